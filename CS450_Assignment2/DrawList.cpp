@@ -0,0 +1,75 @@
+#include "DrawList.h"
+#include "JobSystem.h"
+#include <algorithm>
+
+// Objects one preparation job handles
+#define OBJECTS_PER_JOB 256
+
+ViewFrustum::ViewFrustum( const mat4& projection )
+{
+	// rows combine into the clip planes -w <= x, y, z <= w
+	vec4 x = projection[0], y = projection[1], z = projection[2], w = projection[3];
+	vec4 raw[6] = { w + x, w - x, w + y, w - y, w + z, w - z };
+
+	for (int i = 0; i < 6; i++)
+	{
+		float length = sqrtf(raw[i].x * raw[i].x + raw[i].y * raw[i].y + raw[i].z * raw[i].z);
+		planes[i] = raw[i] / length;
+	}
+}
+
+bool ViewFrustum::intersectsSphere( const vec3& center, float radius ) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		const vec4& p = planes[i];
+		if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+			return false;
+	}
+	return true;
+}
+
+bool ViewFrustum::intersectsBox( const vec3& lo, const vec3& hi ) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		// the corner farthest along the plane's normal
+		const vec4& p = planes[i];
+		float x = p.x >= 0.0f ? hi.x : lo.x;
+		float y = p.y >= 0.0f ? hi.y : lo.y;
+		float z = p.z >= 0.0f ? hi.z : lo.z;
+		if (p.x * x + p.y * y + p.z * z + p.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+void DrawList::build( int objectCount, const PrepareFunction& prepare )
+{
+	int chunkCount = (objectCount + OBJECTS_PER_JOB - 1) / OBJECTS_PER_JOB;
+	_chunks.resize(chunkCount);
+
+	jobs.parallelFor(chunkCount, 1, [&](int begin, int end, int) {
+		for (int c = begin; c < end; c++)
+		{
+			Chunk& chunk = _chunks[c];
+			chunk.packets.clear();
+			chunk.culled = 0;
+
+			int last = std::min(objectCount, (c + 1) * OBJECTS_PER_JOB);
+			for (int i = c * OBJECTS_PER_JOB; i < last; i++)
+			{
+				DrawPacket packet;
+				packet.object = i;
+				if (prepare(i, packet))
+					chunk.packets.push_back(packet);
+				else
+					chunk.culled++;
+			}
+		}
+	});
+
+	_culled = 0;
+	for (int c = 0; c < chunkCount; c++)
+		_culled += _chunks[c].culled;
+}
@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- DrawList.h ---
+//
+//   Per-frame draw packets, prepared off the GL thread.  build() runs the
+//   prepare function for chunks of objects on the JobSystem; each job
+//   writes into its own buffer, and the buffers are read back in object
+//   order, so the GL thread only has to submit what it is given.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __DRAW_LIST_H__
+#define __DRAW_LIST_H__
+
+#include "Angel.h"
+#include <functional>
+#include <vector>
+
+// Everything the GL thread needs to draw one object
+struct DrawPacket {
+	int		object;
+	mat4	modelView;
+	mat3	normalMatrix;	// for the lighting's normals
+	GLuint	pickID;			// written by the pick pass; 0 is the background
+	bool	wireframe;
+	bool	gizmo;			// draw the axis end caps and lines too
+};
+
+// View frustum as six eye-space planes taken from a projection matrix
+struct ViewFrustum {
+	vec4	planes[6];		// xyz is the inward normal, w the offset
+
+	ViewFrustum() {}
+	explicit ViewFrustum( const mat4& projection );
+
+	bool intersectsSphere( const vec3& center, float radius ) const;
+	bool intersectsBox( const vec3& lo, const vec3& hi ) const;
+};
+
+class DrawList {
+public:
+	// Fills in the packet for an object and returns false to cull it.  It
+	// runs on worker threads, so it must only read shared state.
+	typedef std::function<bool(int object, DrawPacket& packet)> PrepareFunction;
+
+	DrawList() : _culled(0) {}
+
+	void build( int objectCount, const PrepareFunction& prepare );
+
+	// Packets in object order
+	template <typename Function>
+	void forEach( Function function ) const
+	{
+		for (size_t c = 0; c < _chunks.size(); c++)
+			for (size_t i = 0; i < _chunks[c].packets.size(); i++)
+				function(_chunks[c].packets[i]);
+	}
+
+	int culled() const { return _culled; }
+
+private:
+	struct Chunk {
+		std::vector<DrawPacket>	packets;
+		int						culled;
+	};
+
+	std::vector<Chunk>	_chunks;
+	int					_culled;
+};
+
+#endif // __DRAW_LIST_H__
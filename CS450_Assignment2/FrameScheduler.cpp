@@ -0,0 +1,64 @@
+#include "FrameScheduler.h"
+#include "Angel.h"
+
+// GLUT timers only carry an int, so the scheduler firing is kept here
+static FrameScheduler* activeScheduler = NULL;
+
+FrameScheduler::FrameScheduler() :
+	_dirty(DirtyNone), _interval(16), _lastFrameTime(-1), _timerArmed(false),
+	_framePosted(false), _framesRendered(0), _framesSkipped(0)
+{
+}
+
+void FrameScheduler::invalidate( unsigned flags )
+{
+	if (flags == DirtyNone)
+	{
+		_framesSkipped++;
+		return;
+	}
+
+	_dirty |= flags;
+
+	// already waiting on a frame that will pick this change up
+	if (_timerArmed || _framePosted)
+	{
+		_framesSkipped++;
+		return;
+	}
+
+	int now = glutGet(GLUT_ELAPSED_TIME);
+	int wait = (_lastFrameTime < 0) ? 0 : _lastFrameTime + _interval - now;
+
+	if (wait <= 0)
+	{
+		_framePosted = true;
+		glutPostRedisplay();
+	}
+	else
+	{
+		activeScheduler = this;
+		_timerArmed = true;
+		glutTimerFunc(wait, timerFired, 0);
+	}
+}
+
+void FrameScheduler::timerFired( int value )
+{
+	FrameScheduler* scheduler = activeScheduler;
+	scheduler->_timerArmed = false;
+
+	if (scheduler->_dirty != DirtyNone && !scheduler->_framePosted)
+	{
+		scheduler->_framePosted = true;
+		glutPostRedisplay();
+	}
+}
+
+void FrameScheduler::frameRendered()
+{
+	_dirty = DirtyNone;
+	_framePosted = false;
+	_lastFrameTime = glutGet(GLUT_ELAPSED_TIME);
+	_framesRendered++;
+}
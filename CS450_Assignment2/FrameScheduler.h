@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- FrameScheduler.h ---
+//
+//   Draws on demand instead of on every input event.  Input handlers report
+//   what they actually changed; requests are coalesced so that at most one
+//   frame is posted per frame interval, and nothing is posted at all while
+//   the scene is idle.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __FRAME_SCHEDULER_H__
+#define __FRAME_SCHEDULER_H__
+
+enum DirtyFlags {
+	DirtyNone		= 0,
+	DirtyScene		= 1 << 0,	// object transforms or draw state
+	DirtyCamera		= 1 << 1,	// eye/at of a view
+	DirtySelection	= 1 << 2,	// picked object or axis
+	DirtyShaders	= 1 << 3,	// a shader variant may have become ready
+	DirtyInput		= 1 << 4	// input is queued for the next frame to apply
+};
+
+class FrameScheduler {
+public:
+	FrameScheduler();
+
+	// Frames are posted no closer together than this; defaults to 60 Hz
+	void setInterval( int milliseconds ) { _interval = milliseconds; }
+
+	// Marks state as changed and makes sure a frame gets posted.  Passing
+	// DirtyNone records an event that needed no redraw.
+	void invalidate( unsigned flags );
+
+	// Called from the display callback once the frame has been handed to
+	// the render thread
+	void frameRendered();
+
+	unsigned dirtyFlags() const { return _dirty; }
+
+	unsigned long framesRendered() const { return _framesRendered; }
+
+	// Redraw requests that did not cost a frame of their own, either because
+	// nothing had changed or because they were folded into a pending frame
+	unsigned long framesSkipped() const { return _framesSkipped; }
+
+private:
+	static void timerFired( int value );
+
+	unsigned		_dirty;
+	int				_interval;
+	int				_lastFrameTime;
+	bool			_timerArmed;
+	bool			_framePosted;
+	unsigned long	_framesRendered;
+	unsigned long	_framesSkipped;
+};
+
+#endif // __FRAME_SCHEDULER_H__
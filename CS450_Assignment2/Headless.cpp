@@ -0,0 +1,158 @@
+#include "Headless.h"
+#include "Angel.h"
+#include "Log.h"
+
+#include <string.h>
+
+#ifndef __APPLE__
+#  include <EGL/egl.h>
+#  include <EGL/eglext.h>
+#endif
+
+#ifdef __APPLE__
+
+bool headlessCreateContext()
+{
+	LOG_ERROR("headless mode needs EGL, which isn't available on OS X");
+	return false;
+}
+
+bool headlessCreateFramebuffer( int width, int height )
+{
+	return false;
+}
+
+void headlessDestroyContext()
+{
+}
+
+#else
+
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+static GLuint offscreenFramebuffer = 0;
+static GLuint offscreenRenderbuffers[2] = { 0, 0 };
+
+static bool hasEGLExtension( const char* extensions, const char* name )
+{
+	size_t length = strlen(name);
+	for (const char* p = extensions; p != NULL && (p = strstr(p, name)) != NULL; p += length)
+	{
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+			return true;
+	}
+	return false;
+}
+
+bool headlessCreateContext()
+{
+	// the surfaceless platform needs no display server at all; fall back to
+	// the default display where it isn't supported
+	const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (hasEGLExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+	{
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay != NULL)
+			eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (eglDisplay == EGL_NO_DISPLAY)
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+	{
+		LOG_ERROR("couldn't initialize EGL (0x%x)", eglGetError());
+		return false;
+	}
+
+	const char* displayExtensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+	if (!hasEGLExtension(displayExtensions, "EGL_KHR_surfaceless_context"))
+	{
+		LOG_ERROR("EGL %d.%d has no surfaceless context support", major, minor);
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		LOG_ERROR("EGL can't create desktop OpenGL contexts");
+		return false;
+	}
+
+	EGLConfig config = (EGLConfig)0;	// EGL_NO_CONFIG_KHR
+	EGLint configCount = 0;
+	const EGLint configAttribs[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	if (!hasEGLExtension(displayExtensions, "EGL_KHR_no_config_context"))
+		eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount);
+
+	// same version and flags as the windowed context
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+		EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+		EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE_BIT_KHR,
+		EGL_NONE
+	};
+	eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+	if (eglContext == EGL_NO_CONTEXT)
+	{
+		LOG_ERROR("couldn't create a 3.2 core context (0x%x)", eglGetError());
+		return false;
+	}
+
+	if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+	{
+		LOG_ERROR("couldn't make the headless context current (0x%x)", eglGetError());
+		return false;
+	}
+	return true;
+}
+
+bool headlessCreateFramebuffer( int width, int height )
+{
+	glGenFramebuffers(1, &offscreenFramebuffer);
+	glGenRenderbuffers(2, offscreenRenderbuffers);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, offscreenRenderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, offscreenRenderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, offscreenFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenRenderbuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreenRenderbuffers[1]);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		LOG_ERROR("offscreen framebuffer is incomplete");
+		return false;
+	}
+
+	// there is no window to set this for us
+	glViewport(0, 0, width, height);
+	return true;
+}
+
+void headlessDestroyContext()
+{
+	if (offscreenFramebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &offscreenFramebuffer);
+		glDeleteRenderbuffers(2, offscreenRenderbuffers);
+		offscreenFramebuffer = 0;
+	}
+	if (eglDisplay != EGL_NO_DISPLAY)
+	{
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (eglContext != EGL_NO_CONTEXT)
+			eglDestroyContext(eglDisplay, eglContext);
+		eglTerminate(eglDisplay);
+	}
+	eglContext = EGL_NO_CONTEXT;
+	eglDisplay = EGL_NO_DISPLAY;
+}
+
+#endif // __APPLE__
@@ -0,0 +1,25 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- Headless.h ---
+//
+//   A GL context with no window, for benchmarking on build machines.  The
+//   context comes from EGL on Mesa's surfaceless platform, so it works
+//   without an X server and with nothing but llvmpipe installed.  Drawing
+//   goes to an offscreen framebuffer the size the window would have been.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __HEADLESS_H__
+#define __HEADLESS_H__
+
+// Creates a 3.2 core context and makes it current.  Returns false when no
+// headless context is available (always the case on OS X).
+bool headlessCreateContext();
+
+// Creates and binds the offscreen color/depth framebuffer.  Call after the
+// GL entry points are loaded (glewInit).
+bool headlessCreateFramebuffer( int width, int height );
+
+void headlessDestroyContext();
+
+#endif // __HEADLESS_H__
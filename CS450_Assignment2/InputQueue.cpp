@@ -0,0 +1,54 @@
+#include "InputQueue.h"
+#include "Angel.h"
+
+InputQueue::InputQueue() :
+	_step(8), _maxSteps(4), _motionSteps(0), _eventsReceived(0), _eventsCoalesced(0)
+{
+}
+
+void InputQueue::push( InputEvent event )
+{
+	event.time = glutGet(GLUT_ELAPSED_TIME);
+	_eventsReceived++;
+
+	if (event.type == InputMotion && !event.path &&
+		!_events.empty() && _events.back().type == InputMotion && !_events.back().path)
+	{
+		// the handlers only care where the mouse ended up, so a later
+		// position in the same step, or past the last step a frame
+		// applies, replaces the earlier one
+		const InputEvent& last = _events.back();
+		if (last.time / _step == event.time / _step || _motionSteps >= _maxSteps)
+		{
+			_events.back() = event;
+			_eventsCoalesced++;
+			return;
+		}
+	}
+
+	if (event.type == InputMotion && !event.path)
+		_motionSteps++;
+	_events.push_back(event);
+}
+
+int InputQueue::update( const Handler& apply )
+{
+	// take the events first, so anything a handler queues waits for the
+	// next update
+	std::vector<InputEvent> events;
+	events.swap(_events);
+	_motionSteps = 0;
+
+	for (size_t i = 0; i < events.size(); i++)
+		apply(events[i]);
+
+	int applied = (int)events.size();
+
+	// hand the storage back so steady input doesn't allocate
+	if (_events.empty())
+	{
+		events.clear();
+		_events.swap(events);
+	}
+	return applied;
+}
@@ -0,0 +1,76 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- InputQueue.h ---
+//
+//   Holds keyboard and mouse events from the GLUT callbacks until the next
+//   frame applies them, in order, before it draws.  Events are stamped with
+//   the time they arrived, and motion is coalesced on a fixed grid of
+//   input time: the motion events within one step become a single event at
+//   the latest position.  A frame applies at most a handful of motion
+//   steps however long it has been since the last one, so a 1000 Hz mouse
+//   costs the frame what a 60 Hz one does.  Motion marked as a path, whose
+//   handler keeps every point it passes through, is queued as it came.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __INPUT_QUEUE_H__
+#define __INPUT_QUEUE_H__
+
+#include <functional>
+#include <vector>
+
+enum InputEventType {
+	InputKey = 0,		// key pressed
+	InputButton,		// mouse button pressed or released
+	InputMotion			// mouse moved with a button down
+};
+
+struct InputEvent {
+	InputEventType type;
+	int time;			// GLUT_ELAPSED_TIME when it arrived, in ms
+	int x;				// window pixel, as GLUT gave it
+	int y;
+	unsigned char key;	// InputKey
+	int button;			// InputButton
+	int state;
+	int modifiers;		// glutGetModifiers(), which is only valid in the callback
+	bool path;			// InputMotion whose every position matters, such as a
+						// lasso's; never coalesced
+};
+
+class InputQueue {
+public:
+	typedef std::function<void(const InputEvent&)> Handler;
+
+	InputQueue();
+
+	// Motion within one step is coalesced; defaults to 8 ms, 125 Hz
+	void setStep( int milliseconds ) { _step = milliseconds; }
+
+	// Motion steps one update applies; later motion folds into the last
+	void setMaxSteps( int steps ) { _maxSteps = steps; }
+
+	// Queues an event from a GLUT callback, stamping it with the time
+	void push( InputEvent event );
+
+	// Hands every queued event to apply, oldest first, and empties the
+	// queue.  Returns how many were applied.
+	int update( const Handler& apply );
+
+	bool empty() const { return _events.empty(); }
+
+	unsigned long eventsReceived() const { return _eventsReceived; }
+
+	// Motion events that were folded into a later one instead of applied
+	unsigned long eventsCoalesced() const { return _eventsCoalesced; }
+
+private:
+	std::vector<InputEvent>	_events;
+	int						_step;
+	int						_maxSteps;
+	int						_motionSteps;
+	unsigned long			_eventsReceived;
+	unsigned long			_eventsCoalesced;
+};
+
+#endif // __INPUT_QUEUE_H__
@@ -0,0 +1,120 @@
+#include "JobSystem.h"
+
+JobSystem jobs;
+
+JobSystem::JobSystem() :
+	_stopping(false), _generation(0), _body(NULL), _count(0), _grain(1),
+	_next(0), _remaining(0), _active(0)
+{
+}
+
+JobSystem::~JobSystem()
+{
+	stop();
+}
+
+void JobSystem::start( int threadCount )
+{
+	stop();
+
+	if (threadCount <= 0)
+		threadCount = (int)std::thread::hardware_concurrency();
+	if (threadCount <= 0)
+		threadCount = 1;
+
+	_stopping = false;
+	for (int i = 0; i < threadCount - 1; i++)
+		_workers.push_back(std::thread(&JobSystem::workerMain, this, i + 1));
+}
+
+void JobSystem::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_wake.notify_all();
+
+	for (size_t i = 0; i < _workers.size(); i++)
+		_workers[i].join();
+	_workers.clear();
+}
+
+void JobSystem::parallelFor( int count, int grain, const RangeFunction& body )
+{
+	if (count <= 0)
+		return;
+	if (grain < 1)
+		grain = 1;
+
+	int chunks = (count + grain - 1) / grain;
+
+	// not worth waking anyone
+	if (_workers.empty() || chunks == 1)
+	{
+		for (int begin = 0; begin < count; begin += grain)
+			body(begin, begin + grain < count ? begin + grain : count, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_body = &body;
+		_count = count;
+		_grain = grain;
+		_next.store(0);
+		_remaining.store(chunks);
+		_generation++;
+	}
+	_wake.notify_all();
+
+	runChunks(0);
+
+	// wait for the chunks other threads took, and for every worker to be out
+	// of runChunks before `body` goes out of scope
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [this] { return _remaining.load() == 0 && _active == 0; });
+	_body = NULL;
+}
+
+void JobSystem::runChunks( int worker )
+{
+	for ( ; ; )
+	{
+		int chunk = _next.fetch_add(1);
+		int begin = chunk * _grain;
+		if (begin >= _count)
+			break;
+		int end = begin + _grain < _count ? begin + _grain : _count;
+
+		(*_body)(begin, end, worker);
+
+		_remaining.fetch_sub(1);
+	}
+}
+
+void JobSystem::workerMain( int worker )
+{
+	unsigned long seen = 0;
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	for ( ; ; )
+	{
+		_wake.wait(lock, [&] { return _stopping || _generation != seen; });
+		if (_stopping)
+			return;
+
+		seen = _generation;
+		if (_body == NULL)
+			continue;
+
+		_active++;
+		lock.unlock();
+		runChunks(worker);
+		lock.lock();
+		_active--;
+
+		if (_remaining.load() == 0 && _active == 0)
+			_done.notify_all();
+	}
+}
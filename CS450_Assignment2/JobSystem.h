@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- JobSystem.h ---
+//
+//   A fixed pool of worker threads for data-parallel loops.  parallelFor
+//   splits an index range into chunks that the workers and the calling
+//   thread take from a shared counter, and returns once every chunk is
+//   done.  Only one thread should issue parallelFor at a time.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __JOB_SYSTEM_H__
+#define __JOB_SYSTEM_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem {
+public:
+	// Called as body(begin, end, worker); worker is in [0, threadCount())
+	// and is the same for every chunk a given thread runs, so it can index
+	// per-thread scratch space.
+	typedef std::function<void(int begin, int end, int worker)> RangeFunction;
+
+	JobSystem();
+	~JobSystem();
+
+	// Starts threadCount - 1 workers; the caller of parallelFor is the last
+	// thread.  0 means one thread per hardware thread.
+	void start( int threadCount = 0 );
+	void stop();
+
+	int threadCount() const { return (int)_workers.size() + 1; }
+
+	// Runs body over [0, count) in chunks of at most grain indices
+	void parallelFor( int count, int grain, const RangeFunction& body );
+
+private:
+	void workerMain( int worker );
+	void runChunks( int worker );
+
+	std::vector<std::thread>	_workers;
+	std::mutex					_mutex;
+	std::condition_variable		_wake;
+	std::condition_variable		_done;
+	bool						_stopping;
+	unsigned long				_generation;	// bumped for every parallelFor
+
+	// the loop being run
+	const RangeFunction*		_body;
+	int							_count;
+	int							_grain;
+	std::atomic<int>			_next;
+	std::atomic<int>			_remaining;		// chunks not yet finished
+	int							_active;		// workers inside runChunks
+};
+
+extern JobSystem jobs;
+
+#endif // __JOB_SYSTEM_H__
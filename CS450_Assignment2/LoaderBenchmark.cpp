@@ -0,0 +1,505 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- LoaderBenchmark.cpp ---
+//
+//   Times the OBJ loader over every .obj the assignments ship, here and in
+//   Assignment_3_Objects, then over synthetic tori written in the same
+//   format, from ten thousand faces up to ten million in steps of ten.
+//   Each file is loaded cold, with its pages dropped from the file cache
+//   first where the system allows it, and warm, and each run reports MB/s,
+//   faces/s, the heap allocations it made and its peak RSS.  Everything is
+//   printed as one JSON object; the makefile's benchmark-loader target
+//   writes it to loaderbench.json.  Run it from this directory.
+//
+//     loaderbench [--repetitions n] [--max-faces n] [--filter text] [file.obj ...]
+//
+//   Files on the command line replace the bundled ones.  --max-faces 0
+//   leaves out the synthetic meshes, and --max-faces 100000000 adds a
+//   hundred-million-face one, which needs ten times the memory of the
+//   ten-million one.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ObjLoader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+// repetitions per cache state when --repetitions is not given
+#define DEFAULT_REPETITIONS 5
+// files bigger than this load once per cache state
+#define LARGE_FILE_BYTES (64 << 20)
+// largest synthetic mesh when --max-faces is not given
+#define DEFAULT_MAX_FACES 10000000
+// the synthetic meshes start here and grow tenfold
+#define SYNTHETIC_MIN_FACES 10000
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+//
+//  Allocation counting.  Every operator new in the process goes through
+//  here, with its size kept in front of the block so delete can take it
+//  back off the live total.  The benchmark is single threaded.
+//
+
+struct AllocationCounts
+{
+	size_t allocations;
+	size_t bytes;		// allocated in all
+	size_t live;		// allocated and not yet freed
+	size_t peak;		// most live at once
+};
+
+static AllocationCounts counts;
+
+// keeps the block after it 16-byte aligned, like malloc's
+#define ALLOCATION_HEADER 16
+
+// GCC checks inlined deletes against the block new returned and takes the
+// header for an out-of-bounds read
+#ifdef __GNUC__
+#  define ALLOCATION_HOOK __attribute__((noinline))
+#else
+#  define ALLOCATION_HOOK
+#endif
+
+ALLOCATION_HOOK void* operator new( size_t size )
+{
+	char* block = (char*)malloc(size + ALLOCATION_HEADER);
+	if (block == NULL)
+		throw bad_alloc();
+	*(size_t*)block = size;
+
+	counts.allocations++;
+	counts.bytes += size;
+	counts.live += size;
+	counts.peak = max(counts.peak, counts.live);
+	return block + ALLOCATION_HEADER;
+}
+
+void* operator new[]( size_t size )
+{
+	return operator new(size);
+}
+
+ALLOCATION_HOOK void operator delete( void* p ) noexcept
+{
+	if (p == NULL)
+		return;
+	char* block = (char*)p - ALLOCATION_HEADER;
+	counts.live -= *(size_t*)block;
+	free(block);
+}
+
+void operator delete[]( void* p ) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete[]( void* p, size_t ) noexcept
+{
+	operator delete(p);
+}
+
+//----------------------------------------------------------------------------
+//
+//  Memory and file cache
+//
+
+// Starts a new peak RSS for peakRSS to report, where the system can
+static void resetPeakRSS()
+{
+#ifdef __linux__
+	int fd = open("/proc/self/clear_refs", O_WRONLY);
+	if (fd >= 0)
+	{
+		if (write(fd, "5", 1) != 1)
+			fprintf(stderr, "couldn't reset the peak RSS\n");
+		close(fd);
+	}
+#endif
+}
+
+// Peak RSS in MB since resetPeakRSS, or since the process started
+static double peakRSS()
+{
+#ifdef __linux__
+	FILE* status = fopen("/proc/self/status", "r");
+	if (status != NULL)
+	{
+		char line[256];
+		long kilobytes = -1;
+		while (fgets(line, sizeof(line), status) != NULL)
+			if (sscanf(line, "VmHWM: %ld kB", &kilobytes) == 1)
+				break;
+		fclose(status);
+		if (kilobytes >= 0)
+			return kilobytes / 1024.0;
+	}
+#endif
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / (1024.0 * 1024.0);	// bytes
+#else
+	return usage.ru_maxrss / 1024.0;			// kilobytes
+#endif
+}
+
+// Drops the file's pages from the cache; false where that isn't possible
+static bool evict( const string& path )
+{
+#if defined(__linux__) && defined(POSIX_FADV_DONTNEED)
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	bool dropped = fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+	close(fd);
+	return dropped;
+#else
+	return false;
+#endif
+}
+
+// Fraction of the file's pages in the cache, or -1 if it can't be told
+static double resident( const string& path, size_t bytes )
+{
+#ifdef __linux__
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0 || bytes == 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		return -1.0;
+	}
+	void* map = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1.0;
+
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t pages = (bytes + pageSize - 1) / pageSize;
+	vector<unsigned char> inCore(pages);
+	size_t count = 0;
+	if (mincore(map, bytes, &inCore[0]) == 0)
+		for (size_t i = 0; i < pages; i++)
+			count += inCore[i] & 1;
+	munmap(map, bytes);
+	return (double)count / pages;
+#else
+	return -1.0;
+#endif
+}
+
+static size_t fileSize( const string& path )
+{
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 ? (size_t)info.st_size : 0;
+}
+
+//----------------------------------------------------------------------------
+//
+//  Inputs
+//
+
+// The .obj files in a directory, sorted
+static void listObjs( const string& directory, vector<string>& files )
+{
+	DIR* dir = opendir(directory.c_str());
+	if (dir == NULL)
+		return;
+
+	vector<string> found;
+	while (struct dirent* entry = readdir(dir))
+	{
+		string name = entry->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".obj") == 0)
+			found.push_back(directory == "." ? name : directory + "/" + name);
+	}
+	closedir(dir);
+
+	sort(found.begin(), found.end());
+	files.insert(files.end(), found.begin(), found.end());
+}
+
+// Writes a torus of about the given number of faces in the bundled files'
+// format, and syncs it so it can be evicted; returns the faces written
+static long writeTorus( const string& path, long faces )
+{
+	long rings = max(3L, (long)sqrt(faces / 2.0));
+	long segments = max(3L, faces / 2 / rings);
+	const double R = 0.7, r = 0.3;
+
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == NULL)
+		return 0;
+
+	fprintf(file, "#\tsynthetic torus : %ld vertices, %ld normals, %ld faces.\n", rings * segments, rings * segments, 2 * rings * segments);
+	fprintf(file, "#\tRange : [%g, %g, %g] -> [%g, %g, %g]\n", -(R + r), -(R + r), -r, R + r, R + r, r);
+	fprintf(file, "#\tSpan : (%g, %g, %g)\n", 2 * (R + r), 2 * (R + r), 2 * r);
+
+	for (long i = 0; i < rings; i++)
+	{
+		double u = 2.0 * M_PI * i / rings;
+		for (long j = 0; j < segments; j++)
+		{
+			double v = 2.0 * M_PI * j / segments;
+			fprintf(file, "v %g %g %g\n", (R + r * cos(v)) * cos(u), (R + r * cos(v)) * sin(u), r * sin(v));
+		}
+	}
+	for (long i = 0; i < rings; i++)
+	{
+		double u = 2.0 * M_PI * i / rings;
+		for (long j = 0; j < segments; j++)
+		{
+			double v = 2.0 * M_PI * j / segments;
+			fprintf(file, "vn %g %g %g\n", cos(v) * cos(u), cos(v) * sin(u), sin(v));
+		}
+	}
+	// two triangles a quad; vertices and normals share indices
+	for (long i = 0; i < rings; i++)
+	{
+		for (long j = 0; j < segments; j++)
+		{
+			long a = i * segments + j + 1;
+			long b = ((i + 1) % rings) * segments + j + 1;
+			long c = ((i + 1) % rings) * segments + (j + 1) % segments + 1;
+			long d = i * segments + (j + 1) % segments + 1;
+			fprintf(file, "f %ld//%ld %ld//%ld %ld//%ld\n", a, a, b, b, c, c);
+			fprintf(file, "f %ld//%ld %ld//%ld %ld//%ld\n", a, a, c, c, d, d);
+		}
+	}
+
+	fflush(file);
+	fsync(fileno(file));
+	fclose(file);
+	return 2 * rings * segments;
+}
+
+//----------------------------------------------------------------------------
+//
+//  Runs
+//
+
+// The loaders under test; parser modes go here as they are added
+struct Loader
+{
+	const char* name;
+	bool (*load)( const string& fileName, vector<vec4>& vertices, vector<vec4>& normals );
+};
+
+static const Loader loaders[] = {
+	{ "stream", loadObj },
+};
+
+// Everything one file, loader and cache state produced
+struct Result
+{
+	string file;
+	bool synthetic;
+	const char* loader;
+	bool cold;
+	bool evicted;			// cold runs only: the pages were dropped first
+	double residentBefore;	// cold runs only: fraction cached before the first load
+	size_t bytes;
+	long faces;
+	vector<double> ms;
+	AllocationCounts allocations;	// of the last run
+	double peakRssMB;				// highest over the runs
+};
+
+static int repetitions = DEFAULT_REPETITIONS;
+static const char* filter = NULL;
+static vector<Result> results;
+
+// One timed load, with its allocations and peak RSS folded into result
+static bool loadOnce( const Loader& loader, const string& path, Result& result )
+{
+	vector<vec4> vertices, normals;
+	resetPeakRSS();
+	size_t before = counts.live;
+	counts.allocations = counts.bytes = 0;
+	counts.peak = before;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	bool loaded = loader.load(path, vertices, normals);
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	if (!loaded)
+		return false;
+
+	// the peak counts only what the load added
+	AllocationCounts during = counts;
+	during.live -= before;
+	during.peak -= before;
+
+	result.ms.push_back(ms);
+	result.faces = (long)vertices.size() / 3;
+	result.allocations = during;
+	result.peakRssMB = max(result.peakRssMB, peakRSS());
+	return true;
+}
+
+static void benchmark( const string& path, bool synthetic )
+{
+	if (filter != NULL && strstr(path.c_str(), filter) == NULL)
+		return;
+
+	size_t bytes = fileSize(path);
+	int runs = bytes > LARGE_FILE_BYTES ? 1 : repetitions;
+
+	for (size_t l = 0; l < sizeof(loaders) / sizeof(loaders[0]); l++)
+	{
+		for (int cold = 1; cold >= 0; cold--)
+		{
+			Result result;
+			result.file = path;
+			result.synthetic = synthetic;
+			result.loader = loaders[l].name;
+			result.cold = cold;
+			result.evicted = true;
+			result.residentBefore = -1.0;
+			result.bytes = bytes;
+			result.faces = 0;
+			result.peakRssMB = 0.0;
+
+			// the last cold run leaves the file cached for the warm ones
+			for (int run = 0; run < runs; run++)
+			{
+				if (cold)
+				{
+					result.evicted = evict(path) && result.evicted;
+					if (run == 0)
+						result.residentBefore = resident(path, bytes);
+				}
+				if (!loadOnce(loaders[l], path, result))
+				{
+					fprintf(stderr, "couldn't read %s\n", path.c_str());
+					return;
+				}
+			}
+			results.push_back(result);
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+
+static const char* compiler()
+{
+#if defined(__clang__)
+	return "clang " __clang_version__;
+#elif defined(__GNUC__)
+	return "gcc " __VERSION__;
+#else
+	return "unknown";
+#endif
+}
+
+// One JSON object on stdout, a line per result.  Rates are from the median
+// run.
+static void printReport()
+{
+	printf("{\"suite\": \"obj-loader\", \"compiler\": \"%s\", \"repetitions\": %d, \"results\": [\n",
+		   compiler(), repetitions);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Result& r = results[i];
+		vector<double> sorted(r.ms);
+		sort(sorted.begin(), sorted.end());
+		size_t n = sorted.size();
+		double median = n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+		double mean = 0.0, squares = 0.0;
+		for (size_t k = 0; k < n; k++)
+			mean += sorted[k] / n;
+		for (size_t k = 0; k < n; k++)
+			squares += (sorted[k] - mean) * (sorted[k] - mean);
+		double stddev = n > 1 ? sqrt(squares / (n - 1)) : 0.0;
+
+		printf("  {\"file\": \"%s\", \"synthetic\": %s, \"loader\": \"%s\", \"cache\": \"%s\", ",
+			   r.file.c_str(), r.synthetic ? "true" : "false", r.loader, r.cold ? "cold" : "warm");
+		if (r.cold)
+			printf("\"evicted\": %s, \"resident_before\": %.3f, ", r.evicted ? "true" : "false", r.residentBefore);
+		printf("\"bytes\": %zu, \"faces\": %ld, \"runs\": %zu, "
+			   "\"ms\": {\"mean\": %.3f, \"stddev\": %.3f, \"min\": %.3f, \"median\": %.3f, \"max\": %.3f}, "
+			   "\"mb_per_s\": %.2f, \"faces_per_s\": %.0f, \"allocations\": %zu, \"allocated_mb\": %.2f, "
+			   "\"heap_peak_mb\": %.2f, \"peak_rss_mb\": %.1f}%s\n",
+			   r.bytes, r.faces, n, mean, stddev, sorted.front(), median, sorted.back(),
+			   r.bytes / (1024.0 * 1024.0) / (median * 1e-3), r.faces / (median * 1e-3),
+			   r.allocations.allocations, r.allocations.bytes / (1024.0 * 1024.0),
+			   r.allocations.peak / (1024.0 * 1024.0), r.peakRssMB, i + 1 < results.size() ? "," : "");
+	}
+	printf("]}\n");
+}
+
+int main( int argc, char** argv )
+{
+	long maxFaces = DEFAULT_MAX_FACES;
+	vector<string> files;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc)
+			repetitions = max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--max-faces") == 0 && i + 1 < argc)
+			maxFaces = atol(argv[++i]);
+		else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else if (argv[i][0] != '-')
+			files.push_back(argv[i]);
+		else
+		{
+			fprintf(stderr, "usage: %s [--repetitions n] [--max-faces n] [--filter text] [file.obj ...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (files.empty())
+	{
+		listObjs(".", files);
+		listObjs("Assignment_3_Objects", files);
+		if (files.empty())
+			fprintf(stderr, "no .obj files here; run from CS450_Assignment2\n");
+	}
+	for (size_t i = 0; i < files.size(); i++)
+		benchmark(files[i], false);
+
+	const char* temp = getenv("TMPDIR");
+	string directory = temp != NULL && temp[0] != '\0' ? temp : "/tmp";
+	for (long faces = SYNTHETIC_MIN_FACES; faces <= maxFaces; faces *= 10)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "/loaderbench_torus_%ld.obj", faces);
+		string path = directory + name;
+		if (filter != NULL && strstr(path.c_str(), filter) == NULL)
+			continue;
+
+		if (writeTorus(path, faces) == 0)
+		{
+			fprintf(stderr, "couldn't write %s\n", path.c_str());
+			continue;
+		}
+		benchmark(path, true);
+		unlink(path.c_str());
+	}
+
+	printReport();
+
+	return 0;
+}
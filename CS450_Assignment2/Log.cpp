@@ -0,0 +1,169 @@
+#include "Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#define LOG_RING_SIZE     1024		// must be a power of two
+#define LOG_MESSAGE_SIZE  232
+
+std::atomic<int> logRuntimeLevel(LOG_LEVEL_INFO);
+
+// One slot of the ring.  `sequence` says whose turn the slot is: it equals
+// the write position when free for a producer, and position+1 once the
+// record is published for the writer thread.
+struct LogRecord {
+	std::atomic<size_t>	sequence;
+	int					level;
+	int					line;
+	const char*			file;
+	long long			time;		// microseconds since logInit
+	char				message[LOG_MESSAGE_SIZE];
+};
+
+static LogRecord logRing[LOG_RING_SIZE];
+static std::atomic<size_t> logWritePos(0);
+static size_t logReadPos = 0;		// only touched by the writer thread
+static std::atomic<unsigned long> logDropped(0);
+static std::atomic<bool> logRunning(false);
+static std::thread logThread;
+static std::chrono::steady_clock::time_point logStart = std::chrono::steady_clock::now();
+
+static const char* logLevelNames[] = { "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR" };
+
+static struct LogRingInit {
+	LogRingInit() {
+		for (size_t i = 0; i < LOG_RING_SIZE; i++)
+			logRing[i].sequence.store(i, std::memory_order_relaxed);
+	}
+} logRingInit;
+
+//----------------------------------------------------------------------------
+
+void logWrite( int level, const char* file, int line, const char* format, ... )
+{
+	// claim a slot
+	size_t pos = logWritePos.load(std::memory_order_relaxed);
+	LogRecord* record;
+	for ( ; ; )
+	{
+		record = &logRing[pos & (LOG_RING_SIZE - 1)];
+		size_t sequence = record->sequence.load(std::memory_order_acquire);
+		long diff = (long)sequence - (long)pos;
+
+		if (diff == 0)
+		{
+			if (logWritePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// full; the writer thread is behind
+			logDropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		else
+		{
+			pos = logWritePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	record->level = level;
+	record->line = line;
+	const char* slash = strrchr(file, '/');
+	record->file = slash ? slash + 1 : file;
+	record->time = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - logStart).count();
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(record->message, LOG_MESSAGE_SIZE, format, args);
+	va_end(args);
+
+	// publish
+	record->sequence.store(pos + 1, std::memory_order_release);
+}
+
+// Writes every published record; returns how many there were
+static int logDrain()
+{
+	int count = 0;
+	for ( ; ; )
+	{
+		LogRecord& record = logRing[logReadPos & (LOG_RING_SIZE - 1)];
+		if (record.sequence.load(std::memory_order_acquire) != logReadPos + 1)
+			break;
+
+		int level = record.level < LOG_LEVEL_OFF ? record.level : LOG_LEVEL_ERROR;
+		fprintf(stderr, "[%10.3f ms] %s %s:%d  %s\n", record.time / 1000.0,
+				logLevelNames[level], record.file, record.line, record.message);
+
+		record.sequence.store(logReadPos + LOG_RING_SIZE, std::memory_order_release);
+		logReadPos++;
+		count++;
+	}
+
+	static unsigned long reported = 0;
+	unsigned long dropped = logDropped.load(std::memory_order_relaxed);
+	if (dropped != reported)
+	{
+		fprintf(stderr, "[log] %lu messages dropped\n", dropped - reported);
+		reported = dropped;
+	}
+
+	return count;
+}
+
+static void logThreadMain()
+{
+	while (logRunning.load(std::memory_order_acquire))
+	{
+		if (logDrain() == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	logDrain();
+	fflush(stderr);
+}
+
+//----------------------------------------------------------------------------
+
+void logInit()
+{
+	if (logRunning.load())
+		return;
+
+	const char* level = getenv("LOG_LEVEL");
+	if (level != NULL)
+	{
+		const char* names[] = { "trace", "debug", "info", "warn", "error", "off" };
+		for (int i = LOG_LEVEL_TRACE; i <= LOG_LEVEL_OFF; i++)
+		{
+			if (strcmp(level, names[i]) == 0)
+				logSetLevel(i);
+		}
+	}
+
+	logRunning.store(true);
+	logThread = std::thread(logThreadMain);
+	atexit(logShutdown);
+}
+
+void logShutdown()
+{
+	if (!logRunning.exchange(false))
+		return;
+	logThread.join();
+}
+
+void logSetLevel( int level )
+{
+	logRuntimeLevel.store(level, std::memory_order_relaxed);
+}
+
+unsigned long logDroppedCount()
+{
+	return logDropped.load(std::memory_order_relaxed);
+}
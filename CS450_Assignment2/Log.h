@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- Log.h ---
+//
+//   Logging for the render and input paths.  A log statement formats its
+//   message into a slot of a lock-free ring buffer and returns; a background
+//   thread writes the records to stderr.  Nothing on the calling thread
+//   touches stdio or takes a lock.  If the ring is full the record is
+//   dropped and counted rather than making the caller wait.
+//
+//   Statements below LOG_COMPILE_LEVEL compile to nothing, arguments
+//   included.  Statements below the runtime level (LOG_LEVEL environment
+//   variable, or logSetLevel) cost one relaxed load and a compare.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <atomic>
+
+#define LOG_LEVEL_TRACE  0
+#define LOG_LEVEL_DEBUG  1
+#define LOG_LEVEL_INFO   2
+#define LOG_LEVEL_WARN   3
+#define LOG_LEVEL_ERROR  4
+#define LOG_LEVEL_OFF    5
+
+#ifndef LOG_COMPILE_LEVEL
+#  ifdef DEBUG
+#    define LOG_COMPILE_LEVEL LOG_LEVEL_TRACE
+#  else
+#    define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#  endif
+#endif
+
+extern std::atomic<int> logRuntimeLevel;
+
+// Starts the writer thread; the runtime level is read from LOG_LEVEL
+// (trace, debug, info, warn, error or off) and defaults to info.
+void logInit();
+
+// Writes out whatever is still queued and stops the writer thread.
+// logInit registers this with atexit.
+void logShutdown();
+
+void logSetLevel( int level );
+
+// Records dropped because the ring buffer was full
+unsigned long logDroppedCount();
+
+void logWrite( int level, const char* file, int line, const char* format, ... )
+#ifdef __GNUC__
+	__attribute__((format(printf, 4, 5)))
+#endif
+	;
+
+#define LOG_AT( level, ... ) \
+	do { \
+		if ( (level) >= LOG_COMPILE_LEVEL && \
+			 (level) >= logRuntimeLevel.load(std::memory_order_relaxed) ) \
+			logWrite( (level), __FILE__, __LINE__, __VA_ARGS__ ); \
+	} while (0)
+
+#define LOG_TRACE( ... )  LOG_AT( LOG_LEVEL_TRACE, __VA_ARGS__ )
+#define LOG_DEBUG( ... )  LOG_AT( LOG_LEVEL_DEBUG, __VA_ARGS__ )
+#define LOG_INFO( ... )   LOG_AT( LOG_LEVEL_INFO, __VA_ARGS__ )
+#define LOG_WARN( ... )   LOG_AT( LOG_LEVEL_WARN, __VA_ARGS__ )
+#define LOG_ERROR( ... )  LOG_AT( LOG_LEVEL_ERROR, __VA_ARGS__ )
+
+#endif // __LOG_H__
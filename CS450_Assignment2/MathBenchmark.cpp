@@ -0,0 +1,606 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MathBenchmark.cpp ---
+//
+//   Microbenchmarks for the Angel math headers: the matrix builders and
+//   products display() runs every frame, the vec4 helpers, quaternions and
+//   the batch transforms over a million-vertex array against memcpy of the
+//   same bytes.  Each kernel is timed over several repetitions and the
+//   results are printed as one JSON object, so runs can be diffed across
+//   commits and compilers.  Where the kernel lets perf_event_open count
+//   instructions (Linux, with hardware counters), each single-threaded
+//   kernel also reports the instructions it retires per op, which are
+//   steadier than the times for comparing code changes.  The makefile builds it twice, as mathbench
+//   with the SIMD kernels and as mathbench-scalar with -DANGEL_NO_SIMD.
+//
+//     mathbench [--repetitions n] [--filter text]
+//
+//   --filter runs only the kernels whose names contain text.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Angel.h"
+#include "JobSystem.h"
+#include "ParallelTransform.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// inputs per pass; small enough to stay in L1 with the results
+#define BENCH_COUNT 256
+// passes per repetition of a kernel
+#define BENCH_PASSES 400
+// vertices in the batch transform arrays, far bigger than the caches
+#define BATCH_VERTICES (1 << 20)
+// passes per repetition of a batch transform
+#define BATCH_PASSES 2
+// repetitions when --repetitions is not given
+#define DEFAULT_REPETITIONS 10
+
+using namespace std;
+
+static float randomFloat()
+{
+	return (float)rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+// The fields of main.cpp's LookAtInfo, with the Euler angles it kept
+// before orientations
+struct ObjectTransform
+{
+	vec4 eye, at, up;
+	quat orientation;
+	vec3 rotate, scale, translate;
+};
+
+// Summary of one kernel's repetitions
+struct Result
+{
+	string name;
+	const char* unit;
+	double mean, variance, min, median, max;
+	double bytesPerSecond;		// batch transforms only, else 0
+	double instructions;		// per op, or < 0 when not counted
+};
+
+// Instructions the calling thread retires in user space, when the
+// hardware and kernel can count them
+class InstructionCounter
+{
+public:
+	InstructionCounter() : _fd(-1)
+	{
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+
+	~InstructionCounter()
+	{
+#ifdef __linux__
+		if (_fd >= 0)
+			close(_fd);
+#endif
+	}
+
+	bool available() const { return _fd >= 0; }
+
+	void start()
+	{
+#ifdef __linux__
+		if (_fd >= 0)
+		{
+			ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	// instructions since start, or -1
+	double stop()
+	{
+#ifdef __linux__
+		long long count;
+		if (_fd >= 0)
+		{
+			ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(_fd, &count, sizeof(count)) == sizeof(count))
+				return (double)count;
+		}
+#endif
+		return -1.0;
+	}
+
+private:
+	int _fd;
+};
+
+static int repetitions = DEFAULT_REPETITIONS;
+static const char* filter = NULL;
+static vector<Result> results;
+static InstructionCounter instructionCounter;
+
+// Something the compiler has to keep every result for
+static float sink = 0.0f;
+
+static void addResult( const char* name, const char* unit, vector<double>& samples, double bytes,
+					   double instructions )
+{
+	Result r;
+	r.name = name;
+	r.unit = unit;
+	r.instructions = instructions;
+
+	double sum = 0.0;
+	for (size_t i = 0; i < samples.size(); i++)
+		sum += samples[i];
+	r.mean = sum / samples.size();
+
+	double squares = 0.0;
+	for (size_t i = 0; i < samples.size(); i++)
+		squares += (samples[i] - r.mean) * (samples[i] - r.mean);
+	r.variance = samples.size() > 1 ? squares / (samples.size() - 1) : 0.0;
+
+	sort(samples.begin(), samples.end());
+	r.min = samples.front();
+	r.max = samples.back();
+	size_t mid = samples.size() / 2;
+	r.median = samples.size() % 2 ? samples[mid] : 0.5 * (samples[mid - 1] + samples[mid]);
+
+	// bytes are per element, like the times
+	r.bytesPerSecond = bytes > 0.0 ? bytes / (r.mean * 1e-9) : 0.0;
+	results.push_back(r);
+}
+
+static bool selected( const char* name )
+{
+	return filter == NULL || strstr(name, filter) != NULL;
+}
+
+// Times BENCH_PASSES passes of kernel, which handles BENCH_COUNT inputs,
+// per repetition
+template <typename Kernel>
+static void run( const char* name, Kernel kernel )
+{
+	if (!selected(name))
+		return;
+
+	kernel();	// warm up
+
+	instructionCounter.start();
+	kernel();
+	double instructions = instructionCounter.stop();
+
+	vector<double> samples;
+	for (int rep = 0; rep < repetitions; rep++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int pass = 0; pass < BENCH_PASSES; pass++)
+			kernel();
+		double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+		samples.push_back(ns / ((double)BENCH_PASSES * BENCH_COUNT));
+	}
+	addResult(name, "ns/op", samples, 0.0, instructions >= 0.0 ? instructions / BENCH_COUNT : -1.0);
+}
+
+// Times passes over the batch arrays; bytes is what one vertex reads and
+// writes.  The instructions of threaded kernels aren't counted, since the
+// counter only sees this thread.
+template <typename Kernel>
+static void runBatch( const char* name, double bytes, bool threaded, Kernel kernel )
+{
+	if (!selected(name))
+		return;
+
+	instructionCounter.start();
+	kernel();
+	double instructions = threaded ? -1.0 : instructionCounter.stop();
+	if (threaded)
+		instructionCounter.stop();
+
+	vector<double> samples;
+	for (int rep = 0; rep < repetitions; rep++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int pass = 0; pass < BATCH_PASSES; pass++)
+			kernel();
+		double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+		samples.push_back(ns / ((double)BATCH_PASSES * BATCH_VERTICES));
+	}
+	addResult(name, "ns/vertex", samples, bytes, instructions >= 0.0 ? instructions / BATCH_VERTICES : -1.0);
+}
+
+static const char* kernelSet()
+{
+#ifdef ANGEL_SIMD
+#ifdef ANGEL_SIMD_AVX
+	return "AVX";
+#elif defined(ANGEL_SIMD_NEON)
+	return "NEON";
+#else
+	return "SSE";
+#endif
+#else
+	return "scalar";
+#endif
+}
+
+static const char* compiler()
+{
+#if defined(__clang__)
+	return "clang " __clang_version__;
+#elif defined(__GNUC__)
+	return "gcc " __VERSION__;
+#else
+	return "unknown";
+#endif
+}
+
+// One JSON object on stdout, a line per result
+static void printReport( float inverseError )
+{
+#ifdef __FMA__
+	bool fma = true;
+#else
+	bool fma = false;
+#endif
+	printf("{\"suite\": \"angel-math\", \"kernels\": \"%s\", \"fma\": %s, \"compiler\": \"%s\", "
+		   "\"threads\": %d, \"repetitions\": %d, \"inverse_error\": %.3g, \"instructions_counted\": %s, "
+		   "\"results\": [\n",
+		   kernelSet(), fma ? "true" : "false", compiler(), jobs.threadCount(), repetitions, inverseError,
+		   instructionCounter.available() ? "true" : "false");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Result& r = results[i];
+		printf("  {\"name\": \"%s\", \"unit\": \"%s\", \"mean\": %.4f, \"variance\": %.6f, \"stddev\": %.4f, "
+			   "\"min\": %.4f, \"median\": %.4f, \"max\": %.4f",
+			   r.name.c_str(), r.unit, r.mean, r.variance, sqrt(r.variance), r.min, r.median, r.max);
+		if (r.bytesPerSecond > 0.0)
+			printf(", \"gb_per_s\": %.3f", r.bytesPerSecond * 1e-9);
+		if (r.instructions >= 0.0)
+			printf(", \"instructions\": %.1f", r.instructions);
+		printf("}%s\n", i + 1 < results.size() ? "," : "");
+	}
+	printf("]}\n");
+}
+
+int main( int argc, char** argv )
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc)
+			repetitions = max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [--repetitions n] [--filter text]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	srand(450);
+
+	vector<mat4> a(BENCH_COUNT), b(BENCH_COUNT), out(BENCH_COUNT);
+	vector<vec4> v(BENCH_COUNT), w(BENCH_COUNT), vOut(BENCH_COUNT);
+	vector<vec3> v3(BENCH_COUNT), v3Out(BENCH_COUNT);
+	vector<float> angles(BENCH_COUNT);
+	vector<quat> q(BENCH_COUNT), qOut(BENCH_COUNT);
+	vector<ObjectTransform> objects(BENCH_COUNT);
+	vector<mat4> modelViews(BENCH_COUNT);
+	vector<mat3> normalMatrices(BENCH_COUNT);
+	for (int i = 0; i < BENCH_COUNT; i++)
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			a[i][r] = vec4(randomFloat(), randomFloat(), randomFloat(), randomFloat());
+			b[i][r] = vec4(randomFloat(), randomFloat(), randomFloat(), randomFloat());
+			a[i][r][r] += 4.0f;		// keeps every matrix well away from singular
+		}
+		v[i] = vec4(randomFloat(), randomFloat(), randomFloat(), 1.0f);
+		w[i] = vec4(randomFloat(), randomFloat(), randomFloat(), 0.0f);
+		v3[i] = vec3(randomFloat(), randomFloat(), randomFloat());
+		angles[i] = 180.0f * randomFloat();
+		q[i] = normalize(quat(randomFloat(), randomFloat(), randomFloat(), randomFloat()));
+
+		ObjectTransform& o = objects[i];
+		o.eye = vec4(randomFloat(), randomFloat(), 3.0f, 1.0f);
+		o.at = vec4(randomFloat(), randomFloat(), 0.0f, 1.0f);
+		o.up = vec4(0.0f, 1.0f, 0.0f, 0.0f);
+		o.rotate = 180.0f * vec3(randomFloat(), randomFloat(), randomFloat());
+		o.orientation = FromEuler(o.rotate);
+		o.translate = vec3(randomFloat(), randomFloat(), randomFloat());
+		o.scale = vec3(1.0f) + 0.5f * vec3(randomFloat(), randomFloat(), randomFloat());
+		modelViews[i] = LookAtTRS(o.eye, o.at, o.up, o.orientation, o.translate, o.scale);
+	}
+
+	//
+	//  mat4 products and inverses
+	//
+
+	run("mat4_mul", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			out[i] = a[i] * b[i];
+		sink += out[BENCH_COUNT - 1][3][3];
+	});
+
+	run("mat4_mul_assign", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+		{
+			out[i] = a[i];
+			out[i] *= b[i];
+		}
+		sink += out[BENCH_COUNT - 1][3][3];
+	});
+
+	run("mat4_mul_vec4", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			vOut[i] = a[i] * v[i];
+		sink += vOut[BENCH_COUNT - 1].w;
+	});
+
+	run("transpose", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			out[i] = transpose(a[i]);
+		sink += out[BENCH_COUNT - 1][3][3];
+	});
+
+	run("inverse", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			out[i] = inverse(a[i]);
+		sink += out[BENCH_COUNT - 1][3][3];
+	});
+
+	run("affine_inverse", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			out[i] = affineInverse(modelViews[i]);
+		sink += out[BENCH_COUNT - 1][2][3];
+	});
+
+	run("normal_matrix", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			normalMatrices[i] = Normal(modelViews[i]);
+		sink += normalMatrices[BENCH_COUNT - 1][2][2];
+	});
+
+	//
+	//  Matrix builders
+	//
+
+	run("lookat", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			out[i] = LookAt(objects[i].eye, objects[i].at, objects[i].up);
+		sink += out[BENCH_COUNT - 1][2][3];
+	});
+
+	// what LookAt did before it was multiplied out
+	run("lookat_translate_product", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+		{
+			const ObjectTransform& o = objects[i];
+			vec4 n = normalize(o.eye - o.at);
+			vec4 u = vec4(normalize(cross(o.up, n)), 0.0);
+			vec4 v = vec4(normalize(cross(n, u)), 0.0);
+			out[i] = mat4(u, v, n, vec4(0.0, 0.0, 0.0, 1.0)) * Translate(-o.eye);
+		}
+		sink += out[BENCH_COUNT - 1][2][3];
+	});
+
+	run("perspective", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			out[i] = Perspective(90.0f + 0.1f * angles[i], 1.0f, 0.1f, 20.0f);
+		sink += out[BENCH_COUNT - 1][2][3];
+	});
+
+	run("rotate_x", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			out[i] = RotateX(angles[i]);
+		sink += out[BENCH_COUNT - 1][1][2];
+	});
+
+	run("rotate_y", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			out[i] = RotateY(angles[i]);
+		sink += out[BENCH_COUNT - 1][0][2];
+	});
+
+	run("rotate_z", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			out[i] = RotateZ(angles[i]);
+		sink += out[BENCH_COUNT - 1][0][1];
+	});
+
+	run("rotate_xyz", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+		{
+			const vec3& r = objects[i].rotate;
+			out[i] = RotateX(r.x) * RotateY(r.y) * RotateZ(r.z);
+		}
+		sink += out[BENCH_COUNT - 1][0][1];
+	});
+
+	// what objectModelView did before LookAtTRS
+	run("lookat_r_t_s", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+		{
+			const ObjectTransform& o = objects[i];
+			out[i] = LookAt(o.eye, o.at, o.up) * RotateX(o.rotate.x) * RotateY(o.rotate.y) * RotateZ(o.rotate.z)
+				* Translate(o.translate) * Scale(o.scale);
+		}
+		sink += out[BENCH_COUNT - 1][2][3];
+	});
+
+	run("lookat_trs_euler", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+		{
+			const ObjectTransform& o = objects[i];
+			out[i] = LookAtTRS(o.eye, o.at, o.up, o.rotate, o.translate, o.scale);
+		}
+		sink += out[BENCH_COUNT - 1][2][3];
+	});
+
+	run("lookat_trs_quat", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+		{
+			const ObjectTransform& o = objects[i];
+			out[i] = LookAtTRS(o.eye, o.at, o.up, o.orientation, o.translate, o.scale);
+		}
+		sink += out[BENCH_COUNT - 1][2][3];
+	});
+
+	run("lookat_trs_batch", [&]() {
+		LookAtTRS(&objects[0], BENCH_COUNT, &out[0]);
+		sink += out[BENCH_COUNT - 1][2][3];
+	});
+
+	//
+	//  Vectors and quaternions
+	//
+
+	run("vec4_normalize", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			vOut[i] = normalize(v[i]);
+		sink += vOut[BENCH_COUNT - 1].x;
+	});
+
+	run("vec4_cross", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			v3Out[i] = cross(v[i], w[i]);
+		sink += v3Out[BENCH_COUNT - 1].x;
+	});
+
+	run("vec3_normalize", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			v3Out[i] = normalize(v3[i]);
+		sink += v3Out[BENCH_COUNT - 1].x;
+	});
+
+	run("vec3_cross", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			v3Out[i] = cross(v3[i], v3[BENCH_COUNT - 1 - i]);
+		sink += v3Out[BENCH_COUNT - 1].x;
+	});
+
+	run("quat_mul", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			qOut[i] = q[i] * q[BENCH_COUNT - 1 - i];
+		sink += qOut[BENCH_COUNT - 1].w;
+	});
+
+	run("quat_normalize", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			qOut[i] = normalize(q[i] + q[BENCH_COUNT - 1 - i]);
+		sink += qOut[BENCH_COUNT - 1].w;
+	});
+
+	run("nlerp", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			qOut[i] = nlerp(q[i], q[BENCH_COUNT - 1 - i], 0.3f);
+		sink += qOut[BENCH_COUNT - 1].w;
+	});
+
+	run("slerp", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			qOut[i] = slerp(q[i], q[BENCH_COUNT - 1 - i], 0.3f);
+		sink += qOut[BENCH_COUNT - 1].w;
+	});
+
+	run("rotate_quat", [&]() {
+		for (int i = 0; i < BENCH_COUNT; i++)
+			out[i] = Rotate(q[i]);
+		sink += out[BENCH_COUNT - 1][2][1];
+	});
+
+	//
+	//  The software rasterizer's vertex batches: eye and clip positions
+	//  for BENCH_COUNT vertices, in two passes or fused
+	//
+
+	vector<vec4> eyes(BENCH_COUNT), clips(BENCH_COUNT);
+	mat4 projection = Perspective(90.0, 1.0, 0.1, 20.0);
+
+	run("transform_points_two_pass", [&]() {
+		transformPoints(modelViews[0], &v[0], &eyes[0], BENCH_COUNT);
+		transformPoints(projection, &eyes[0], &clips[0], BENCH_COUNT);
+		sink += clips[BENCH_COUNT - 1].w;
+	});
+
+	run("transform_points_fused", [&]() {
+		transformPoints(modelViews[0], projection, &v[0], &eyes[0], &clips[0], BENCH_COUNT);
+		sink += clips[BENCH_COUNT - 1].w;
+	});
+
+	// the product of each inverse with its matrix should be the identity
+	float worst = 0.0f;
+	for (int i = 0; i < BENCH_COUNT; i++)
+	{
+		mat4 identity = inverse(a[i]) * a[i];
+		for (int r = 0; r < 4; r++)
+			for (int c = 0; c < 4; c++)
+				worst = max(worst, fabsf(identity[r][c] - (r == c ? 1.0f : 0.0f)));
+	}
+
+	//
+	//  Batch transforms
+	//
+
+	jobs.start();
+
+	vector<vec4> points(BATCH_VERTICES), transformed(BATCH_VERTICES);
+	vector<float> x(BATCH_VERTICES), y(BATCH_VERTICES), z(BATCH_VERTICES);
+	vector<float> outX(BATCH_VERTICES), outY(BATCH_VERTICES), outZ(BATCH_VERTICES);
+	for (int i = 0; i < BATCH_VERTICES; i++)
+	{
+		points[i] = vec4(randomFloat(), randomFloat(), randomFloat(), 1.0f);
+		x[i] = points[i].x;  y[i] = points[i].y;  z[i] = points[i].z;
+	}
+	const mat4& m = a[0];
+	double aosBytes = 2.0 * sizeof(vec4);
+	double soaBytes = 6.0 * sizeof(float);
+
+	runBatch("memcpy", aosBytes, false, [&]() {
+		memcpy((void*)&transformed[0], &points[0], BATCH_VERTICES * sizeof(vec4));
+	});
+	runBatch("mat4_vec4_loop", aosBytes, false, [&]() {
+		for (int i = 0; i < BATCH_VERTICES; i++)
+			transformed[i] = m * points[i];
+	});
+	runBatch("transform_points", aosBytes, false, [&]() {
+		transformPoints(m, &points[0], &transformed[0], BATCH_VERTICES);
+	});
+	runBatch("transform_points_parallel", aosBytes, true, [&]() {
+		parallelTransformPoints(m, &points[0], &transformed[0], BATCH_VERTICES);
+	});
+	runBatch("transform_normals_parallel", aosBytes, true, [&]() {
+		parallelTransformNormals(m, &points[0], &transformed[0], BATCH_VERTICES);
+	});
+	runBatch("soa_points_parallel", soaBytes, true, [&]() {
+		parallelTransformPoints(m, &x[0], &y[0], &z[0], &outX[0], &outY[0], &outZ[0], NULL, BATCH_VERTICES);
+	});
+	runBatch("soa_normals_parallel", soaBytes, true, [&]() {
+		parallelTransformNormals(m, &x[0], &y[0], &z[0], &outX[0], &outY[0], &outZ[0], BATCH_VERTICES);
+	});
+	sink += transformed[BATCH_VERTICES - 1].x + outX[BATCH_VERTICES - 1];
+
+	printReport(worst);
+
+	return sink == 12345.0f;
+}
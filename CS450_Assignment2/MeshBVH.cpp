@@ -0,0 +1,635 @@
+#include "MeshBVH.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define BVH_SSE 1
+#endif
+
+// SAH bins per axis
+#define BVH_BINS 16
+// Leaves hold at most this many triangles; fewer if splitting is cheaper
+#define BVH_MAX_LEAF_SIZE 8
+// Relative cost of a node visit against a triangle test
+#define BVH_TRAVERSAL_COST 1.0f
+// Ranges at least this big bin in parallel
+#define BVH_PARALLEL_BIN_SIZE 16384
+// Triangles one binning job handles
+#define BVH_BIN_CHUNK 4096
+// Subtrees below this size are built by a single job
+#define BVH_MIN_TASK_SIZE 1024
+// Traversal stack kept on the call stack; deeper trees use the heap
+#define BVH_STACK_SIZE 128
+
+bool intersectTriangle( const Ray& ray, const vec3& a, const vec3& b, const vec3& c,
+						float& t, float& u, float& v )
+{
+	vec3 e1 = b - a;
+	vec3 e2 = c - a;
+	vec3 p = cross(ray.direction, e2);
+	float det = dot(e1, p);
+	if (fabsf(det) < 1e-12f)
+		return false;
+
+	float invDet = 1.0f / det;
+	vec3 s = ray.origin - a;
+	u = dot(s, p) * invDet;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	vec3 q = cross(s, e1);
+	v = dot(ray.direction, q) * invDet;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	t = dot(e2, q) * invDet;
+	return t >= 0.0f;
+}
+
+//----------------------------------------------------------------------------
+
+void AABB::grow( const vec3& p )
+{
+	lo.x = std::min(lo.x, p.x);  hi.x = std::max(hi.x, p.x);
+	lo.y = std::min(lo.y, p.y);  hi.y = std::max(hi.y, p.y);
+	lo.z = std::min(lo.z, p.z);  hi.z = std::max(hi.z, p.z);
+}
+
+// Not grow(box.lo) and grow(box.hi): an empty box would make this one infinite
+void AABB::grow( const AABB& box )
+{
+	lo.x = std::min(lo.x, box.lo.x);  hi.x = std::max(hi.x, box.hi.x);
+	lo.y = std::min(lo.y, box.lo.y);  hi.y = std::max(hi.y, box.hi.y);
+	lo.z = std::min(lo.z, box.lo.z);  hi.z = std::max(hi.z, box.hi.z);
+}
+
+float AABB::surfaceArea() const
+{
+	vec3 d = hi - lo;
+	if (d.x < 0.0f || d.y < 0.0f || d.z < 0.0f)
+		return 0.0f;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+AABB AABB::transformed( const mat4& m ) const
+{
+	// each output extent is the sum of every input axis's smallest and
+	// largest contribution (Arvo)
+	AABB box;
+	for (int r = 0; r < 3; r++)
+	{
+		box.lo[r] = box.hi[r] = m[r][3];
+		for (int c = 0; c < 3; c++)
+		{
+			float a = m[r][c] * lo[c];
+			float b = m[r][c] * hi[c];
+			box.lo[r] += std::min(a, b);
+			box.hi[r] += std::max(a, b);
+		}
+	}
+	return box;
+}
+
+bool AABB::intersect( const Ray& ray, const vec3& inverseDirection, float tMax, float& tEnter ) const
+{
+	float tx0 = (lo.x - ray.origin.x) * inverseDirection.x;
+	float tx1 = (hi.x - ray.origin.x) * inverseDirection.x;
+	float ty0 = (lo.y - ray.origin.y) * inverseDirection.y;
+	float ty1 = (hi.y - ray.origin.y) * inverseDirection.y;
+	float tz0 = (lo.z - ray.origin.z) * inverseDirection.z;
+	float tz1 = (hi.z - ray.origin.z) * inverseDirection.z;
+
+	float tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+	float tFar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tMax));
+
+	tEnter = tNear;
+	return tNear <= tFar;
+}
+
+//----------------------------------------------------------------------------
+//
+//  Build
+//
+
+inline vec3 MeshBVH::vertex( int triangle, int corner ) const
+{
+	const vec4& p = _positions[triangle * 3 + corner];
+	return vec3(p.x, p.y, p.z);
+}
+
+AABB MeshBVH::leafBounds( int first, int count ) const
+{
+	AABB bounds;
+	for (int i = first; i < first + count; i++)
+		bounds.grow(_triangleBounds[_triangles[i]]);
+	return bounds;
+}
+
+void MeshBVH::build( const vec4* positions, int triangleCount )
+{
+	_positions = positions;
+	_nodes.clear();
+	_depth = 0;
+	_bounds = AABB();
+	_triangles.resize(triangleCount);
+	if (triangleCount == 0)
+		return;
+
+	_triangleBounds.resize(triangleCount);
+	_centroids.resize(triangleCount);
+	jobs.parallelFor(triangleCount, BVH_BIN_CHUNK, [this](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+		{
+			_triangles[i] = i;
+			AABB box;
+			box.grow(vertex(i, 0));
+			box.grow(vertex(i, 1));
+			box.grow(vertex(i, 2));
+			_triangleBounds[i] = box;
+			_centroids[i] = box.center();
+		}
+	});
+
+	std::vector<BuildNode> nodes(1);
+	nodes[0].bounds = leafBounds(0, triangleCount);
+	nodes[0].left = nodes[0].right = -1;
+	nodes[0].first = 0;
+	nodes[0].count = triangleCount;
+
+	// split the top of the tree here, binning in parallel, until there are
+	// enough subtrees to keep every thread busy
+	int taskSize = std::max(BVH_MIN_TASK_SIZE, triangleCount / (4 * jobs.threadCount()));
+	std::vector<int> tasks;
+	std::vector<int> open(1, 0);
+	while (!open.empty())
+	{
+		int index = open.back();
+		open.pop_back();
+		if (nodes[index].count <= taskSize)
+		{
+			tasks.push_back(index);
+			continue;
+		}
+
+		AABB leftBounds, rightBounds;
+		int first = nodes[index].first;
+		int count = nodes[index].count;
+		int middle = split(first, first + count, leftBounds, rightBounds, true);
+		if (middle < 0)
+			continue;
+
+		BuildNode left = { leftBounds, -1, -1, first, middle - first };
+		BuildNode right = { rightBounds, -1, -1, middle, first + count - middle };
+		nodes[index].left = (int)nodes.size();
+		nodes.push_back(left);
+		nodes[index].right = (int)nodes.size();
+		nodes.push_back(right);
+		open.push_back(nodes[index].left);
+		open.push_back(nodes[index].right);
+	}
+
+	// the subtrees work on disjoint ranges of _triangles
+	std::vector<std::vector<BuildNode> > subtrees(tasks.size());
+	jobs.parallelFor((int)tasks.size(), 1, [&](int begin, int end, int) {
+		for (int t = begin; t < end; t++)
+		{
+			subtrees[t].push_back(nodes[tasks[t]]);
+			buildSubtree(subtrees[t], 0);
+		}
+	});
+
+	// splice each subtree in place of its task node
+	for (size_t t = 0; t < tasks.size(); t++)
+	{
+		const std::vector<BuildNode>& subtree = subtrees[t];
+		int base = (int)nodes.size() - 1;
+		for (size_t i = 0; i < subtree.size(); i++)
+		{
+			BuildNode node = subtree[i];
+			if (node.left >= 0)
+			{
+				node.left = node.left == 0 ? tasks[t] : base + node.left;
+				node.right = node.right == 0 ? tasks[t] : base + node.right;
+			}
+			if (i == 0)
+				nodes[tasks[t]] = node;
+			else
+				nodes.push_back(node);
+		}
+	}
+
+	_bounds = nodes[0].bounds;
+	_nodes.reserve(nodes.size() / 2 + 1);
+	collapse(nodes, 0, 1);
+
+	_triangleBounds.clear();
+	_centroids.clear();
+}
+
+void MeshBVH::buildSubtree( std::vector<BuildNode>& nodes, int index )
+{
+	AABB leftBounds, rightBounds;
+	int first = nodes[index].first;
+	int count = nodes[index].count;
+	int middle = split(first, first + count, leftBounds, rightBounds, false);
+	if (middle < 0)
+		return;
+
+	BuildNode left = { leftBounds, -1, -1, first, middle - first };
+	BuildNode right = { rightBounds, -1, -1, middle, first + count - middle };
+	int leftIndex = (int)nodes.size();
+	nodes.push_back(left);
+	int rightIndex = (int)nodes.size();
+	nodes.push_back(right);
+	nodes[index].left = leftIndex;
+	nodes[index].right = rightIndex;
+
+	buildSubtree(nodes, leftIndex);
+	buildSubtree(nodes, rightIndex);
+}
+
+namespace {
+
+struct Bins {
+	AABB	bounds[3][BVH_BINS];
+	int		count[3][BVH_BINS];
+
+	Bins() { memset(count, 0, sizeof(count)); }
+};
+
+inline int binOf( float centroid, float lo, float scale )
+{
+	int bin = (int)((centroid - lo) * scale);
+	return std::min(std::max(bin, 0), BVH_BINS - 1);
+}
+
+}
+
+// Cheapest binned SAH split of the range over all three axes
+MeshBVH::BinSplit MeshBVH::findSplit( int begin, int end, const AABB& centroidBounds, bool parallel ) const
+{
+	vec3 extent = centroidBounds.hi - centroidBounds.lo;
+	vec3 scale;
+	for (int axis = 0; axis < 3; axis++)
+		scale[axis] = extent[axis] > 0.0f ? BVH_BINS / extent[axis] : 0.0f;
+
+	auto binRange = [&](int from, int to, Bins& bins) {
+		for (int i = from; i < to; i++)
+		{
+			int tri = _triangles[i];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				int bin = binOf(_centroids[tri][axis], centroidBounds.lo[axis], scale[axis]);
+				bins.bounds[axis][bin].grow(_triangleBounds[tri]);
+				bins.count[axis][bin]++;
+			}
+		}
+	};
+
+	Bins bins;
+	if (parallel && end - begin >= BVH_PARALLEL_BIN_SIZE)
+	{
+		int chunks = (end - begin + BVH_BIN_CHUNK - 1) / BVH_BIN_CHUNK;
+		std::vector<Bins> partial(chunks);
+		jobs.parallelFor(chunks, 1, [&](int first, int last, int) {
+			for (int c = first; c < last; c++)
+				binRange(begin + c * BVH_BIN_CHUNK, std::min(end, begin + (c + 1) * BVH_BIN_CHUNK), partial[c]);
+		});
+		for (int c = 0; c < chunks; c++)
+			for (int axis = 0; axis < 3; axis++)
+				for (int b = 0; b < BVH_BINS; b++)
+				{
+					bins.bounds[axis][b].grow(partial[c].bounds[axis][b]);
+					bins.count[axis][b] += partial[c].count[axis][b];
+				}
+	}
+	else
+		binRange(begin, end, bins);
+
+	BinSplit best = { -1, -1, INFINITY };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (scale[axis] == 0.0f)
+			continue;
+
+		// sweep from the right to get each split's right-hand area and count
+		float rightArea[BVH_BINS];
+		int rightCount[BVH_BINS];
+		AABB box;
+		int count = 0;
+		for (int b = BVH_BINS - 1; b > 0; b--)
+		{
+			box.grow(bins.bounds[axis][b]);
+			count += bins.count[axis][b];
+			rightArea[b] = box.surfaceArea();
+			rightCount[b] = count;
+		}
+
+		box = AABB();
+		count = 0;
+		for (int b = 0; b < BVH_BINS - 1; b++)
+		{
+			box.grow(bins.bounds[axis][b]);
+			count += bins.count[axis][b];
+			if (count == 0 || rightCount[b + 1] == 0)
+				continue;
+
+			float cost = box.surfaceArea() * count + rightArea[b + 1] * rightCount[b + 1];
+			if (cost < best.cost)
+			{
+				best.axis = axis;
+				best.bin = b;
+				best.cost = cost;
+			}
+		}
+	}
+
+	return best;
+}
+
+// Partitions the range and returns where the right half starts, or -1 if it
+// should stay a leaf
+int MeshBVH::split( int begin, int end, AABB& leftBounds, AABB& rightBounds, bool parallel )
+{
+	int count = end - begin;
+	if (count <= 1)
+		return -1;
+
+	AABB bounds, centroidBounds;
+	for (int i = begin; i < end; i++)
+	{
+		bounds.grow(_triangleBounds[_triangles[i]]);
+		centroidBounds.grow(_centroids[_triangles[i]]);
+	}
+
+	BinSplit best = findSplit(begin, end, centroidBounds, parallel);
+
+	float area = bounds.surfaceArea();
+	float splitCost = BVH_TRAVERSAL_COST + (area > 0.0f ? best.cost / area : INFINITY);
+	if (count <= BVH_MAX_LEAF_SIZE && (best.axis < 0 || count <= splitCost))
+		return -1;
+
+	int middle;
+	if (best.axis < 0)
+	{
+		// every centroid is in the same place; any split will do
+		middle = begin + count / 2;
+	}
+	else
+	{
+		int axis = best.axis;
+		float lo = centroidBounds.lo[axis];
+		float scale = BVH_BINS / (centroidBounds.hi[axis] - lo);
+		middle = (int)(std::partition(_triangles.begin() + begin, _triangles.begin() + end, [&](int tri) {
+			return binOf(_centroids[tri][axis], lo, scale) <= best.bin;
+		}) - _triangles.begin());
+	}
+
+	leftBounds = leafBounds(begin, middle - begin);
+	rightBounds = leafBounds(middle, end - middle);
+	return middle;
+}
+
+void MeshBVH::setSlot( Node4& node, int slot, const AABB& bounds, int child, int count )
+{
+	node.minX[slot] = bounds.lo.x;  node.maxX[slot] = bounds.hi.x;
+	node.minY[slot] = bounds.lo.y;  node.maxY[slot] = bounds.hi.y;
+	node.minZ[slot] = bounds.lo.z;  node.maxZ[slot] = bounds.hi.z;
+	node.child[slot] = child;
+	node.count[slot] = count;
+}
+
+// Turns a binary node into a 4-wide one by opening its biggest inner
+// descendants until it has four children.  depth is the new node's level,
+// 1 for the root.
+int MeshBVH::collapse( const std::vector<BuildNode>& nodes, int index, int depth )
+{
+	_depth = std::max(_depth, depth);
+
+	int children[4];
+	int childCount = 0;
+
+	if (nodes[index].left < 0)
+		children[childCount++] = index;		// a leaf root
+	else
+	{
+		children[childCount++] = nodes[index].left;
+		children[childCount++] = nodes[index].right;
+	}
+
+	while (childCount < 4)
+	{
+		int widest = -1;
+		float widestArea = -1.0f;
+		for (int c = 0; c < childCount; c++)
+		{
+			const BuildNode& node = nodes[children[c]];
+			if (node.left >= 0 && node.bounds.surfaceArea() > widestArea)
+			{
+				widest = c;
+				widestArea = node.bounds.surfaceArea();
+			}
+		}
+		if (widest < 0)
+			break;
+
+		int opened = children[widest];
+		children[widest] = nodes[opened].left;
+		children[childCount++] = nodes[opened].right;
+	}
+
+	int node4 = (int)_nodes.size();
+	_nodes.push_back(Node4());
+	for (int slot = 0; slot < 4; slot++)
+		setSlot(_nodes[node4], slot, AABB(), 0, -1);
+
+	for (int c = 0; c < childCount; c++)
+	{
+		const BuildNode& child = nodes[children[c]];
+		if (child.left < 0)
+			setSlot(_nodes[node4], c, child.bounds, child.first, child.count);
+		else
+		{
+			int inner = collapse(nodes, children[c], depth + 1);
+			setSlot(_nodes[node4], c, child.bounds, inner, 0);
+		}
+	}
+
+	return node4;
+}
+
+//----------------------------------------------------------------------------
+
+void MeshBVH::refit()
+{
+	// children come after their parents, so walking backwards finishes
+	// every child before the node that holds its box
+	for (int n = (int)_nodes.size() - 1; n >= 0; n--)
+	{
+		Node4& node = _nodes[n];
+		for (int slot = 0; slot < 4; slot++)
+		{
+			if (node.count[slot] < 0)
+				continue;
+
+			AABB bounds;
+			if (node.count[slot] > 0)
+			{
+				for (int i = node.child[slot]; i < node.child[slot] + node.count[slot]; i++)
+				{
+					bounds.grow(vertex(_triangles[i], 0));
+					bounds.grow(vertex(_triangles[i], 1));
+					bounds.grow(vertex(_triangles[i], 2));
+				}
+			}
+			else
+			{
+				const Node4& child = _nodes[node.child[slot]];
+				for (int c = 0; c < 4; c++)
+					if (child.count[c] >= 0)
+					{
+						bounds.grow(vec3(child.minX[c], child.minY[c], child.minZ[c]));
+						bounds.grow(vec3(child.maxX[c], child.maxY[c], child.maxZ[c]));
+					}
+			}
+			setSlot(node, slot, bounds, node.child[slot], node.count[slot]);
+		}
+	}
+
+	_bounds = AABB();
+	if (!_nodes.empty())
+		for (int slot = 0; slot < 4; slot++)
+			if (_nodes[0].count[slot] >= 0)
+			{
+				_bounds.grow(vec3(_nodes[0].minX[slot], _nodes[0].minY[slot], _nodes[0].minZ[slot]));
+				_bounds.grow(vec3(_nodes[0].maxX[slot], _nodes[0].maxY[slot], _nodes[0].maxZ[slot]));
+			}
+}
+
+//----------------------------------------------------------------------------
+//
+//  Traversal
+//
+
+bool MeshBVH::intersect( const Ray& ray, RayHit& hit ) const
+{
+	if (_nodes.empty())
+		return false;
+
+	vec3 inverseDirection(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+	bool found = false;
+
+#ifdef BVH_SSE
+	const __m128 originX = _mm_set1_ps(ray.origin.x);
+	const __m128 originY = _mm_set1_ps(ray.origin.y);
+	const __m128 originZ = _mm_set1_ps(ray.origin.z);
+	const __m128 inverseX = _mm_set1_ps(inverseDirection.x);
+	const __m128 inverseY = _mm_set1_ps(inverseDirection.y);
+	const __m128 inverseZ = _mm_set1_ps(inverseDirection.z);
+#endif
+
+	// A child still to visit, with where the ray enters its box.  count is
+	// 0 for an inner node, as in Node4.
+	struct Entry {
+		int		child;
+		int		count;
+		float	tEnter;
+	};
+
+	// each level pops one node and pushes at most four
+	int stackSize = 3 * _depth + 1;
+	Entry localStack[BVH_STACK_SIZE];
+	std::vector<Entry> heapStack;
+	Entry* stack = localStack;
+	if (stackSize > BVH_STACK_SIZE)
+	{
+		heapStack.resize(stackSize);
+		stack = heapStack.data();
+	}
+	int top = 0;
+	Entry root = { 0, 0, -INFINITY };
+	stack[top++] = root;
+
+	while (top > 0)
+	{
+		Entry entry = stack[--top];
+
+		// a nearer hit may have turned up since it was pushed
+		if (!(entry.tEnter < hit.t))
+			continue;
+
+		if (entry.count > 0)
+		{
+			for (int i = entry.child; i < entry.child + entry.count; i++)
+			{
+				int tri = _triangles[i];
+				float t, u, v;
+				if (intersectTriangle(ray, vertex(tri, 0), vertex(tri, 1), vertex(tri, 2), t, u, v) && t < hit.t)
+				{
+					hit.triangle = tri;
+					hit.t = t;
+					hit.u = u;
+					hit.v = v;
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		const Node4& node = _nodes[entry.child];
+
+		// entry distance of each child, infinite for a miss
+		float tEnter[4];
+#ifdef BVH_SSE
+		__m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), originX), inverseX);
+		__m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), originX), inverseX);
+		__m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), originY), inverseY);
+		__m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), originY), inverseY);
+		__m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), originZ), inverseZ);
+		__m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), originZ), inverseZ);
+
+		__m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)),
+								  _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+		__m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)),
+								 _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(hit.t)));
+		__m128 missed = _mm_cmpgt_ps(tNear, tFar);
+		_mm_storeu_ps(tEnter, _mm_or_ps(_mm_and_ps(missed, _mm_set1_ps(INFINITY)), _mm_andnot_ps(missed, tNear)));
+#else
+		for (int slot = 0; slot < 4; slot++)
+		{
+			AABB box;
+			box.lo = vec3(node.minX[slot], node.minY[slot], node.minZ[slot]);
+			box.hi = vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]);
+			if (!box.intersect(ray, inverseDirection, hit.t, tEnter[slot]))
+				tEnter[slot] = INFINITY;
+		}
+#endif
+
+		// children onto the stack farthest first, so the nearest is next
+		int order[4];
+		int hits = 0;
+		for (int slot = 0; slot < 4; slot++)
+		{
+			if (node.count[slot] < 0 || !(tEnter[slot] < hit.t))
+				continue;
+
+			int i = hits++;
+			while (i > 0 && tEnter[order[i - 1]] < tEnter[slot])
+			{
+				order[i] = order[i - 1];
+				i--;
+			}
+			order[i] = slot;
+		}
+
+		for (int i = 0; i < hits; i++)
+		{
+			Entry child = { node.child[order[i]], node.count[order[i]], tEnter[order[i]] };
+			stack[top++] = child;
+		}
+	}
+
+	return found;
+}
@@ -0,0 +1,171 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- MeshBVH.h ---
+//
+//   Bounding volume hierarchy over one mesh's triangles, for ray queries on
+//   the CPU.  Triangles are read as consecutive vertex triples, the layout
+//   of the per-object arrays in main.cpp.
+//
+//   The tree is built top-down with a binned surface area heuristic; the
+//   top levels bin in parallel and the subtrees below them are built as
+//   separate jobs.  It is then collapsed into 4-wide nodes whose child
+//   boxes are stored as structure-of-arrays, so one SSE slab test covers
+//   all four children.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __MESH_BVH_H__
+#define __MESH_BVH_H__
+
+#include "Angel.h"
+#include <vector>
+
+struct Ray {
+	vec3	origin;
+	vec3	direction;		// need not be unit length; t is in its units
+};
+
+struct RayHit {
+	int		triangle;		// -1 for a miss
+	float	t;
+	float	u, v;			// barycentrics of the second and third vertex
+
+	RayHit() : triangle(-1), t(INFINITY), u(0.0f), v(0.0f) {}
+};
+
+// Moller-Trumbore; both sides of the triangle count
+bool intersectTriangle( const Ray& ray, const vec3& a, const vec3& b, const vec3& c,
+						float& t, float& u, float& v );
+
+struct AABB {
+	vec3	lo;
+	vec3	hi;
+
+	AABB() : lo(INFINITY), hi(-INFINITY) {}
+
+	void grow( const vec3& p );
+	void grow( const AABB& box );
+	vec3 center() const { return (lo + hi) * 0.5f; }
+	float surfaceArea() const;
+
+	// Box around this one after an affine transform
+	AABB transformed( const mat4& m ) const;
+
+	// Entry distance of the ray, or false if it misses within [0, tMax]
+	bool intersect( const Ray& ray, const vec3& inverseDirection, float tMax, float& tEnter ) const;
+};
+
+class MeshBVH {
+public:
+	MeshBVH() : _positions(NULL), _depth(0) {}
+
+	// Builds over triangleCount triangles starting at positions.  The
+	// array is referenced, not copied, and must outlive the tree.
+	void build( const vec4* positions, int triangleCount );
+
+	// Recomputes the boxes after the vertices have moved, keeping the
+	// topology; much cheaper than a rebuild for small deformations
+	void refit();
+
+	bool empty() const { return _nodes.empty(); }
+	const AABB& bounds() const { return _bounds; }
+	int nodeCount() const { return (int)_nodes.size(); }
+
+	// Nearest hit closer than hit.t; returns whether one was found
+	bool intersect( const Ray& ray, RayHit& hit ) const;
+
+	enum BoxOverlap {
+		BoxOutside,		// no triangle in the box can pass
+		BoxPartial,		// open the box
+		BoxInside		// every triangle in the box passes
+	};
+
+	// Whether any triangle passes a query.  boxTest(const AABB&) classifies
+	// each node's boxes from the top down, and triangleTest(int triangle)
+	// decides the triangles of leaves that come out BoxPartial.
+	template <typename BoxTest, typename TriangleTest>
+	bool any( BoxTest boxTest, TriangleTest triangleTest ) const;
+
+private:
+	// One node and its four children's boxes.  A child is an inner node
+	// when count is 0, a leaf of count triangles from _triangles[child]
+	// when positive, and an unused slot when -1.
+	struct Node4 {
+		float	minX[4], minY[4], minZ[4];
+		float	maxX[4], maxY[4], maxZ[4];
+		int		child[4];
+		int		count[4];
+	};
+
+	// The binary tree the build produces before it is collapsed
+	struct BuildNode {
+		AABB	bounds;
+		int		left, right;	// -1 for a leaf
+		int		first, count;	// range of _triangles
+	};
+
+	struct BinSplit {
+		int		axis;
+		int		bin;			// left side is bins [0, bin]
+		float	cost;
+	};
+
+	BinSplit findSplit( int begin, int end, const AABB& centroidBounds, bool parallel ) const;
+	int split( int begin, int end, AABB& leftBounds, AABB& rightBounds, bool parallel );
+	void buildSubtree( std::vector<BuildNode>& nodes, int node );
+	int collapse( const std::vector<BuildNode>& nodes, int node, int depth );
+	void setSlot( Node4& node, int slot, const AABB& bounds, int child, int count );
+	AABB leafBounds( int first, int count ) const;
+	vec3 vertex( int triangle, int corner ) const;
+
+	const vec4*					_positions;
+	std::vector<Node4>			_nodes;			// a parent comes before its children
+	std::vector<int>			_triangles;
+	AABB						_bounds;
+	int							_depth;			// levels of 4-wide nodes
+
+	// build scratch
+	std::vector<AABB>			_triangleBounds;
+	std::vector<vec3>			_centroids;
+};
+
+//----------------------------------------------------------------------------
+
+template <typename BoxTest, typename TriangleTest>
+bool MeshBVH::any( BoxTest boxTest, TriangleTest triangleTest ) const
+{
+	if (_nodes.empty())
+		return false;
+
+	std::vector<int> stack(1, 0);
+	while (!stack.empty())
+	{
+		const Node4& node = _nodes[stack.back()];
+		stack.pop_back();
+
+		for (int slot = 0; slot < 4; slot++)
+		{
+			if (node.count[slot] < 0)
+				continue;
+
+			AABB box;
+			box.lo = vec3(node.minX[slot], node.minY[slot], node.minZ[slot]);
+			box.hi = vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]);
+			BoxOverlap overlap = boxTest(box);
+			if (overlap == BoxInside)
+				return true;
+			if (overlap == BoxOutside)
+				continue;
+
+			if (node.count[slot] == 0)
+				stack.push_back(node.child[slot]);
+			else
+				for (int i = node.child[slot]; i < node.child[slot] + node.count[slot]; i++)
+					if (triangleTest(_triangles[i]))
+						return true;
+		}
+	}
+	return false;
+}
+
+#endif // __MESH_BVH_H__
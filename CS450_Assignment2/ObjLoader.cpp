@@ -0,0 +1,72 @@
+#include "ObjLoader.h"
+#include "Splitter.h"
+#include <fstream>
+#include <cstdlib>
+
+bool loadObj( const std::string& fileName, std::vector<vec4>& vertices, std::vector<vec4>& normals )
+{
+	std::ifstream fileStream(fileName);
+	if (!fileStream.is_open())
+		return false;
+
+	std::string line;
+	getline(fileStream, line);
+	Splitter split(line, " ");
+
+	// the header; its Range and Span lines aren't needed
+	while (split[0].c_str()[0] == '#')
+	{
+		getline(fileStream, line);
+		split.reset(line, " ");
+	}
+
+	std::vector<vec4> vertexStore;
+	std::vector<vec4> normalStore;
+
+	while (fileStream.good())
+	{
+		bool used = false;
+
+		// get vertex info
+		while (split[0].compare("v") == 0)
+		{
+			vertexStore.push_back(vec4(atof(split[1].c_str()), atof(split[2].c_str()), atof(split[3].c_str()), 1.0));
+			getline(fileStream, line);
+			split.reset(line, " ");
+			used = true;
+		}
+
+		// get normals
+		while (split[0].compare("vn") == 0)
+		{
+			normalStore.push_back(vec4(atof(split[1].c_str()), atof(split[2].c_str()), atof(split[3].c_str()), 1.0));
+			getline(fileStream, line);
+			split.reset(line, " ");
+			used = true;
+		}
+
+		while (split[0].compare("f") == 0)
+		{
+			// extract index values for faces, one-based
+			for (int corner = 1; corner <= 3; corner++)
+			{
+				Splitter slashSplitter(split[corner], "//");
+				vertices.push_back(vertexStore[atoi(slashSplitter[0].c_str()) - 1]);
+				normals.push_back(normalStore[atoi(slashSplitter[1].c_str()) - 1]);
+			}
+
+			getline(fileStream, line);
+			split.reset(line, " ");
+			used = true;
+		}
+
+		// a group, texture coordinates or anything else this doesn't draw
+		if (!used)
+		{
+			getline(fileStream, line);
+			split.reset(line, " ");
+		}
+	}
+
+	return true;
+}
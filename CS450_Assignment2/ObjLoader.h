@@ -0,0 +1,23 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- ObjLoader.h ---
+//
+//   Reader for the OBJ files the assignments ship: a "#" header, then "v"
+//   positions, "vn" normals and triangular "f v//n" faces.  Faces come
+//   out unindexed, three vertices and three normals each, the way the draw
+//   calls take them.  Lines of any other kind are skipped.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OBJ_LOADER_H__
+#define __OBJ_LOADER_H__
+
+#include "Angel.h"
+#include <string>
+#include <vector>
+
+// Appends the file's triangles to vertices and normals; false if it can't
+// be opened
+bool loadObj( const std::string& fileName, std::vector<vec4>& vertices, std::vector<vec4>& normals );
+
+#endif // __OBJ_LOADER_H__
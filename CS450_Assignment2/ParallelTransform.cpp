@@ -0,0 +1,72 @@
+#include "ParallelTransform.h"
+#include "JobSystem.h"
+#include <algorithm>
+
+// Arrays shorter than this are transformed on the calling thread
+#define PARALLEL_TRANSFORM_MIN 65536
+// Outputs bigger than this many bytes bypass the caches
+#define STREAM_BYTES (8 << 20)
+
+// Chunks big enough to amortize a job, and several per thread so a slow
+// one doesn't hold the rest up
+static int grainFor( int count )
+{
+	return std::max(PARALLEL_TRANSFORM_MIN / 4, count / (4 * jobs.threadCount()));
+}
+
+void parallelTransformPoints( const mat4& m, const vec4* in, vec4* out, int count )
+{
+	bool stream = (size_t)count * sizeof(vec4) > STREAM_BYTES;
+	if (count < PARALLEL_TRANSFORM_MIN || jobs.threadCount() == 1)
+	{
+		transformPoints(m, in, out, count, stream);
+		return;
+	}
+
+	jobs.parallelFor(count, grainFor(count), [&](int begin, int end, int) {
+		transformPoints(m, in + begin, out + begin, end - begin, stream);
+	});
+}
+
+void parallelTransformNormals( const mat4& m, const vec4* in, vec4* out, int count )
+{
+	bool stream = (size_t)count * sizeof(vec4) > STREAM_BYTES;
+	if (count < PARALLEL_TRANSFORM_MIN || jobs.threadCount() == 1)
+	{
+		transformNormals(m, in, out, count, stream);
+		return;
+	}
+
+	jobs.parallelFor(count, grainFor(count), [&](int begin, int end, int) {
+		transformNormals(m, in + begin, out + begin, end - begin, stream);
+	});
+}
+
+void parallelTransformPoints( const mat4& m, const float* x, const float* y, const float* z,
+							  float* outX, float* outY, float* outZ, float* outW, int count )
+{
+	if (count < PARALLEL_TRANSFORM_MIN || jobs.threadCount() == 1)
+	{
+		transformPoints(m, x, y, z, outX, outY, outZ, outW, count);
+		return;
+	}
+
+	jobs.parallelFor(count, grainFor(count), [&](int begin, int end, int) {
+		transformPoints(m, x + begin, y + begin, z + begin, outX + begin, outY + begin, outZ + begin,
+						outW != NULL ? outW + begin : NULL, end - begin);
+	});
+}
+
+void parallelTransformNormals( const mat4& m, const float* x, const float* y, const float* z,
+							   float* outX, float* outY, float* outZ, int count )
+{
+	if (count < PARALLEL_TRANSFORM_MIN || jobs.threadCount() == 1)
+	{
+		transformNormals(m, x, y, z, outX, outY, outZ, count);
+		return;
+	}
+
+	jobs.parallelFor(count, grainFor(count), [&](int begin, int end, int) {
+		transformNormals(m, x + begin, y + begin, z + begin, outX + begin, outY + begin, outZ + begin, end - begin);
+	});
+}
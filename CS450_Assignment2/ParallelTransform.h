@@ -0,0 +1,26 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- ParallelTransform.h ---
+//
+//   The batch transforms from mat.h, split over the JobSystem when the
+//   array is big enough to be worth waking the workers for.  Smaller
+//   arrays run on the calling thread.  Outputs too big for the caches are
+//   written with streaming stores.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __PARALLEL_TRANSFORM_H__
+#define __PARALLEL_TRANSFORM_H__
+
+#include "Angel.h"
+
+void parallelTransformPoints( const mat4& m, const vec4* in, vec4* out, int count );
+void parallelTransformNormals( const mat4& m, const vec4* in, vec4* out, int count );
+
+// SoA; outW may be NULL as for transformPoints
+void parallelTransformPoints( const mat4& m, const float* x, const float* y, const float* z,
+							  float* outX, float* outY, float* outZ, float* outW, int count );
+void parallelTransformNormals( const mat4& m, const float* x, const float* y, const float* z,
+							   float* outX, float* outY, float* outZ, int count );
+
+#endif // __PARALLEL_TRANSFORM_H__
@@ -0,0 +1,134 @@
+#include "PickBuffer.h"
+#include "Log.h"
+
+PickBuffer::PickBuffer() :
+	_framebuffer(0), _previousFramebuffer(0), _next(0), _pending(-1), _flushed(false)
+{
+	for (int i = 0; i < 3; i++)
+		_renderbuffers[i] = 0;
+	for (int i = 0; i < PICK_READBACK_SLOTS; i++)
+	{
+		_buffers[i] = 0;
+		_fences[i] = 0;
+	}
+}
+
+bool PickBuffer::init( int width, int height, GLint objectOutput, GLint primitiveOutput )
+{
+	GLint previous = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+
+	glGenFramebuffers(1, &_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+
+	glGenRenderbuffers(3, _renderbuffers);
+	GLenum formats[3] = { GL_R32UI, GL_R32UI, GL_DEPTH_COMPONENT24 };
+	GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_DEPTH_ATTACHMENT };
+	for (int i = 0; i < 3; i++)
+	{
+		glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffers[i]);
+		glRenderbufferStorage(GL_RENDERBUFFER, formats[i], width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachments[i], GL_RENDERBUFFER, _renderbuffers[i]);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	// route each output to its attachment, wherever the linker put it
+	GLenum drawBuffers[2] = { GL_NONE, GL_NONE };
+	if (objectOutput >= 0 && objectOutput < 2)
+		drawBuffers[objectOutput] = GL_COLOR_ATTACHMENT0;
+	if (primitiveOutput >= 0 && primitiveOutput < 2)
+		drawBuffers[primitiveOutput] = GL_COLOR_ATTACHMENT1;
+	glDrawBuffers(2, drawBuffers);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		LOG_ERROR("pick framebuffer incomplete (0x%x)", status);
+		return false;
+	}
+
+	glGenBuffers(PICK_READBACK_SLOTS, _buffers);
+	for (int i = 0; i < PICK_READBACK_SLOTS; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(PickSample), NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return true;
+}
+
+void PickBuffer::begin( int x, int y, int region )
+{
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &_previousFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(x - region/2, y - region/2, region, region);
+
+	GLuint background[4] = { 0, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, background);
+	glClearBufferuiv(GL_COLOR, 1, background);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void PickBuffer::end( int x, int y )
+{
+	glDisable(GL_SCISSOR_TEST);
+
+	int slot = _next;
+	_next = (_next + 1) % PICK_READBACK_SLOTS;
+
+	if (_fences[slot] != 0)
+		glDeleteSync(_fences[slot]);
+
+	// with a pack buffer bound the reads are queued, not waited for
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffers[slot]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(x, y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+	glReadBuffer(GL_COLOR_ATTACHMENT1);
+	glReadPixels(x, y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, BUFFER_OFFSET(sizeof(GLuint)));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_pending = slot;
+	_flushed = false;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, _previousFramebuffer);
+}
+
+bool PickBuffer::poll( PickSample& sample )
+{
+	if (_pending < 0)
+		return false;
+
+	int slot = _pending;
+
+	// the first check flushes, so the fence is sure to signal eventually
+	GLenum status = glClientWaitSync(_fences[slot], _flushed ? 0 : GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	_flushed = true;
+	if (status == GL_TIMEOUT_EXPIRED)
+		return false;
+
+	glDeleteSync(_fences[slot]);
+	_fences[slot] = 0;
+	_pending = -1;
+
+	if (status == GL_WAIT_FAILED)
+		return false;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffers[slot]);
+	const PickSample* ids = (const PickSample*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(PickSample), GL_MAP_READ_BIT);
+	bool mapped = (ids != NULL);
+	if (mapped)
+	{
+		sample = *ids;
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return mapped;
+}
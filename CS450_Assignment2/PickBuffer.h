@@ -0,0 +1,60 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- PickBuffer.h ---
+//
+//   Offscreen target for the pick pass.  It has two R32UI attachments, one
+//   for the object ID and one for the primitive ID, plus a depth buffer, so
+//   picking never touches the visible frame.  Reads go through pixel pack
+//   buffers and fences: end() queues the read of the pixel under the cursor,
+//   and poll() hands the IDs over once the GPU has them, usually a frame or
+//   two later, without ever waiting.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __PICK_BUFFER_H__
+#define __PICK_BUFFER_H__
+
+#include "Angel.h"
+
+#define PICK_READBACK_SLOTS 2
+
+// What the pick shader wrote under the cursor; object 0 is the background
+struct PickSample {
+	GLuint	object;
+	GLuint	primitive;
+};
+
+class PickBuffer {
+public:
+	PickBuffer();
+
+	// Creates the framebuffer and pack buffers; needs a current context.
+	// The locations are the pick program's fragment outputs for the two IDs.
+	bool init( int width, int height, GLint objectOutput, GLint primitiveOutput );
+
+	// Binds the ID target, limited to a region pixels wide around window
+	// pixel (x, y), and clears it to 0
+	void begin( int x, int y, int region );
+
+	// Queues the read of (x, y) and rebinds the framebuffer that was bound
+	// at begin().  A newer read makes any older one stale.
+	void end( int x, int y );
+
+	// True once the newest read has landed; sample is then filled in
+	bool poll( PickSample& sample );
+
+	bool pending() const { return _pending >= 0; }
+
+private:
+	GLuint		_framebuffer;
+	GLuint		_renderbuffers[3];	// object IDs, primitive IDs, depth
+	GLint		_previousFramebuffer;
+
+	GLuint		_buffers[PICK_READBACK_SLOTS];
+	GLsync		_fences[PICK_READBACK_SLOTS];
+	int			_next;				// slot the next read uses
+	int			_pending;			// slot of the newest read, -1 for none
+	bool		_flushed;			// the newest fence has been flushed to the GPU
+};
+
+#endif // __PICK_BUFFER_H__
@@ -0,0 +1,255 @@
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#  include <OpenGL/gl3.h>
+#endif
+
+Profiler profiler;
+
+Profiler::Profiler() :
+	_frameCount(0), _inFrame(false), _gpuTiming(false), _passOpen(false),
+	_frameThread(std::thread::id())
+{
+	memset(&_current, 0, sizeof(_current));
+	memset(_pending, 0, sizeof(_pending));
+}
+
+void Profiler::init()
+{
+#ifdef GL_TIME_ELAPSED
+	while (glGetError() != GL_NO_ERROR)
+		;
+
+	for (int i = 0; i < 2; i++)
+		glGenQueries(ProfilerMaxPasses, _pending[i].queries);
+
+	// probe once; contexts without timer queries reject the target
+	glBeginQuery(GL_TIME_ELAPSED, _pending[0].queries[0]);
+	glEndQuery(GL_TIME_ELAPSED);
+	_gpuTiming = (glGetError() == GL_NO_ERROR);
+
+	if (!_gpuTiming)
+	{
+		for (int i = 0; i < 2; i++)
+			glDeleteQueries(ProfilerMaxPasses, _pending[i].queries);
+	}
+#endif
+}
+
+void Profiler::beginFrame()
+{
+	memset(&_current, 0, sizeof(_current));
+	_current.frame = _frameCount;
+	_current.gpuMs = -1.0;
+	_inFrame = true;
+	_frameThread = std::this_thread::get_id();
+
+	{
+		std::lock_guard<std::mutex> lock(_deferredMutex);
+		for (size_t i = 0; i < _deferred.size() && _current.scopeCount < ProfilerMaxScopes; i++)
+			_current.scopes[_current.scopeCount++] = _deferred[i];
+		_deferred.clear();
+	}
+
+	// this frame's query set was last used two frames ago
+	PendingPasses& pending = _pending[_frameCount % 2];
+	if (pending.count > 0)
+		resolve(pending);
+	pending.frame = _frameCount;
+	pending.count = 0;
+
+	_frameStart = Clock::now();
+}
+
+void Profiler::endFrame()
+{
+	if (!_inFrame)
+		return;
+
+	_current.cpuMs = std::chrono::duration<double, std::milli>(Clock::now() - _frameStart).count();
+	_history[_frameCount % ProfilerHistorySize] = _current;
+	_frameCount++;
+	_inFrame = false;
+}
+
+void Profiler::beginPass( const char* name )
+{
+	if (!_inFrame || _current.passCount == ProfilerMaxPasses)
+		return;
+
+	_current.passes[_current.passCount].name = name;
+	_current.passes[_current.passCount].ms = -1.0;
+
+#ifdef GL_TIME_ELAPSED
+	if (_gpuTiming)
+	{
+		PendingPasses& pending = _pending[_frameCount % 2];
+		glBeginQuery(GL_TIME_ELAPSED, pending.queries[pending.count]);
+		pending.count++;
+	}
+#endif
+	_current.passCount++;
+	_passOpen = true;
+}
+
+void Profiler::endPass()
+{
+	if (!_passOpen)
+		return;
+
+#ifdef GL_TIME_ELAPSED
+	if (_gpuTiming)
+		glEndQuery(GL_TIME_ELAPSED);
+#endif
+	_passOpen = false;
+}
+
+// Collects a finished frame's pass times, if the GPU has them
+void Profiler::resolve( PendingPasses& pending )
+{
+#ifdef GL_TIME_ELAPSED
+	FrameStats* stats = historyEntry(pending.frame);
+	if (stats == NULL)
+		return;
+
+	GLint available = GL_FALSE;
+	glGetQueryObjectiv(pending.queries[pending.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;		// leave them unresolved rather than wait
+
+	stats->gpuMs = 0.0;
+	for (int i = 0; i < pending.count && i < stats->passCount; i++)
+	{
+		GLuint nanoseconds = 0;
+		glGetQueryObjectuiv(pending.queries[i], GL_QUERY_RESULT, &nanoseconds);
+		stats->passes[i].ms = nanoseconds / 1.0e6;
+		stats->gpuMs += stats->passes[i].ms;
+	}
+#endif
+}
+
+FrameStats* Profiler::historyEntry( unsigned long frame )
+{
+	if (frame >= _frameCount || _frameCount - frame > ProfilerHistorySize)
+		return NULL;
+	return &_history[frame % ProfilerHistorySize];
+}
+
+void Profiler::countDraw( GLenum mode, GLsizei count )
+{
+	_current.drawCalls++;
+	if (mode == GL_TRIANGLES)
+		_current.triangles += count / 3;
+}
+
+void Profiler::addScope( const char* name, double ms )
+{
+	ProfileTiming timing = { name, ms };
+	std::thread::id frameThread = _frameThread.load();
+
+	if (frameThread == std::this_thread::get_id() && _inFrame)
+	{
+		if (_current.scopeCount < ProfilerMaxScopes)
+			_current.scopes[_current.scopeCount++] = timing;
+		return;
+	}
+
+	// between frames, or on another thread
+	std::lock_guard<std::mutex> lock(_deferredMutex);
+	if (frameThread == std::thread::id())
+		_startup.push_back(timing);
+	else if (_deferred.size() < ProfilerMaxScopes)
+		_deferred.push_back(timing);
+}
+
+const FrameStats* Profiler::lastFrame() const
+{
+	if (_frameCount == 0)
+		return NULL;
+	return &_history[(_frameCount - 1) % ProfilerHistorySize];
+}
+
+//----------------------------------------------------------------------------
+//
+//  Export
+//
+
+bool Profiler::exportCSV( const char* path ) const
+{
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL)
+		return false;
+
+	// one row per frame per timing, so scopes and passes can differ per frame
+	fprintf(fp, "frame,kind,name,ms,draw_calls,triangles,uniform_uploads\n");
+
+	for (size_t i = 0; i < _startup.size(); i++)
+		fprintf(fp, "-1,startup,%s,%.4f,,,\n", _startup[i].name, _startup[i].ms);
+
+	unsigned long first = _frameCount > ProfilerHistorySize ? _frameCount - ProfilerHistorySize : 0;
+	for (unsigned long f = first; f < _frameCount; f++)
+	{
+		const FrameStats& s = _history[f % ProfilerHistorySize];
+		fprintf(fp, "%lu,frame,cpu,%.4f,%d,%ld,%d\n", s.frame, s.cpuMs, s.drawCalls, s.triangles, s.uniformUploads);
+		if (s.gpuMs >= 0.0)
+			fprintf(fp, "%lu,frame,gpu,%.4f,,,\n", s.frame, s.gpuMs);
+		for (int i = 0; i < s.scopeCount; i++)
+			fprintf(fp, "%lu,scope,%s,%.4f,,,\n", s.frame, s.scopes[i].name, s.scopes[i].ms);
+		for (int i = 0; i < s.passCount; i++)
+		{
+			if (s.passes[i].ms >= 0.0)
+				fprintf(fp, "%lu,pass,%s,%.4f,,,\n", s.frame, s.passes[i].name, s.passes[i].ms);
+		}
+	}
+
+	fclose(fp);
+	return true;
+}
+
+static void writeTimings( FILE* fp, const ProfileTiming* timings, int count )
+{
+	fprintf(fp, "[");
+	for (int i = 0; i < count; i++)
+	{
+		if (timings[i].ms >= 0.0)
+			fprintf(fp, "%s{\"name\":\"%s\",\"ms\":%.4f}", i ? "," : "", timings[i].name, timings[i].ms);
+		else
+			fprintf(fp, "%s{\"name\":\"%s\",\"ms\":null}", i ? "," : "", timings[i].name);
+	}
+	fprintf(fp, "]");
+}
+
+bool Profiler::exportJSON( const char* path ) const
+{
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL)
+		return false;
+
+	fprintf(fp, "{\n  \"gpu_timing\": %s,\n  \"startup\": ", _gpuTiming ? "true" : "false");
+	writeTimings(fp, _startup.empty() ? NULL : &_startup[0], (int)_startup.size());
+	fprintf(fp, ",\n  \"frames\": [\n");
+
+	unsigned long first = _frameCount > ProfilerHistorySize ? _frameCount - ProfilerHistorySize : 0;
+	for (unsigned long f = first; f < _frameCount; f++)
+	{
+		const FrameStats& s = _history[f % ProfilerHistorySize];
+		fprintf(fp, "    {\"frame\":%lu,\"cpu_ms\":%.4f,", s.frame, s.cpuMs);
+		if (s.gpuMs >= 0.0)
+			fprintf(fp, "\"gpu_ms\":%.4f,", s.gpuMs);
+		else
+			fprintf(fp, "\"gpu_ms\":null,");
+		fprintf(fp, "\"draw_calls\":%d,\"triangles\":%ld,\"uniform_uploads\":%d,\"scopes\":",
+				s.drawCalls, s.triangles, s.uniformUploads);
+		writeTimings(fp, s.scopes, s.scopeCount);
+		fprintf(fp, ",\"passes\":");
+		writeTimings(fp, s.passes, s.passCount);
+		fprintf(fp, "}%s\n", f + 1 < _frameCount ? "," : "");
+	}
+
+	fprintf(fp, "  ]\n}\n");
+	fclose(fp);
+	return true;
+}
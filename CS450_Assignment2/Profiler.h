@@ -0,0 +1,133 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- Profiler.h ---
+//
+//   Per-frame instrumentation.  CPU time is measured with scoped timers,
+//   GPU time with GL_TIME_ELAPSED queries around passes.  The queries are
+//   double-buffered: a frame's results are collected two frames later, by
+//   which point the GPU is done with them, so reading them never stalls.
+//   Every frame also counts draw calls, triangles and uniform uploads.
+//
+//   The last ProfilerHistorySize frames are kept in memory and can be
+//   written out as CSV or JSON.  Scopes timed outside a frame (init, the
+//   loader) are kept separately as startup timings.
+//
+//   Frames belong to the thread that calls beginFrame().  Once frames have
+//   begun, scopes timed between them or on another thread, such as the
+//   input and frame preparation on the GLUT thread, are held under a lock
+//   and go into the next frame.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "Angel.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define ProfilerHistorySize  600
+#define ProfilerMaxScopes    16
+#define ProfilerMaxPasses    8
+
+struct ProfileTiming {
+	const char*	name;	// must be a string literal or otherwise outlive the profiler
+	double		ms;
+};
+
+struct FrameStats {
+	unsigned long	frame;
+	double			cpuMs;
+	double			gpuMs;			// sum of passes; negative until resolved
+	int				drawCalls;
+	long			triangles;
+	int				uniformUploads;
+	int				scopeCount;
+	ProfileTiming	scopes[ProfilerMaxScopes];
+	int				passCount;
+	ProfileTiming	passes[ProfilerMaxPasses];	// ms < 0 until resolved
+};
+
+class Profiler {
+public:
+	Profiler();
+
+	// Creates the GPU queries; needs a current GL context.  Without timer
+	// query support only CPU timings are recorded.
+	void init();
+
+	void beginFrame();
+	void endFrame();
+
+	// Wrap a GPU pass.  Passes must not nest.
+	void beginPass( const char* name );
+	void endPass();
+
+	// Called with the arguments of each glDrawArrays
+	void countDraw( GLenum mode, GLsizei count );
+	void countUniform( int uploads = 1 ) { _current.uniformUploads += uploads; }
+
+	// Used by ProfileScope
+	void addScope( const char* name, double ms );
+
+	// Most recent complete frame, or NULL before the first one
+	const FrameStats* lastFrame() const;
+
+	bool exportCSV( const char* path ) const;
+	bool exportJSON( const char* path ) const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct PendingPasses {
+		unsigned long	frame;
+		int				count;
+		GLuint			queries[ProfilerMaxPasses];
+	};
+
+	void resolve( PendingPasses& pending );
+	FrameStats* historyEntry( unsigned long frame );
+
+	FrameStats					_history[ProfilerHistorySize];
+	unsigned long				_frameCount;
+	FrameStats					_current;
+	Clock::time_point			_frameStart;
+	bool						_inFrame;
+	bool						_gpuTiming;
+	bool						_passOpen;
+	PendingPasses				_pending[2];
+	std::vector<ProfileTiming>	_startup;
+
+	// scopes from threads other than the frame thread
+	std::atomic<std::thread::id>	_frameThread;
+	std::mutex					_deferredMutex;
+	std::vector<ProfileTiming>	_deferred;
+};
+
+extern Profiler profiler;
+
+// Times the enclosing block and reports it to the profiler
+class ProfileScope {
+public:
+	ProfileScope( const char* name ) :
+		_name(name), _start(std::chrono::steady_clock::now()) {}
+
+	~ProfileScope() {
+		profiler.addScope(_name, std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - _start).count());
+	}
+
+private:
+	const char*								_name;
+	std::chrono::steady_clock::time_point	_start;
+};
+
+#define PROFILE_CONCAT2( a, b )  a##b
+#define PROFILE_CONCAT( a, b )   PROFILE_CONCAT2( a, b )
+#define PROFILE_SCOPE( name )    ProfileScope PROFILE_CONCAT( profileScope, __LINE__ )( name )
+
+#endif // __PROFILER_H__
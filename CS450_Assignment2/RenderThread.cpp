@@ -0,0 +1,247 @@
+#include "RenderThread.h"
+#include "Angel.h"
+#include "Log.h"
+
+#ifdef __APPLE__
+#  include <OpenGL/OpenGL.h>
+#else
+#  include <GL/glx.h>
+#  include <X11/Xlib.h>
+#endif
+
+RenderThread renderThread;
+
+//----------------------------------------------------------------------------
+//
+//  The window's drawing context, per platform
+//
+
+#ifdef __APPLE__
+
+// GLUT's own context.  CGL lets a context be current on several threads;
+// the GLUT thread stops issuing GL once the render thread has it, and the
+// lock keeps GLUT's own updates of the drawable out of a frame.
+struct RenderContext {
+	CGLContextObj	context;
+};
+
+static RenderContext* captureContext()
+{
+	CGLContextObj context = CGLGetCurrentContext();
+	if (context == NULL)
+		return NULL;
+
+	RenderContext* c = new RenderContext;
+	c->context = CGLRetainContext(context);
+	return c;
+}
+
+static void makeCurrent( RenderContext* c )		{ CGLSetCurrentContext(c->context); }
+static void releaseCurrent( RenderContext* c )	{ CGLSetCurrentContext(NULL); }
+static void lockContext( RenderContext* c )		{ CGLLockContext(c->context); }
+static void unlockContext( RenderContext* c )	{ CGLUnlockContext(c->context); }
+static void swapBuffers( RenderContext* c )		{ CGLFlushDrawable(c->context); }
+
+static void destroyContext( RenderContext* c )
+{
+	CGLReleaseContext(c->context);
+	delete c;
+}
+
+#else
+
+// A second context on GLUT's window, sharing buffers and programs with
+// GLUT's.  freeglut makes its own context current on the GLUT thread
+// before every callback, and a GLX context can only be current on one
+// thread, so the render thread can't simply take GLUT's.
+struct RenderContext {
+	Display*		display;
+	GLXDrawable		drawable;
+	GLXContext		context;
+};
+
+typedef GLXContext (*CreateContextAttribsFunction)( Display*, GLXFBConfig, GLXContext, Bool, const int* );
+
+// Xlib's default handler exits on any error, and a context the server
+// can't make is one
+static bool contextFailed = false;
+
+static int contextError( Display* display, XErrorEvent* error )
+{
+	contextFailed = true;
+	return 0;
+}
+
+static RenderContext* captureContext()
+{
+	Display* display = glXGetCurrentDisplay();
+	GLXContext shared = glXGetCurrentContext();
+	GLXDrawable drawable = glXGetCurrentDrawable();
+	if (display == NULL || shared == NULL || drawable == None)
+		return NULL;
+
+	CreateContextAttribsFunction createContextAttribs = (CreateContextAttribsFunction)
+		glXGetProcAddress((const GLubyte*)"glXCreateContextAttribsARB");
+	if (createContextAttribs == NULL)
+		return NULL;
+
+	// the same framebuffer configuration and version as GLUT's
+	int configID = 0;
+	glXQueryContext(display, shared, GLX_FBCONFIG_ID, &configID);
+	int configAttribs[] = { GLX_FBCONFIG_ID, configID, None };
+	int configCount = 0;
+	GLXFBConfig* configs = glXChooseFBConfig(display, DefaultScreen(display), configAttribs, &configCount);
+	if (configs == NULL || configCount == 0)
+		return NULL;
+
+	int contextAttribs[] = {
+		GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
+		GLX_CONTEXT_MINOR_VERSION_ARB, 2,
+		GLX_CONTEXT_FLAGS_ARB, GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB,
+		None
+	};
+	int (*previousHandler)( Display*, XErrorEvent* ) = XSetErrorHandler(contextError);
+	GLXContext context = createContextAttribs(display, configs[0], shared, True, contextAttribs);
+	XSync(display, False);
+	XSetErrorHandler(previousHandler);
+	XFree(configs);
+
+	if (contextFailed && context != NULL)
+		glXDestroyContext(display, context);
+	if (contextFailed || context == NULL)
+		return NULL;
+
+	RenderContext* c = new RenderContext;
+	c->display = display;
+	c->drawable = drawable;
+	c->context = context;
+	return c;
+}
+
+static void makeCurrent( RenderContext* c )		{ glXMakeCurrent(c->display, c->drawable, c->context); }
+static void releaseCurrent( RenderContext* c )	{ glXMakeCurrent(c->display, None, NULL); }
+static void lockContext( RenderContext* c )		{}
+static void unlockContext( RenderContext* c )	{}
+static void swapBuffers( RenderContext* c )		{ glXSwapBuffers(c->display, c->drawable); }
+
+static void destroyContext( RenderContext* c )
+{
+	glXDestroyContext(c->display, c->context);
+	delete c;
+}
+
+#endif // __APPLE__
+
+//----------------------------------------------------------------------------
+
+RenderThread::RenderThread() :
+	_context(NULL), _woken(false), _running(false), _stopping(false)
+{
+}
+
+RenderThread::~RenderThread()
+{
+	stop();
+}
+
+void RenderThread::initThreads()
+{
+#ifndef __APPLE__
+	XInitThreads();
+#endif
+}
+
+void RenderThread::start( const Function& init, const Function& frame )
+{
+	_init = init;
+	_frame = frame;
+
+	_context = captureContext();
+	if (_context == NULL)
+	{
+		LOG_WARN("no context for a render thread; rendering on the GLUT thread");
+		_init();
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_thread = std::thread(&RenderThread::threadMain, this);
+	_started.wait(lock, [this] { return _running; });
+}
+
+void RenderThread::stop()
+{
+	if (!_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_wake.notify_one();
+	_thread.join();
+
+	destroyContext(_context);
+	_context = NULL;
+}
+
+// The snapshot itself was handed over without a lock; this only wakes the
+// render thread if it is asleep
+void RenderThread::wake()
+{
+	if (!_thread.joinable())
+	{
+		_frame();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_woken = true;
+	}
+	_wake.notify_one();
+}
+
+void RenderThread::present()
+{
+	if (_context != NULL)
+		swapBuffers(_context);
+	else
+		glutSwapBuffers();
+}
+
+void RenderThread::threadMain()
+{
+	makeCurrent(_context);
+#ifndef __APPLE__
+	glewExperimental = GL_TRUE;
+	glewInit();
+#endif
+
+	lockContext(_context);
+	_init();
+	unlockContext(_context);
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = true;
+	}
+	_started.notify_one();
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this] { return _woken || _stopping; });
+			if (_stopping)
+				break;
+			_woken = false;
+		}
+
+		lockContext(_context);
+		_frame();
+		unlockContext(_context);
+	}
+
+	releaseCurrent(_context);
+}
@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- RenderThread.h ---
+//
+//   Runs the GL side of the program on a thread of its own, so that a slow
+//   frame or a readback never holds up input.  The GLUT thread handles
+//   events, updates the scene and publishes an immutable snapshot of each
+//   frame; the render thread draws the newest snapshot it has and skips
+//   any it fell behind on.  Snapshots, and results coming back, pass
+//   between the threads through lock-free triple buffers.
+//
+//   The render thread draws into the GLUT window with a context of its own
+//   that shares objects with GLUT's (GLX), or with GLUT's context itself,
+//   which the GLUT thread then never uses (CGL).  Where neither is
+//   possible, start() falls back to drawing on the GLUT thread.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __RENDER_THREAD_H__
+#define __RENDER_THREAD_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//----------------------------------------------------------------------------
+//
+//  TripleBuffer - one producer hands values to one consumer without either
+//    waiting.  The producer fills back() and publishes it; the consumer
+//    takes the newest published value with acquire() and reads it from
+//    front() until its next acquire().  Neither side ever sees a slot the
+//    other is using, so a published value is immutable until it is
+//    replaced, and values the consumer didn't get to are skipped.
+//
+
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : _back(0), _middle(1), _front(2) {}
+
+	T& back() { return _slots[_back]; }
+
+	void publish() { _back = _middle.exchange(_back | Fresh) & Index; }
+
+	// True if something newer than front() has been published
+	bool acquire()
+	{
+		if ((_middle.load() & Fresh) == 0)
+			return false;
+		_front = _middle.exchange(_front) & Index;
+		return true;
+	}
+
+	const T& front() const { return _slots[_front]; }
+
+private:
+	enum {
+		Index = 3,		// slot number
+		Fresh = 4		// published and not yet acquired
+	};
+
+	T						_slots[3];
+	unsigned				_back;		// producer's
+	std::atomic<unsigned>	_middle;	// last published, or handed back
+	unsigned				_front;		// consumer's
+};
+
+//----------------------------------------------------------------------------
+
+// The render thread's handle on the window, per platform
+struct RenderContext;
+
+class RenderThread {
+public:
+	typedef std::function<void()> Function;
+
+	RenderThread();
+	~RenderThread();
+
+	// Call before glutInit; Xlib must be told it will be used from more
+	// than one thread before anything else touches it
+	static void initThreads();
+
+	// Call on the GLUT thread once the window exists and its context is
+	// current.  init runs first, on the render thread, and start() returns
+	// once it has; frame then runs for every wake().
+	void start( const Function& init, const Function& frame );
+
+	// Stops the render thread after the frame it is on
+	void stop();
+
+	// A new snapshot has been published.  Without a render thread this
+	// draws it before returning.
+	void wake();
+
+	// Called by the frame function to show what it drew
+	void present();
+
+	bool threaded() const { return _thread.joinable(); }
+
+private:
+	void threadMain();
+
+	RenderContext*			_context;
+	Function				_init;
+	Function				_frame;
+	std::thread				_thread;
+	std::mutex				_mutex;
+	std::condition_variable	_wake;
+	std::condition_variable	_started;
+	bool					_woken;
+	bool					_running;
+	bool					_stopping;
+};
+
+extern RenderThread renderThread;
+
+#endif // __RENDER_THREAD_H__
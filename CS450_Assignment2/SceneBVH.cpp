@@ -0,0 +1,239 @@
+#include "SceneBVH.h"
+
+// A leaf's box is grown by this fraction of its largest extent
+#define SCENE_BVH_MARGIN 0.1f
+
+static AABB merge( const AABB& a, const AABB& b )
+{
+	AABB box = a;
+	box.grow(b);
+	return box;
+}
+
+static bool contains( const AABB& outer, const AABB& inner )
+{
+	return outer.lo.x <= inner.lo.x && outer.lo.y <= inner.lo.y && outer.lo.z <= inner.lo.z &&
+		   outer.hi.x >= inner.hi.x && outer.hi.y >= inner.hi.y && outer.hi.z >= inner.hi.z;
+}
+
+void SceneBVH::clear()
+{
+	_nodes.clear();
+	_leaves.clear();
+	_root = -1;
+	_free = -1;
+}
+
+bool SceneBVH::update( int object, const AABB& bounds )
+{
+	if (object >= (int)_leaves.size())
+		_leaves.resize(object + 1, -1);
+
+	int leaf = _leaves[object];
+	if (leaf >= 0)
+	{
+		if (contains(_nodes[leaf].bounds, bounds))
+			return false;
+		removeLeaf(leaf);
+	}
+	else
+	{
+		leaf = allocate();
+		_nodes[leaf].object = object;
+		_leaves[object] = leaf;
+	}
+
+	vec3 extent = bounds.hi - bounds.lo;
+	float margin = SCENE_BVH_MARGIN * std::max(extent.x, std::max(extent.y, extent.z));
+	_nodes[leaf].bounds.lo = bounds.lo - vec3(margin);
+	_nodes[leaf].bounds.hi = bounds.hi + vec3(margin);
+	insertLeaf(leaf);
+	return true;
+}
+
+void SceneBVH::remove( int object )
+{
+	if (object >= (int)_leaves.size() || _leaves[object] < 0)
+		return;
+
+	removeLeaf(_leaves[object]);
+	release(_leaves[object]);
+	_leaves[object] = -1;
+}
+
+//----------------------------------------------------------------------------
+
+int SceneBVH::allocate()
+{
+	int node;
+	if (_free >= 0)
+	{
+		node = _free;
+		_free = _nodes[node].parent;
+	}
+	else
+	{
+		node = (int)_nodes.size();
+		_nodes.push_back(Node());
+	}
+
+	_nodes[node].parent = -1;
+	_nodes[node].child[0] = _nodes[node].child[1] = -1;
+	_nodes[node].object = -1;
+	_nodes[node].height = 0;
+	return node;
+}
+
+void SceneBVH::release( int node )
+{
+	_nodes[node].parent = _free;
+	_nodes[node].height = -1;
+	_free = node;
+}
+
+// Pairs the leaf with the sibling that costs the least surface area:
+// the box it would share with the sibling, plus what that grows every
+// ancestor by on the way down
+void SceneBVH::insertLeaf( int leaf )
+{
+	if (_root < 0)
+	{
+		_root = leaf;
+		_nodes[leaf].parent = -1;
+		return;
+	}
+
+	AABB box = _nodes[leaf].bounds;
+	int sibling = _root;
+	while (!_nodes[sibling].leaf())
+	{
+		const Node& node = _nodes[sibling];
+		float area = node.bounds.surfaceArea();
+		float combined = merge(node.bounds, box).surfaceArea();
+
+		// pairing here makes a new parent over this whole subtree
+		float cost = 2.0f * combined;
+		float inherited = 2.0f * (combined - area);
+
+		float childCost[2];
+		for (int c = 0; c < 2; c++)
+		{
+			const Node& child = _nodes[node.child[c]];
+			float grown = merge(child.bounds, box).surfaceArea();
+			childCost[c] = (child.leaf() ? grown : grown - child.bounds.surfaceArea()) + inherited;
+		}
+
+		if (cost < childCost[0] && cost < childCost[1])
+			break;
+		sibling = childCost[0] < childCost[1] ? node.child[0] : node.child[1];
+	}
+
+	int oldParent = _nodes[sibling].parent;
+	int parent = allocate();
+	_nodes[parent].parent = oldParent;
+	_nodes[parent].bounds = merge(box, _nodes[sibling].bounds);
+	_nodes[parent].height = _nodes[sibling].height + 1;
+	_nodes[parent].child[0] = sibling;
+	_nodes[parent].child[1] = leaf;
+	_nodes[sibling].parent = parent;
+	_nodes[leaf].parent = parent;
+
+	if (oldParent < 0)
+		_root = parent;
+	else if (_nodes[oldParent].child[0] == sibling)
+		_nodes[oldParent].child[0] = parent;
+	else
+		_nodes[oldParent].child[1] = parent;
+
+	refitUp(_nodes[leaf].parent);
+}
+
+// Unlinks the leaf and puts its sibling in place of their parent
+void SceneBVH::removeLeaf( int leaf )
+{
+	if (leaf == _root)
+	{
+		_root = -1;
+		return;
+	}
+
+	int parent = _nodes[leaf].parent;
+	int grandParent = _nodes[parent].parent;
+	int sibling = _nodes[parent].child[0] == leaf ? _nodes[parent].child[1] : _nodes[parent].child[0];
+	release(parent);
+
+	_nodes[sibling].parent = grandParent;
+	if (grandParent < 0)
+	{
+		_root = sibling;
+		return;
+	}
+
+	if (_nodes[grandParent].child[0] == parent)
+		_nodes[grandParent].child[0] = sibling;
+	else
+		_nodes[grandParent].child[1] = sibling;
+	refitUp(grandParent);
+}
+
+// Rebalances and recomputes boxes from the node up to the root
+void SceneBVH::refitUp( int node )
+{
+	while (node >= 0)
+	{
+		node = rotate(node);
+
+		Node& n = _nodes[node];
+		const Node& left = _nodes[n.child[0]];
+		const Node& right = _nodes[n.child[1]];
+		n.height = 1 + std::max(left.height, right.height);
+		n.bounds = merge(left.bounds, right.bounds);
+		node = n.parent;
+	}
+}
+
+// If one child is more than a level taller than the other, lifts that
+// child into the node's place, handing its shorter grandchild down.
+// Returns the node now at this position.
+int SceneBVH::rotate( int a )
+{
+	if (_nodes[a].leaf() || _nodes[a].height < 2)
+		return a;
+
+	int balance = _nodes[_nodes[a].child[1]].height - _nodes[_nodes[a].child[0]].height;
+	if (balance >= -1 && balance <= 1)
+		return a;
+
+	// side of a that is too tall, and the other one
+	int tall = balance > 0 ? 1 : 0;
+	int b = _nodes[a].child[tall];
+	int c = _nodes[a].child[1 - tall];
+	int f = _nodes[b].child[0];
+	int g = _nodes[b].child[1];
+
+	// b takes a's place, with a as one child
+	_nodes[b].child[0] = a;
+	_nodes[b].parent = _nodes[a].parent;
+	_nodes[a].parent = b;
+
+	int parent = _nodes[b].parent;
+	if (parent < 0)
+		_root = b;
+	else if (_nodes[parent].child[0] == a)
+		_nodes[parent].child[0] = b;
+	else
+		_nodes[parent].child[1] = b;
+
+	// b keeps its taller child; the shorter one goes to a
+	int keep = _nodes[f].height > _nodes[g].height ? f : g;
+	int give = keep == f ? g : f;
+	_nodes[b].child[1] = keep;
+	_nodes[a].child[tall] = give;
+	_nodes[give].parent = a;
+
+	_nodes[a].bounds = merge(_nodes[c].bounds, _nodes[give].bounds);
+	_nodes[a].height = 1 + std::max(_nodes[c].height, _nodes[give].height);
+	_nodes[b].bounds = merge(_nodes[a].bounds, _nodes[keep].bounds);
+	_nodes[b].height = 1 + std::max(_nodes[a].height, _nodes[keep].height);
+	return b;
+}
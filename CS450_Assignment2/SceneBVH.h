@@ -0,0 +1,189 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- SceneBVH.h ---
+//
+//   Top-level hierarchy over whole objects, above their MeshBVHs.  Each
+//   object is a leaf holding its eye-space box, grown by a margin so small
+//   moves fit inside it.  A move that leaves the box takes the leaf out and
+//   reinserts it where it adds the least surface area; rotations on the way
+//   back up keep the tree balanced, so no edit ever rebuilds the whole tree.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SCENE_BVH_H__
+#define __SCENE_BVH_H__
+
+#include "Angel.h"
+#include "MeshBVH.h"
+#include "DrawList.h"
+#include <algorithm>
+#include <vector>
+
+// Deep enough for any balanced tree that fits in memory
+#define SCENE_BVH_STACK_SIZE 64
+
+class SceneBVH {
+public:
+	SceneBVH() : _root(-1), _free(-1) {}
+
+	void clear();
+
+	// Sets an object's eye-space bounds, adding it if it is new.  Returns
+	// whether the leaf had to be reinserted.
+	bool update( int object, const AABB& bounds );
+	void remove( int object );
+
+	int height() const { return _root < 0 ? 0 : _nodes[_root].height; }
+
+	// Calls function(object) for every object whose box overlaps the box
+	template <typename Function>
+	void queryBox( const AABB& box, Function function ) const;
+
+	// Calls function(object) for every object whose box is not entirely
+	// outside one of the frustum's planes
+	template <typename Function>
+	void queryFrustum( const ViewFrustum& frustum, Function function ) const;
+
+	// Calls function(object, tMax) for every object whose box the ray
+	// enters before tMax, nearest box first.  The function returns the
+	// distance to its nearest hit, or tMax for none, which prunes the rest.
+	template <typename Function>
+	float queryRay( const Ray& ray, float tMax, Function function ) const;
+
+private:
+	struct Node {
+		AABB	bounds;
+		int		parent;			// or the next free node
+		int		child[2];		// -1 for a leaf
+		int		object;
+		int		height;			// 0 for a leaf
+
+		bool leaf() const { return child[0] < 0; }
+	};
+
+	int allocate();
+	void release( int node );
+	void insertLeaf( int leaf );
+	void removeLeaf( int leaf );
+	void refitUp( int node );
+	int rotate( int node );
+
+	std::vector<Node>	_nodes;
+	std::vector<int>	_leaves;		// leaf node of each object, or -1
+	int					_root;
+	int					_free;
+};
+
+//----------------------------------------------------------------------------
+
+inline bool overlaps( const AABB& a, const AABB& b )
+{
+	return a.lo.x <= b.hi.x && b.lo.x <= a.hi.x &&
+		   a.lo.y <= b.hi.y && b.lo.y <= a.hi.y &&
+		   a.lo.z <= b.hi.z && b.lo.z <= a.hi.z;
+}
+
+template <typename Function>
+void SceneBVH::queryBox( const AABB& box, Function function ) const
+{
+	if (_root < 0)
+		return;
+
+	int stack[SCENE_BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = _root;
+
+	while (top > 0)
+	{
+		const Node& node = _nodes[stack[--top]];
+		if (!overlaps(node.bounds, box))
+			continue;
+
+		if (node.leaf())
+			function(node.object);
+		else
+		{
+			stack[top++] = node.child[0];
+			stack[top++] = node.child[1];
+		}
+	}
+}
+
+template <typename Function>
+void SceneBVH::queryFrustum( const ViewFrustum& frustum, Function function ) const
+{
+	if (_root < 0)
+		return;
+
+	int stack[SCENE_BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = _root;
+
+	while (top > 0)
+	{
+		const Node& node = _nodes[stack[--top]];
+		if (!frustum.intersectsBox(node.bounds.lo, node.bounds.hi))
+			continue;
+
+		if (node.leaf())
+			function(node.object);
+		else
+		{
+			stack[top++] = node.child[0];
+			stack[top++] = node.child[1];
+		}
+	}
+}
+
+template <typename Function>
+float SceneBVH::queryRay( const Ray& ray, float tMax, Function function ) const
+{
+	if (_root < 0)
+		return tMax;
+
+	vec3 inverseDirection(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+
+	int stack[SCENE_BVH_STACK_SIZE];
+	float enter[SCENE_BVH_STACK_SIZE];
+	int top = 0;
+
+	float tRoot;
+	if (!_nodes[_root].bounds.intersect(ray, inverseDirection, tMax, tRoot))
+		return tMax;
+	stack[top] = _root;
+	enter[top++] = tRoot;
+
+	while (top > 0)
+	{
+		top--;
+		if (enter[top] >= tMax)
+			continue;
+
+		const Node& node = _nodes[stack[top]];
+		if (node.leaf())
+		{
+			tMax = std::min(tMax, function(node.object, tMax));
+			continue;
+		}
+
+		float t0, t1;
+		bool hit0 = _nodes[node.child[0]].bounds.intersect(ray, inverseDirection, tMax, t0);
+		bool hit1 = _nodes[node.child[1]].bounds.intersect(ray, inverseDirection, tMax, t1);
+
+		// the nearer child goes on top
+		if (hit0 && hit1 && t0 < t1)
+		{
+			stack[top] = node.child[1];  enter[top++] = t1;
+			stack[top] = node.child[0];  enter[top++] = t0;
+		}
+		else
+		{
+			if (hit0) { stack[top] = node.child[0];  enter[top++] = t0; }
+			if (hit1) { stack[top] = node.child[1];  enter[top++] = t1; }
+		}
+	}
+
+	return tMax;
+}
+
+#endif // __SCENE_BVH_H__
@@ -0,0 +1,165 @@
+#include "SelectionRegion.h"
+#include <algorithm>
+
+void SelectionRegion::setRectangle( const vec2& a, const vec2& b )
+{
+	_x0 = (int)floorf(std::min(a.x, b.x));
+	_y0 = (int)floorf(std::min(a.y, b.y));
+	_width = (int)floorf(std::max(a.x, b.x)) + 1 - _x0;
+	_height = (int)floorf(std::max(a.y, b.y)) + 1 - _y0;
+
+	_mask.assign(_width * _height, 1);
+	buildSums();
+}
+
+void SelectionRegion::setLasso( const std::vector<vec2>& points )
+{
+	if (points.size() < 3)
+	{
+		_width = _height = 0;
+		_mask.clear();
+		_sums.clear();
+		return;
+	}
+
+	vec2 lo = points[0], hi = points[0];
+	for (size_t i = 1; i < points.size(); i++)
+	{
+		lo.x = std::min(lo.x, points[i].x);  hi.x = std::max(hi.x, points[i].x);
+		lo.y = std::min(lo.y, points[i].y);  hi.y = std::max(hi.y, points[i].y);
+	}
+	_x0 = (int)floorf(lo.x);
+	_y0 = (int)floorf(lo.y);
+	_width = (int)floorf(hi.x) + 1 - _x0;
+	_height = (int)floorf(hi.y) + 1 - _y0;
+	_mask.assign(_width * _height, 0);
+
+	// fill between pairs of edge crossings through each row's centers
+	std::vector<float> crossings;
+	for (int row = 0; row < _height; row++)
+	{
+		float y = _y0 + row + 0.5f;
+		crossings.clear();
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			const vec2& p = points[i];
+			const vec2& q = points[(i + 1) % points.size()];
+			if ((p.y <= y) != (q.y <= y))
+				crossings.push_back(p.x + (y - p.y) * (q.x - p.x) / (q.y - p.y));
+		}
+		std::sort(crossings.begin(), crossings.end());
+
+		unsigned char* line = &_mask[row * _width];
+		for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+		{
+			int begin = std::max((int)ceilf(crossings[i] - 0.5f) - _x0, 0);
+			int end = std::min((int)ceilf(crossings[i + 1] - 0.5f) - _x0, _width);
+			for (int x = begin; x < end; x++)
+				line[x] = 1;
+		}
+	}
+
+	buildSums();
+}
+
+void SelectionRegion::buildSums()
+{
+	int stride = _width + 1;
+	_sums.assign(stride * (_height + 1), 0);
+	for (int y = 0; y < _height; y++)
+	{
+		int rowSum = 0;
+		for (int x = 0; x < _width; x++)
+		{
+			rowSum += _mask[y * _width + x];
+			_sums[(y + 1) * stride + x + 1] = _sums[y * stride + x + 1] + rowSum;
+		}
+	}
+}
+
+// Region pixels in [x0, x1) x [y0, y1), in mask coordinates
+int SelectionRegion::count( int x0, int y0, int x1, int y1 ) const
+{
+	int stride = _width + 1;
+	return _sums[y1 * stride + x1] - _sums[y0 * stride + x1] - _sums[y1 * stride + x0] + _sums[y0 * stride + x0];
+}
+
+// Mask-coordinate range of the pixels a window rectangle touches
+void SelectionRegion::clip( const vec2& lo, const vec2& hi, int& x0, int& y0, int& x1, int& y1 ) const
+{
+	x0 = std::max((int)floorf(lo.x) - _x0, 0);
+	y0 = std::max((int)floorf(lo.y) - _y0, 0);
+	x1 = std::min((int)floorf(hi.x) + 1 - _x0, _width);
+	y1 = std::min((int)floorf(hi.y) + 1 - _y0, _height);
+}
+
+bool SelectionRegion::overlapsRect( const vec2& lo, const vec2& hi ) const
+{
+	int x0, y0, x1, y1;
+	clip(lo, hi, x0, y0, x1, y1);
+	return x0 < x1 && y0 < y1 && count(x0, y0, x1, y1) > 0;
+}
+
+bool SelectionRegion::containsRect( const vec2& lo, const vec2& hi ) const
+{
+	if (floorf(lo.x) < _x0 || floorf(lo.y) < _y0 || floorf(hi.x) >= right() || floorf(hi.y) >= top())
+		return false;
+
+	int x0, y0, x1, y1;
+	clip(lo, hi, x0, y0, x1, y1);
+	return count(x0, y0, x1, y1) == (x1 - x0) * (y1 - y0);
+}
+
+bool SelectionRegion::overlapsTriangle( const vec2& a, const vec2& b, const vec2& c ) const
+{
+	vec2 lo(std::min(a.x, std::min(b.x, c.x)), std::min(a.y, std::min(b.y, c.y)));
+	vec2 hi(std::max(a.x, std::max(b.x, c.x)), std::max(a.y, std::max(b.y, c.y)));
+
+	int x0, y0, x1, y1;
+	clip(lo, hi, x0, y0, x1, y1);
+	if (x0 >= x1 || y0 >= y1 || count(x0, y0, x1, y1) == 0)
+		return false;
+	if (containsRect(lo, hi))
+		return true;
+
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area == 0.0f)
+		return true;	// a sliver; its bounds touching the region will do
+
+	// edge functions A x + B y + C, positive inside
+	const vec2* corners[3] = { &a, &b, &c };
+	float edgeA[3], edgeB[3], edgeC[3];
+	for (int e = 0; e < 3; e++)
+	{
+		const vec2& p = *corners[e];
+		const vec2& q = *corners[(e + 1) % 3];
+		float sign = area > 0.0f ? 1.0f : -1.0f;
+		edgeA[e] = -(q.y - p.y) * sign;
+		edgeB[e] = (q.x - p.x) * sign;
+		edgeC[e] = -(edgeA[e] * p.x + edgeB[e] * p.y);
+	}
+
+	// a pixel square touches the triangle if, for every edge, its corner
+	// farthest inside is inside
+	for (int y = y0; y < y1; y++)
+	{
+		const unsigned char* line = &_mask[y * _width];
+		for (int x = x0; x < x1; x++)
+		{
+			if (!line[x])
+				continue;
+
+			float px = (float)(_x0 + x), py = (float)(_y0 + y);
+			bool inside = true;
+			for (int e = 0; e < 3 && inside; e++)
+			{
+				float cx = edgeA[e] > 0.0f ? px + 1.0f : px;
+				float cy = edgeB[e] > 0.0f ? py + 1.0f : py;
+				inside = edgeA[e] * cx + edgeB[e] * cy + edgeC[e] >= 0.0f;
+			}
+			if (inside)
+				return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,60 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- SelectionRegion.h ---
+//
+//   Screen region for rubber-band and lasso selection, held as a pixel
+//   mask over the region's bounding rectangle with a summed-area table, so
+//   any rectangle can be asked how many region pixels it covers in four
+//   lookups.  Coordinates are window pixels with the origin at the bottom
+//   left; pixel (x, y) covers [x, x+1) x [y, y+1) and is in the region when
+//   its center is.
+//
+//   The overlap tests are conservative: a triangle or box that touches a
+//   region pixel at all counts, even if it misses the pixel's center.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SELECTION_REGION_H__
+#define __SELECTION_REGION_H__
+
+#include "Angel.h"
+#include <vector>
+
+class SelectionRegion {
+public:
+	SelectionRegion() : _x0(0), _y0(0), _width(0), _height(0) {}
+
+	// Rectangle with corners at two window positions, in either order
+	void setRectangle( const vec2& a, const vec2& b );
+
+	// Closed polygon through the points, filled even-odd
+	void setLasso( const std::vector<vec2>& points );
+
+	bool empty() const { return _width <= 0 || _height <= 0; }
+
+	// Pixel bounds of the region, [left, right) x [bottom, top)
+	int left() const { return _x0; }
+	int bottom() const { return _y0; }
+	int right() const { return _x0 + _width; }
+	int top() const { return _y0 + _height; }
+
+	// Whether any region pixel touches the rectangle
+	bool overlapsRect( const vec2& lo, const vec2& hi ) const;
+
+	// Whether every pixel the rectangle touches is a region pixel
+	bool containsRect( const vec2& lo, const vec2& hi ) const;
+
+	bool overlapsTriangle( const vec2& a, const vec2& b, const vec2& c ) const;
+
+private:
+	void clip( const vec2& lo, const vec2& hi, int& x0, int& y0, int& x1, int& y1 ) const;
+	int count( int x0, int y0, int x1, int y1 ) const;
+	void buildSums();
+
+	int							_x0, _y0;
+	int							_width, _height;
+	std::vector<unsigned char>	_mask;		// row-major from the bottom row
+	std::vector<int>			_sums;		// (width+1) x (height+1), zero first row and column
+};
+
+#endif // __SELECTION_REGION_H__
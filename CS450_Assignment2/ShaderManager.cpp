@@ -0,0 +1,227 @@
+#include "ShaderManager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+
+#ifdef __APPLE__
+#  include <OpenGL/gl3.h>
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#  define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+using namespace std;
+
+static string readFile( const string& fileName )
+{
+	ifstream fileStream(fileName.c_str());
+	if (!fileStream.is_open())
+	{
+		cout << "\nCouldn't read file " << fileName << endl;
+		exit(1);
+	}
+	stringstream contents;
+	contents << fileStream.rdbuf();
+	return contents.str();
+}
+
+static bool hasExtension( const char* name )
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count; i++)
+	{
+		const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (ext != NULL && strcmp(ext, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+// True if the driver compiles in the background and can be polled with
+// GL_COMPLETION_STATUS_KHR
+static bool enableParallelCompile()
+{
+	if (!hasExtension("GL_KHR_parallel_shader_compile"))
+		return false;
+
+#ifdef GL_KHR_parallel_shader_compile
+	// 0xFFFFFFFF lets the implementation pick the number of threads.  Older
+	// headers don't declare the entry point; the driver's default thread
+	// count applies then, which is what this would ask for anyway.
+	glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+#endif
+	return true;
+}
+
+//----------------------------------------------------------------------------
+
+ShaderManager::ShaderManager() :
+	_fallback(0), _setup(NULL), _pendingCount(0), _parallel(false)
+{
+}
+
+ShaderManager::~ShaderManager()
+{
+	// programs are owned by the GL context, which is gone by the time
+	// globals are destroyed
+}
+
+void ShaderManager::setSources( const char* vShaderFile, const char* fShaderFile )
+{
+	_vFile = vShaderFile;
+	_fFile = fShaderFile;
+	_sources[0] = readFile(_vFile);
+	_sources[1] = readFile(_fFile);
+}
+
+void ShaderManager::bindAttribLocation( const char* name, GLuint location )
+{
+	_attribLocations.push_back(make_pair(string(name), location));
+}
+
+int ShaderManager::addVariant( const vector<string>& defines )
+{
+	Variant v;
+	for (size_t i = 0; i < defines.size(); i++)
+		v.defines += "#define " + defines[i] + "\n";
+	v.program = 0;
+	v.shaders[0] = v.shaders[1] = 0;
+	v.state = Queued;
+	_variants.push_back(v);
+	return (int)_variants.size() - 1;
+}
+
+void ShaderManager::compileAll()
+{
+	_parallel = enableParallelCompile();
+
+	for (size_t i = 0; i < _variants.size(); i++)
+	{
+		if (_variants[i].state == Queued)
+		{
+			submit(_variants[i]);
+			_pendingCount++;
+		}
+	}
+}
+
+// Issues compile and link but never queries their status, which is what
+// would force the driver to wait for them.
+void ShaderManager::submit( Variant& v )
+{
+	const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+
+	v.program = glCreateProgram();
+	for (int i = 0; i < 2; i++)
+	{
+		// the #defines have to go after the #version line
+		const string& source = _sources[i];
+		string::size_type bodyStart = 0;
+		if (source.compare(0, 8, "#version") == 0)
+		{
+			bodyStart = source.find('\n');
+			bodyStart = (bodyStart == string::npos) ? source.size() : bodyStart + 1;
+		}
+		string header = source.substr(0, bodyStart);
+		const GLchar* strings[3] = {
+			header.c_str(),
+			v.defines.c_str(),
+			source.c_str() + bodyStart
+		};
+
+		v.shaders[i] = glCreateShader(types[i]);
+		glShaderSource(v.shaders[i], 3, strings, NULL);
+		glCompileShader(v.shaders[i]);
+		glAttachShader(v.program, v.shaders[i]);
+	}
+
+	for (size_t i = 0; i < _attribLocations.size(); i++)
+		glBindAttribLocation(v.program, _attribLocations[i].second, _attribLocations[i].first.c_str());
+
+	glLinkProgram(v.program);
+	v.state = Compiling;
+}
+
+// Checks the link result; blocks if the driver has not finished yet
+void ShaderManager::finish( Variant& v )
+{
+	GLint linked;
+	glGetProgramiv(v.program, GL_LINK_STATUS, &linked);
+
+	for (int i = 0; i < 2; i++)
+	{
+		glDetachShader(v.program, v.shaders[i]);
+		glDeleteShader(v.shaders[i]);
+		v.shaders[i] = 0;
+	}
+
+	if (linked)
+	{
+		v.state = Ready;
+		if (_setup != NULL)
+		{
+			GLint previous;
+			glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+			glUseProgram(v.program);
+			_setup(v.program);
+			glUseProgram(previous);
+		}
+	}
+	else
+	{
+		v.state = Failed;
+		GLint logSize;
+		glGetProgramiv(v.program, GL_INFO_LOG_LENGTH, &logSize);
+		vector<char> logMsg(logSize > 0 ? logSize : 1);
+		glGetProgramInfoLog(v.program, (GLsizei)logMsg.size(), NULL, &logMsg[0]);
+		cerr << "Shader variant (" << _vFile << ", " << _fFile << ") failed:\n"
+			 << v.defines << &logMsg[0] << endl;
+		glDeleteProgram(v.program);
+		v.program = 0;
+	}
+
+	_pendingCount--;
+}
+
+void ShaderManager::poll()
+{
+	if (_pendingCount == 0)
+		return;
+
+	for (size_t i = 0; i < _variants.size(); i++)
+	{
+		Variant& v = _variants[i];
+		if (v.state != Compiling)
+			continue;
+
+		if (_parallel)
+		{
+			GLint done = GL_FALSE;
+			glGetProgramiv(v.program, GL_COMPLETION_STATUS_KHR, &done);
+			if (done)
+				finish(v);
+		}
+		else
+		{
+			// no way to ask without waiting, so take the hit for one
+			// variant per frame
+			finish(v);
+			return;
+		}
+	}
+}
+
+bool ShaderManager::isReady( int variant ) const
+{
+	return variant >= 0 && variant < (int)_variants.size() && _variants[variant].state == Ready;
+}
+
+GLuint ShaderManager::program( int variant ) const
+{
+	return isReady(variant) ? _variants[variant].program : _fallback;
+}
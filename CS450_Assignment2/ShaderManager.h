@@ -0,0 +1,88 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- ShaderManager.h ---
+//
+//   Builds shader program variants from one vertex/fragment source pair by
+//   prepending #define permutations, and compiles them without blocking the
+//   main thread.  Where GL_KHR_parallel_shader_compile is available every
+//   variant is handed to the driver's compiler threads up front and polled
+//   with GL_COMPLETION_STATUS_KHR; otherwise one variant is finished per
+//   poll() so the cost is spread over several frames.  Until a variant has
+//   linked, program() hands back the fallback program.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SHADER_MANAGER_H__
+#define __SHADER_MANAGER_H__
+
+#include "Angel.h"
+#include <string>
+#include <vector>
+
+class ShaderManager {
+public:
+	// Passed to program() to ask for the fallback program explicitly
+	static const int Fallback = -1;
+
+	ShaderManager();
+	~ShaderManager();
+
+	void setSources( const char* vShaderFile, const char* fShaderFile );
+
+	// Program used for any variant that has not finished linking yet
+	void setFallback( GLuint program ) { _fallback = program; }
+
+	// Variants are linked with the same attribute locations as the fallback
+	// program so that existing VAOs work with all of them.
+	void bindAttribLocation( const char* name, GLuint location );
+
+	// Called once for each variant right after it links, e.g. to upload
+	// uniforms that never change.
+	void setProgramSetup( void (*setup)(GLuint program) ) { _setup = setup; }
+
+	// Queues a variant; returns the handle to pass to program()
+	int addVariant( const std::vector<std::string>& defines );
+
+	// Issues the compile and link of every queued variant without waiting
+	void compileAll();
+
+	// Picks up finished variants.  Never waits on the driver when parallel
+	// compilation is supported.
+	void poll();
+
+	bool isReady( int variant ) const;
+	bool pending() const { return _pendingCount > 0; }
+
+	// The variant's program if it has linked, the fallback otherwise
+	GLuint program( int variant ) const;
+
+private:
+	enum VariantState {
+		Queued = 0,
+		Compiling,
+		Ready,
+		Failed
+	};
+
+	struct Variant {
+		std::string		defines;
+		GLuint			program;
+		GLuint			shaders[2];
+		VariantState	state;
+	};
+
+	void submit( Variant& v );
+	void finish( Variant& v );
+
+	std::string		_vFile;
+	std::string		_fFile;
+	std::string		_sources[2];
+	std::vector<std::pair<std::string, GLuint> > _attribLocations;
+	std::vector<Variant> _variants;
+	GLuint			_fallback;
+	void			(*_setup)(GLuint program);
+	int				_pendingCount;
+	bool			_parallel;
+};
+
+#endif // __SHADER_MANAGER_H__
@@ -0,0 +1,570 @@
+#include "SoftwareRasterizer.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define RASTER_SSE 1
+#endif
+
+// Tiles are square; 64 pixels keeps a tile's color and depth in L2.  It
+// must stay a multiple of four, the width of the SIMD groups in a row.
+#define TILE_SIZE 64
+// Primitives one binning job sets up
+#define PRIMITIVES_PER_CHUNK 2048
+// Vertices one lighting job shades
+#define VERTICES_PER_JOB 1024
+// Vertices transformed together before lighting, in stack buffers
+#define VERTEX_BATCH 256
+
+// vshader.glsl's near-plane test in clip space: -w <= z
+static inline float nearDistance( const vec4& clip )
+{
+	return clip.z + clip.w;
+}
+
+static inline unsigned char toUnorm8( float value )
+{
+	if (value <= 0.0f)
+		return 0;
+	if (value >= 1.0f)
+		return 255;
+	return (unsigned char)(value * 255.0f + 0.5f);
+}
+
+SoftwareRasterizer::SoftwareRasterizer( int width, int height ) :
+	_width(width), _height(height),
+	_tilesX((width + TILE_SIZE - 1) / TILE_SIZE),
+	_tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+	_clearPending(true), _primitives(0),
+	_color(width * height * 4, 255),
+	_depth(width * height, 1.0f)
+{
+	_lighting.shininess = 1.0f;
+	_lighting.diffuse = true;
+	_lighting.specular = true;
+	_clearColor[0] = _clearColor[1] = _clearColor[2] = _clearColor[3] = 255;
+}
+
+void SoftwareRasterizer::clear( const vec4& color )
+{
+	_clearColor[0] = toUnorm8(color.x);
+	_clearColor[1] = toUnorm8(color.y);
+	_clearColor[2] = toUnorm8(color.z);
+	_clearColor[3] = toUnorm8(color.w);
+	_clearPending = true;
+	_draws.clear();
+}
+
+void SoftwareRasterizer::draw( Primitive primitive, const vec4* positions, const vec4* normals,
+							   int first, int count, const mat4& modelView, const mat3& normalMatrix,
+							   const vec4* flatColor )
+{
+	if (count <= 0)
+		return;
+
+	Draw draw;
+	draw.primitive = primitive;
+	draw.positions = positions;
+	draw.normals = normals;
+	draw.first = first;
+	draw.count = count;
+	draw.modelView = modelView;
+	draw.flat = (flatColor != NULL);
+	if (flatColor != NULL)
+		draw.flatColor = *flatColor;
+	else
+		draw.normalMatrix = mat4(vec4(normalMatrix[0], 0.0), vec4(normalMatrix[1], 0.0),
+								 vec4(normalMatrix[2], 0.0), vec4(0.0, 0.0, 0.0, 1.0));
+	draw.primitives = (primitive == Lines) ? count / 2 : count / 3;
+	_draws.push_back(draw);
+}
+
+//----------------------------------------------------------------------------
+
+void SoftwareRasterizer::render()
+{
+	int vertexCount = 0;
+	int primitiveCount = 0;
+	for (size_t i = 0; i < _draws.size(); i++)
+	{
+		_draws[i].firstVertex = vertexCount;
+		_draws[i].firstPrimitive = primitiveCount;
+		vertexCount += _draws[i].count;
+		primitiveCount += _draws[i].primitives;
+	}
+	_primitives = primitiveCount;
+	_vertices.resize(vertexCount);
+
+	{
+		PROFILE_SCOPE("sw vertex");
+		jobs.parallelFor(vertexCount, VERTICES_PER_JOB, [this](int begin, int end, int) {
+			// a job can span the end of one draw and the start of the next
+			size_t d = 0;
+			while (d + 1 < _draws.size() && _draws[d + 1].firstVertex <= begin)
+				d++;
+			while (begin < end)
+			{
+				const Draw& draw = _draws[d++];
+				int drawEnd = std::min(end, draw.firstVertex + draw.count);
+				shadeVertices(draw, begin, drawEnd);
+				begin = drawEnd;
+			}
+		});
+	}
+
+	int chunkCount = (primitiveCount + PRIMITIVES_PER_CHUNK - 1) / PRIMITIVES_PER_CHUNK;
+	if ((int)_chunks.size() < chunkCount)
+		_chunks.resize(chunkCount);
+
+	{
+		PROFILE_SCOPE("sw bin");
+		jobs.parallelFor(chunkCount, 1, [this, primitiveCount](int begin, int end, int) {
+			for (int c = begin; c < end; c++)
+			{
+				BinChunk& chunk = _chunks[c];
+				chunk.primitives.clear();
+				chunk.tiles.resize(_tilesX * _tilesY);
+				for (size_t t = 0; t < chunk.tiles.size(); t++)
+					chunk.tiles[t].clear();
+
+				int first = c * PRIMITIVES_PER_CHUNK;
+				setupPrimitives(first, std::min(first + PRIMITIVES_PER_CHUNK, primitiveCount), chunk);
+			}
+		});
+	}
+	// chunks past chunkCount are left over from bigger frames
+	for (size_t c = chunkCount; c < _chunks.size(); c++)
+		_chunks[c].primitives.clear();
+
+	{
+		PROFILE_SCOPE("sw raster");
+		jobs.parallelFor(_tilesX * _tilesY, 1, [this](int begin, int end, int) {
+			for (int tile = begin; tile < end; tile++)
+				rasterizeTile(tile);
+		});
+	}
+
+	_clearPending = false;
+	_draws.clear();
+}
+
+//----------------------------------------------------------------------------
+//
+//  Vertex stage: vshader.glsl on the CPU
+//
+
+void SoftwareRasterizer::shadeVertices( const Draw& draw, int begin, int end )
+{
+	const mat4& mv = draw.modelView;
+	vec4 lightEye = mv * _lighting.lightPosition;
+
+	vec4 eyes[VERTEX_BATCH], clips[VERTEX_BATCH], normals[VERTEX_BATCH];
+	for (int batch = begin; batch < end; batch += VERTEX_BATCH)
+	{
+		int count = std::min(VERTEX_BATCH, end - batch);
+		int source = draw.first + (batch - draw.firstVertex);
+
+		transformPoints(mv, _projection, draw.positions + source, eyes, clips, count);
+		if (!draw.flat)
+			transformNormals(draw.normalMatrix, draw.normals + source, normals, count);
+
+		for (int k = 0; k < count; k++)
+		{
+			ShadedVertex& out = _vertices[batch + k];
+			out.clip = clips[k];
+
+			if (draw.flat)
+			{
+				out.color = draw.flatColor;
+				continue;
+			}
+
+			vec3 pos(eyes[k].x, eyes[k].y, eyes[k].z);
+			vec3 L = normalize(vec3(lightEye.x, lightEye.y, lightEye.z) - pos);
+			vec3 E = normalize(-pos);
+			vec3 H = normalize(L + E);
+			vec3 N(normals[k].x, normals[k].y, normals[k].z);
+
+			vec4 color = _lighting.ambientProduct;
+			float LdotN = dot(L, N);
+			if (_lighting.diffuse)
+				color += std::max(LdotN, 0.0f) * _lighting.diffuseProduct;
+			// the shader's specular for a back-facing light only carries
+			// alpha, which is overwritten below
+			if (_lighting.specular && LdotN >= 0.0f)
+				color += powf(std::max(dot(N, H), 0.0f), _lighting.shininess) * _lighting.specularProduct;
+			color.w = 1.0f;
+			out.color = color;
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+//
+//  Primitive setup and binning
+//
+
+SoftwareRasterizer::ScreenVertex SoftwareRasterizer::toScreen( const ShadedVertex& v ) const
+{
+	ScreenVertex s;
+	s.invW = 1.0f / v.clip.w;
+	s.x = (v.clip.x * s.invW * 0.5f + 0.5f) * _width;
+	s.y = (v.clip.y * s.invW * 0.5f + 0.5f) * _height;
+	s.z = v.clip.z * s.invW * 0.5f + 0.5f;
+	s.colorOverW = v.color * s.invW;
+	return s;
+}
+
+void SoftwareRasterizer::setupPrimitives( int begin, int end, BinChunk& chunk )
+{
+	size_t d = 0;
+	while (d + 1 < _draws.size() && _draws[d + 1].firstPrimitive <= begin)
+		d++;
+
+	for (int p = begin; p < end; p++)
+	{
+		while (p >= _draws[d].firstPrimitive + _draws[d].primitives)
+			d++;
+		const Draw& draw = _draws[d];
+		int local = p - draw.firstPrimitive;
+
+		ShadedVertex in[3];
+		int corners = (draw.primitive == Lines) ? 2 : 3;
+		for (int i = 0; i < corners; i++)
+			in[i] = _vertices[draw.firstVertex + local * corners + i];
+
+		// clip against the near plane only; the others are handled by the
+		// pixel bounds and the depth test
+		ShadedVertex clipped[4];
+		int count = 0;
+		for (int i = 0; i < corners; i++)
+		{
+			const ShadedVertex& a = in[i];
+			const ShadedVertex& b = in[(i + 1) % corners];
+			float da = nearDistance(a.clip);
+			float db = nearDistance(b.clip);
+
+			if (da >= 0.0f)
+				clipped[count++] = a;
+			// a line has one edge, not a closing one back to its start
+			if (corners == 2 && i == 1)
+				break;
+			if ((da >= 0.0f) != (db >= 0.0f))
+			{
+				float t = da / (da - db);
+				clipped[count].clip = a.clip + t * (b.clip - a.clip);
+				clipped[count].color = a.color + t * (b.color - a.color);
+				count++;
+			}
+		}
+
+		ScreenVertex screen[4];
+		for (int i = 0; i < count; i++)
+			screen[i] = toScreen(clipped[i]);
+
+		switch (draw.primitive)
+		{
+		case Triangles:
+			for (int i = 2; i < count; i++)
+				emitTriangle(screen[0], screen[i - 1], screen[i], chunk);
+			break;
+
+		case Wireframe:
+			if (count >= 3)
+				for (int i = 0; i < count; i++)
+					emitLine(screen[i], screen[(i + 1) % count], chunk);
+			break;
+
+		case Lines:
+			if (count == 2)
+				emitLine(screen[0], screen[1], chunk);
+			break;
+		}
+	}
+}
+
+void SoftwareRasterizer::emitTriangle( ScreenVertex a, ScreenVertex b, ScreenVertex c, BinChunk& chunk )
+{
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area == 0.0f)
+		return;
+	// nothing is culled, so make every triangle counter-clockwise
+	if (area < 0.0f)
+		std::swap(b, c);
+
+	ScreenPrimitive tri;
+	tri.v[0] = a;
+	tri.v[1] = b;
+	tri.v[2] = c;
+	tri.line = false;
+	tri.minX = std::max(0, (int)floorf(std::min(a.x, std::min(b.x, c.x))));
+	tri.minY = std::max(0, (int)floorf(std::min(a.y, std::min(b.y, c.y))));
+	tri.maxX = std::min(_width - 1, (int)floorf(std::max(a.x, std::max(b.x, c.x))));
+	tri.maxY = std::min(_height - 1, (int)floorf(std::max(a.y, std::max(b.y, c.y))));
+	binPrimitive(tri, chunk);
+}
+
+void SoftwareRasterizer::emitLine( const ScreenVertex& a, const ScreenVertex& b, BinChunk& chunk )
+{
+	ScreenPrimitive line;
+	line.v[0] = a;
+	line.v[1] = b;
+	line.line = true;
+	line.minX = std::max(0, (int)floorf(std::min(a.x, b.x)));
+	line.minY = std::max(0, (int)floorf(std::min(a.y, b.y)));
+	line.maxX = std::min(_width - 1, (int)floorf(std::max(a.x, b.x)));
+	line.maxY = std::min(_height - 1, (int)floorf(std::max(a.y, b.y)));
+	binPrimitive(line, chunk);
+}
+
+void SoftwareRasterizer::binPrimitive( const ScreenPrimitive& primitive, BinChunk& chunk )
+{
+	if (primitive.minX > primitive.maxX || primitive.minY > primitive.maxY)
+		return;
+
+	int index = (int)chunk.primitives.size();
+	chunk.primitives.push_back(primitive);
+
+	for (int ty = primitive.minY / TILE_SIZE; ty <= primitive.maxY / TILE_SIZE; ty++)
+		for (int tx = primitive.minX / TILE_SIZE; tx <= primitive.maxX / TILE_SIZE; tx++)
+			chunk.tiles[ty * _tilesX + tx].push_back(index);
+}
+
+//----------------------------------------------------------------------------
+//
+//  Rasterization
+//
+
+void SoftwareRasterizer::rasterizeTile( int tile )
+{
+	int x0 = (tile % _tilesX) * TILE_SIZE;
+	int y0 = (tile / _tilesX) * TILE_SIZE;
+	int x1 = std::min(x0 + TILE_SIZE, _width) - 1;
+	int y1 = std::min(y0 + TILE_SIZE, _height) - 1;
+
+	if (_clearPending)
+	{
+		for (int y = y0; y <= y1; y++)
+		{
+			std::fill(&_depth[y * _width + x0], &_depth[y * _width + x1] + 1, 1.0f);
+			unsigned char* row = &_color[(y * _width + x0) * 4];
+			for (int x = x0; x <= x1; x++, row += 4)
+				memcpy(row, _clearColor, 4);
+		}
+	}
+
+	// chunks in order keep each tile's primitives in submission order
+	for (size_t c = 0; c < _chunks.size(); c++)
+	{
+		const BinChunk& chunk = _chunks[c];
+		if (chunk.primitives.empty())
+			continue;
+
+		const std::vector<int>& bin = chunk.tiles[tile];
+		for (size_t i = 0; i < bin.size(); i++)
+		{
+			const ScreenPrimitive& primitive = chunk.primitives[bin[i]];
+			int bx0 = std::max(x0, primitive.minX);
+			int by0 = std::max(y0, primitive.minY);
+			int bx1 = std::min(x1, primitive.maxX);
+			int by1 = std::min(y1, primitive.maxY);
+
+			if (primitive.line)
+				rasterizeLine(primitive, bx0, by0, bx1, by1);
+			else
+				rasterizeTriangle(primitive, bx0, by0, bx1, by1);
+		}
+	}
+}
+
+// Depth test GL_LESS, then write the clamped color
+inline void SoftwareRasterizer::writePixel( int index, float z, const vec4& color )
+{
+	if (!(z < _depth[index]) || z < 0.0f)
+		return;
+	_depth[index] = z;
+
+	unsigned char* out = &_color[index * 4];
+	out[0] = toUnorm8(color.x);
+	out[1] = toUnorm8(color.y);
+	out[2] = toUnorm8(color.z);
+	out[3] = toUnorm8(color.w);
+}
+
+// Color at a pixel from its (unnormalized) barycentric weights, interpolated
+// in clip space like a GLSL smooth varying
+inline vec4 SoftwareRasterizer::perspectiveColor( const ScreenPrimitive& tri, float w0, float w1, float w2 )
+{
+	vec4 sum = w0 * tri.v[0].colorOverW + w1 * tri.v[1].colorOverW + w2 * tri.v[2].colorOverW;
+	return sum / (w0 * tri.v[0].invW + w1 * tri.v[1].invW + w2 * tri.v[2].invW);
+}
+
+void SoftwareRasterizer::rasterizeTriangle( const ScreenPrimitive& tri, int x0, int y0, int x1, int y1 )
+{
+	const ScreenVertex& a = tri.v[0];
+	const ScreenVertex& b = tri.v[1];
+	const ScreenVertex& c = tri.v[2];
+
+	// edge functions E(p) = A*px + B*py + C, positive inside; edge i is the
+	// one opposite vertex i, so E_i/area is vertex i's barycentric weight
+	float A[3] = { b.y - c.y, c.y - a.y, a.y - b.y };
+	float B[3] = { c.x - b.x, a.x - c.x, b.x - a.x };
+	float C[3] = { -(A[0] * b.x + B[0] * b.y), -(A[1] * c.x + B[1] * c.y), -(A[2] * a.x + B[2] * a.y) };
+	float area = A[2] * c.x + B[2] * c.y + C[2];
+
+	// top-left rule: pixels exactly on an edge belong to the triangle on its
+	// top or left side, so shared edges are drawn once
+	bool topLeft[3];
+	for (int e = 0; e < 3; e++)
+		topLeft[e] = (A[e] > 0.0f) || (A[e] == 0.0f && B[e] < 0.0f);
+
+	float invArea = 1.0f / area;
+	float z[3] = { a.z, b.z, c.z };
+
+#ifdef RASTER_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	__m128 edgeA[3], topLeftMask[3];
+	for (int e = 0; e < 3; e++)
+	{
+		edgeA[e] = _mm_set1_ps(A[e]);
+		topLeftMask[e] = _mm_castsi128_ps(_mm_set1_epi32(topLeft[e] ? -1 : 0));
+	}
+
+	// groups of four start on a multiple of four columns, as tiles do, so a
+	// group never reaches into a neighbouring tile whose worker may be
+	// writing its depth
+	int groupX0 = x0 & ~3;
+
+	for (int y = y0; y <= y1; y++)
+	{
+		float py = y + 0.5f;
+		for (int x = groupX0; x <= x1; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+			__m128 w[3];
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int e = 0; e < 3; e++)
+			{
+				w[e] = _mm_add_ps(_mm_mul_ps(edgeA[e], px), _mm_set1_ps(B[e] * py + C[e]));
+				__m128 edgeInside = _mm_or_ps(_mm_cmpgt_ps(w[e], zero),
+											  _mm_and_ps(_mm_cmpeq_ps(w[e], zero), topLeftMask[e]));
+				inside = _mm_and_ps(inside, edgeInside);
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			if (x < x0)
+				mask &= 0xf << (x0 - x);
+			if (x1 - x < 3)
+				mask &= (1 << (x1 - x + 1)) - 1;
+			if (mask == 0)
+				continue;
+
+			// depth is affine in screen space, so test all four lanes at once
+			__m128 depth = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(w[0], _mm_set1_ps(z[0])), _mm_mul_ps(w[1], _mm_set1_ps(z[1]))),
+				_mm_mul_ps(w[2], _mm_set1_ps(z[2]))), _mm_set1_ps(invArea));
+			__m128 stored;
+			if (x + 4 <= _width)
+				stored = _mm_loadu_ps(&_depth[y * _width + x]);
+			else
+			{
+				// past the right edge of the image is the next row, which
+				// belongs to another tile
+				float edge[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+				for (int lane = 0; x + lane < _width; lane++)
+					edge[lane] = _depth[y * _width + x + lane];
+				stored = _mm_loadu_ps(edge);
+			}
+			mask &= _mm_movemask_ps(_mm_cmplt_ps(depth, stored));
+			if (mask == 0)
+				continue;
+
+			float wl[3][4], zl[4];
+			for (int e = 0; e < 3; e++)
+				_mm_storeu_ps(wl[e], w[e]);
+			_mm_storeu_ps(zl, depth);
+
+			for (int lane = 0; lane < 4; lane++)
+			{
+				if (!(mask & (1 << lane)))
+					continue;
+				writePixel(y * _width + x + lane, zl[lane],
+						   perspectiveColor(tri, wl[0][lane], wl[1][lane], wl[2][lane]));
+			}
+		}
+	}
+#else
+	for (int y = y0; y <= y1; y++)
+	{
+		float py = y + 0.5f;
+		for (int x = x0; x <= x1; x++)
+		{
+			float px = x + 0.5f;
+			float w[3];
+			bool inside = true;
+			for (int e = 0; e < 3 && inside; e++)
+			{
+				w[e] = A[e] * px + B[e] * py + C[e];
+				inside = w[e] > 0.0f || (w[e] == 0.0f && topLeft[e]);
+			}
+			if (!inside)
+				continue;
+
+			float depth = (w[0] * z[0] + w[1] * z[1] + w[2] * z[2]) * invArea;
+			writePixel(y * _width + x, depth, perspectiveColor(tri, w[0], w[1], w[2]));
+		}
+	}
+#endif
+}
+
+void SoftwareRasterizer::rasterizeLine( const ScreenPrimitive& line, int x0, int y0, int x1, int y1 )
+{
+	const ScreenVertex& a = line.v[0];
+	const ScreenVertex& b = line.v[1];
+	float dx = b.x - a.x;
+	float dy = b.y - a.y;
+	int steps = std::max(1, (int)ceilf(std::max(fabsf(dx), fabsf(dy))));
+
+	for (int i = 0; i <= steps; i++)
+	{
+		float t = (float)i / steps;
+		int x = (int)floorf(a.x + t * dx);
+		int y = (int)floorf(a.y + t * dy);
+		if (x < x0 || x > x1 || y < y0 || y > y1)
+			continue;
+
+		float invW = a.invW + t * (b.invW - a.invW);
+		vec4 color = (a.colorOverW + t * (b.colorOverW - a.colorOverW)) / invW;
+		writePixel(y * _width + x, a.z + t * (b.z - a.z), color);
+	}
+}
+
+//----------------------------------------------------------------------------
+
+bool writePPM( const char* path, const unsigned char* rgba, int width, int height )
+{
+	FILE* fp = fopen(path, "wb");
+	if (fp == NULL)
+		return false;
+
+	fprintf(fp, "P6\n%d %d\n255\n", width, height);
+	std::vector<unsigned char> row(width * 3);
+	for (int y = height - 1; y >= 0; y--)
+	{
+		const unsigned char* in = &rgba[y * width * 4];
+		for (int x = 0; x < width; x++)
+		{
+			row[x * 3 + 0] = in[x * 4 + 0];
+			row[x * 3 + 1] = in[x * 4 + 1];
+			row[x * 3 + 2] = in[x * 4 + 2];
+		}
+		fwrite(&row[0], 1, row.size(), fp);
+	}
+
+	return fclose(fp) == 0;
+}
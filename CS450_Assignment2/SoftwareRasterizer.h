@@ -0,0 +1,147 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- SoftwareRasterizer.h ---
+//
+//   A CPU renderer for the viewer's scenes.  Draws take the same vertex
+//   arrays, model-view matrices and lighting products as the GL path; they
+//   are queued and then rendered in three parallel passes on the JobSystem:
+//   vertex lighting (as in vshader.glsl), setup and binning of primitives
+//   into screen tiles, and per-tile rasterization against a depth buffer.
+//
+//   The color buffer is RGBA8 with row 0 at the bottom, like glReadPixels.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __SOFTWARE_RASTERIZER_H__
+#define __SOFTWARE_RASTERIZER_H__
+
+#include "Angel.h"
+#include <vector>
+
+// The uniforms vshader.glsl lights with
+struct LightingParams {
+	vec4	ambientProduct;
+	vec4	diffuseProduct;
+	vec4	specularProduct;
+	vec4	lightPosition;
+	float	shininess;
+	bool	diffuse;		// false for LIGHTING_AMBIENT
+	bool	specular;		// false for LIGHTING_AMBIENT and LIGHTING_DIFFUSE
+};
+
+// Writes a bottom-up RGBA8 image as a binary PPM, top row first
+bool writePPM( const char* path, const unsigned char* rgba, int width, int height );
+
+class SoftwareRasterizer {
+public:
+	enum Primitive {
+		Triangles = 0,
+		Lines,
+		Wireframe		// triangles drawn as their edges
+	};
+
+	SoftwareRasterizer( int width, int height );
+
+	int width() const { return _width; }
+	int height() const { return _height; }
+
+	void setProjection( const mat4& projection ) { _projection = projection; }
+	void setLighting( const LightingParams& lighting ) { _lighting = lighting; }
+
+	// Drops queued draws and fills the buffers on the next render()
+	void clear( const vec4& color );
+
+	// Queues count vertices from first.  normalMatrix is the NormalMatrix
+	// uniform for modelView.  A non-NULL flatColor replaces the lighting,
+	// like fshader.glsl's colorID.  The arrays must stay alive until
+	// render() returns.
+	void draw( Primitive primitive, const vec4* positions, const vec4* normals,
+			   int first, int count, const mat4& modelView, const mat3& normalMatrix,
+			   const vec4* flatColor = NULL );
+
+	// Renders the queued draws
+	void render();
+
+	int drawCount() const { return (int)_draws.size(); }
+	long primitiveCount() const { return _primitives; }
+
+	const unsigned char* colorBuffer() const { return &_color[0]; }
+	const float* depthBuffer() const { return &_depth[0]; }
+
+	bool writePPM( const char* path ) const { return ::writePPM(path, &_color[0], _width, _height); }
+
+private:
+	struct Draw {
+		Primitive		primitive;
+		const vec4*		positions;
+		const vec4*		normals;
+		int				first;
+		int				count;
+		mat4			modelView;
+		mat4			normalMatrix;	// the caller's normal matrix in the upper 3x3
+		bool			flat;
+		vec4			flatColor;
+		int				firstVertex;	// into _vertices
+		int				firstPrimitive;	// over all draws
+		int				primitives;
+	};
+
+	// post-vertex-shader attributes
+	struct ShadedVertex {
+		vec4	clip;
+		vec4	color;
+	};
+
+	// a primitive after clipping, in window coordinates; color is divided
+	// by w for perspective-correct interpolation
+	struct ScreenVertex {
+		float	x, y, z, invW;
+		vec4	colorOverW;
+	};
+
+	struct ScreenPrimitive {
+		ScreenVertex	v[3];
+		bool			line;
+		int				minX, minY, maxX, maxY;		// pixel bounds, inclusive
+	};
+
+	// one bin set per chunk of primitives, so binning needs no locks and
+	// tiles still draw in submission order
+	struct BinChunk {
+		std::vector<ScreenPrimitive>	primitives;
+		std::vector<std::vector<int> >	tiles;
+	};
+
+	void shadeVertices( const Draw& draw, int begin, int end );
+	void setupPrimitives( int begin, int end, BinChunk& chunk );
+	void emitTriangle( ScreenVertex a, ScreenVertex b, ScreenVertex c, BinChunk& chunk );
+	void emitLine( const ScreenVertex& a, const ScreenVertex& b, BinChunk& chunk );
+	void binPrimitive( const ScreenPrimitive& primitive, BinChunk& chunk );
+	void rasterizeTile( int tile );
+	void rasterizeTriangle( const ScreenPrimitive& tri, int x0, int y0, int x1, int y1 );
+	void rasterizeLine( const ScreenPrimitive& line, int x0, int y0, int x1, int y1 );
+	void writePixel( int index, float z, const vec4& color );
+	static vec4 perspectiveColor( const ScreenPrimitive& tri, float w0, float w1, float w2 );
+	ScreenVertex toScreen( const ShadedVertex& v ) const;
+
+	int							_width;
+	int							_height;
+	int							_tilesX;
+	int							_tilesY;
+
+	mat4						_projection;
+	LightingParams				_lighting;
+
+	bool						_clearPending;
+	unsigned char				_clearColor[4];
+
+	std::vector<Draw>			_draws;
+	std::vector<ShadedVertex>	_vertices;
+	std::vector<BinChunk>		_chunks;
+	long						_primitives;
+
+	std::vector<unsigned char>	_color;
+	std::vector<float>			_depth;
+};
+
+#endif // __SOFTWARE_RASTERIZER_H__
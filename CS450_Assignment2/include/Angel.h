@@ -57,15 +57,33 @@ GLuint InitShader( const char* vertexShaderFile,
 //  Defined constant for when numbers are too small to be used in the
 //    denominator of a division operation.  This is only used if the
 //    DEBUG macro is defined.
-const GLfloat  DivideByZeroTolerance = GLfloat(1.0e-07);
+constexpr GLfloat  DivideByZeroTolerance = GLfloat(1.0e-07);
 
 //  Degrees-to-radians constant 
-const GLfloat  DegreesToRadians = M_PI / 180.0;
+constexpr GLfloat  DegreesToRadians = M_PI / 180.0;
 
 }  // namespace Angel
 
+//  True while a constexpr function is being evaluated at compile time,
+//    where it can't use pointer arithmetic over members, type punning or
+//    SIMD intrinsics.  Compilers without the builtin always take the
+//    compile-time paths, which give the same results, only slower.
+#if !defined(ANGEL_CONSTANT_EVALUATED) && defined(__has_builtin)
+#  if __has_builtin(__builtin_is_constant_evaluated)
+#    define ANGEL_CONSTANT_EVALUATED()  __builtin_is_constant_evaluated()
+#  endif
+#endif
+#if !defined(ANGEL_CONSTANT_EVALUATED) && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 9
+#  define ANGEL_CONSTANT_EVALUATED()  __builtin_is_constant_evaluated()
+#endif
+#ifndef ANGEL_CONSTANT_EVALUATED
+#  define ANGEL_CONSTANT_EVALUATED()  true
+#endif
+
+#include "half.h"
 #include "vec.h"
 #include "mat.h"
+#include "quat.h"
 #include "CheckError.h"
 
 #define Print(x)  do { std::cerr << #x " = " << (x) << std::endl; } while(0)
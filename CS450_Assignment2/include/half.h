@@ -0,0 +1,155 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- half.h ---
+//
+//   IEEE binary16 storage for the vector templates in vec.h: half the size
+//   of a float, for bulk data that doesn't need the precision.  It is a
+//   storage type only; arithmetic converts to float and rounds back, to
+//   nearest even, when the result is stored.  Conversions are constexpr,
+//   so tables of halves can be built at compile time.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_HALF_H__
+#define __ANGEL_HALF_H__
+
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+
+namespace Angel {
+
+struct half {
+
+    uint16_t  bits;
+
+    //
+    //  --- Constructors and Destructors ---
+    //
+
+    constexpr half() :
+	bits(0) {}
+
+    constexpr half( const float f ) :
+	bits( ANGEL_CONSTANT_EVALUATED() ? constantBits(f) : floatBits(f) ) {}
+
+    static constexpr half fromBits( const uint16_t b )
+	{ half h;  h.bits = b;  return h; }
+
+    //
+    //  --- Conversion Operators ---
+    //
+
+    constexpr operator float () const
+	{ return ANGEL_CONSTANT_EVALUATED() ? constantValue(bits) : floatValue(bits); }
+
+   private:
+    //
+    //  Run-time conversions, on the float's bits
+    //
+
+    static uint16_t floatBits( const float f ) {
+	uint32_t u;
+	std::memcpy( &u, &f, sizeof(u) );
+	uint16_t sign = (u >> 16) & 0x8000;
+	uint32_t a = u & 0x7fffffff;
+
+	if ( a >= 0x7f800000 )				// infinity or NaN
+	    return sign | 0x7c00 | (a > 0x7f800000 ? 0x200 : 0);
+	if ( a >= 0x477ff000 )				// rounds past 65504
+	    return sign | 0x7c00;
+	if ( a <= 0x33000000 )				// rounds to zero
+	    return sign;
+
+	uint32_t rest, halfway, h;
+	if ( a < 0x38800000 ) {				// subnormal
+	    int shift = 126 - int(a >> 23);
+	    uint32_t m = (a & 0x7fffff) | 0x800000;
+	    h = m >> shift;
+	    rest = m & ((1u << shift) - 1);
+	    halfway = 1u << (shift - 1);
+	}
+	else {
+	    h = (a >> 13) - (112 << 10);
+	    rest = a & 0x1fff;
+	    halfway = 0x1000;
+	}
+	// a carry out of the mantissa moves up the exponent, as it should
+	if ( rest > halfway || (rest == halfway && (h & 1)) )
+	    ++h;
+	return sign | uint16_t(h);
+    }
+
+    static float floatValue( const uint16_t h ) {
+	uint32_t sign = uint32_t(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+
+	uint32_t u;
+	if ( exponent == 0 ) {				// zero or subnormal
+	    float f = mantissa * (1.0f / 16777216.0f);
+	    return sign ? -f : f;
+	}
+	if ( exponent == 31 )
+	    u = sign | 0x7f800000 | (mantissa << 13);
+	else
+	    u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+	float f;
+	std::memcpy( &f, &u, sizeof(f) );
+	return f;
+    }
+
+    //
+    //  The same conversions in arithmetic, for compile time, where a
+    //  float's bits can't be read.  A negative zero comes out positive.
+    //
+
+    static constexpr uint16_t constantBits( const float f ) {
+	if ( f != f )
+	    return 0x7e00;
+
+	uint16_t sign = f < 0.0f ? 0x8000 : 0;
+	float a = f < 0.0f ? -f : f;
+	if ( a >= 65520.0f )
+	    return sign | 0x7c00;
+
+	float scaled = 0.0f;
+	int exponent = 0;
+	if ( a < 1.0f / 16384.0f )
+	    scaled = a * 16777216.0f;			// in units of the smallest subnormal
+	else {
+	    while ( a >= 2.0f ) { a *= 0.5f;  ++exponent; }
+	    while ( a < 1.0f ) { a *= 2.0f;  --exponent; }
+	    scaled = (a - 1.0f) * 1024.0f;
+	    exponent += 15;
+	}
+
+	uint32_t h = uint32_t(scaled);
+	float rest = scaled - float(h);
+	if ( rest > 0.5f || (rest == 0.5f && (h & 1)) )
+	    ++h;
+	return sign | uint16_t((uint32_t(exponent) << 10) + h);
+    }
+
+    static constexpr float constantValue( const uint16_t h ) {
+	float sign = h & 0x8000 ? -1.0f : 1.0f;
+	int exponent = (h >> 10) & 0x1f;
+	float mantissa = float(h & 0x3ff);
+
+	if ( exponent == 0 )
+	    return sign * mantissa * (1.0f / 16777216.0f);
+	if ( exponent == 31 )
+	    return mantissa != 0.0f ? std::numeric_limits<float>::quiet_NaN()
+				    : sign * std::numeric_limits<float>::infinity();
+
+	float f = 1.0f + mantissa * (1.0f / 1024.0f);
+	for ( ; exponent > 15; --exponent ) f *= 2.0f;
+	for ( ; exponent < 15; ++exponent ) f *= 0.5f;
+	return sign * f;
+    }
+};
+
+}  // namespace Angel
+
+#endif // __ANGEL_HALF_H__
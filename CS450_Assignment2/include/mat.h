@@ -2,268 +2,174 @@
 //
 //  --- mat.h ---
 //
+//   tmat<N, T> is an N x N matrix of tvec<N, T> rows; mat2, mat3 and mat4
+//   are the float ones and dmat the double ones.  Like the vectors, the
+//   arithmetic is constexpr, so constant matrices can be built at compile
+//   time.  At run time the float mat4 products, transpose and inverse go
+//   through the kernels in simd.h.
+//
 //////////////////////////////////////////////////////////////////////////////
 
 #ifndef __ANGEL_MAT_H__
 #define __ANGEL_MAT_H__
 
 #include "vec.h"
+#include <type_traits>
 
 namespace Angel {
 
 //----------------------------------------------------------------------------
 //
-//  mat2 - 2D square matrix
+//  tmat_kernels - the simd.h kernels for the matrices that have them.
+//    The rest get stubs that are never called, since available is 0.
 //
 
-class mat2 {
-
-    vec2  _m[2];
-
-   public:
-    //
-    //  --- Constructors and Destructors ---
-    //
-
-    mat2( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
-	{ _m[0].x = d;  _m[1].y = d;   }
-
-    mat2( const vec2& a, const vec2& b )
-	{ _m[0] = a;  _m[1] = b;  }
-
-    mat2( GLfloat m00, GLfloat m10, GLfloat m01, GLfloat m11 )
-	{ _m[0] = vec2( m00, m01 ); _m[1] = vec2( m10, m11 ); }
-
-    mat2( const mat2& m ) {
-	if ( *this != m ) {
-	    _m[0] = m._m[0];
-	    _m[1] = m._m[1];
-	} 
-    }
-
-    //
-    //  --- Indexing Operator ---
-    //
-
-    vec2& operator [] ( int i ) { return _m[i]; }
-    const vec2& operator [] ( int i ) const { return _m[i]; }
-
-    //
-    //  --- (non-modifying) Arithmatic Operators ---
-    //
-
-    mat2 operator + ( const mat2& m ) const
-	{ return mat2( _m[0]+m[0], _m[1]+m[1] ); }
-
-    mat2 operator - ( const mat2& m ) const
-	{ return mat2( _m[0]-m[0], _m[1]-m[1] ); }
-
-    mat2 operator * ( const GLfloat s ) const 
-	{ return mat2( s*_m[0], s*_m[1] ); }
-
-    mat2 operator / ( const GLfloat s ) const {
-#ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
-	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
-		      << "Division by zero" << std::endl;
-	    return mat2();
-	}
-#endif // DEBUG
-	
-	GLfloat r = GLfloat(1.0) / s;
-	return *this * r;
-    }
-
-    friend mat2 operator * ( const GLfloat s, const mat2& m )
-	{ return m * s; }
-	
-    mat2 operator * ( const mat2& m ) const {
-	mat2  a( 0.0 );
-
-	for ( int i = 0; i < 2; ++i ) {
-	    for ( int j = 0; j < 2; ++j ) {
-		for ( int k = 0; k < 2; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
-
-	return a;
-    }
-
-    //
-    //  --- (modifying) Arithmetic Operators ---
-    //
-
-    mat2& operator += ( const mat2& m ) {
-	_m[0] += m[0];  _m[1] += m[1];  
-	return *this;
-    }
-
-    mat2& operator -= ( const mat2& m ) {
-	_m[0] -= m[0];  _m[1] -= m[1];  
-	return *this;
-    }
-
-    mat2& operator *= ( const GLfloat s ) {
-	_m[0] *= s;  _m[1] *= s;   
-	return *this;
-    }
-
-    mat2& operator *= ( const mat2& m ) {
-	mat2  a( 0.0 );
-
-	for ( int i = 0; i < 2; ++i ) {
-	    for ( int j = 0; j < 2; ++j ) {
-		for ( int k = 0; k < 2; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
+template <int N, typename T>
+struct tmat_kernels {
+    enum { available = 0 };
 
-        return 	*this = a;
-    }
-    
-    mat2& operator /= ( const GLfloat s ) {
-#ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
-	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
-		      << "Division by zero" << std::endl;
-	    return mat2();
-	}
-#endif // DEBUG
-
-	GLfloat r = GLfloat(1.0) / s;
-	return *this *= r;
-    }
-
-    //
-    //  --- Matrix / Vector operators ---
-    //
-
-    vec2 operator * ( const vec2& v ) const {  // m * v
-	return vec2( _m[0][0]*v.x + _m[0][1]*v.y,
-		     _m[1][0]*v.x + _m[1][1]*v.y );
-    }
-	
-    //
-    //  --- Insertion and Extraction Operators ---
-    //
-	
-    friend std::ostream& operator << ( std::ostream& os, const mat2& m )
-	{ return os << std::endl << m[0] << std::endl << m[1] << std::endl; }
-
-    friend std::istream& operator >> ( std::istream& is, mat2& m )
-	{ return is >> m._m[0] >> m._m[1] ; }
-
-    //
-    //  --- Conversion Operators ---
-    //
-
-    operator const GLfloat* () const
-	{ return static_cast<const GLfloat*>( &_m[0].x ); }
-
-    operator GLfloat* ()
-	{ return static_cast<GLfloat*>( &_m[0].x ); }
+    static void multiply( const T*, const T*, T* ) {}
+    static void multiplyVector( const T*, const T*, T* ) {}
+    static void transpose( const T*, T* ) {}
+    static T inverse( const T*, T* ) { return T(); }
 };
 
-//
-//  --- Non-class mat2 Methods ---
-//
-
-inline
-mat2 matrixCompMult( const mat2& A, const mat2& B ) {
-    return mat2( A[0][0]*B[0][0], A[0][1]*B[0][1],
-		 A[1][0]*B[1][0], A[1][1]*B[1][1] );
-}
-
-inline
-mat2 transpose( const mat2& A ) {
-    return mat2( A[0][0], A[1][0],
-		 A[0][1], A[1][1] );
-}
+#ifdef ANGEL_SIMD
+template <>
+struct tmat_kernels<4, GLfloat> {
+    enum { available = 1 };
+
+    static void multiply( const GLfloat* a, const GLfloat* b, GLfloat* out )
+	{ simd::multiply( a, b, out ); }
+    static void multiplyVector( const GLfloat* m, const GLfloat* v, GLfloat* out )
+	{ simd::multiplyVector( m, v, out ); }
+    static void transpose( const GLfloat* m, GLfloat* out )
+	{ simd::transpose( m, out ); }
+    static GLfloat inverse( const GLfloat* m, GLfloat* out )
+	{ return simd::inverse( m, out ); }
+};
+#endif
 
 //----------------------------------------------------------------------------
 //
-//  mat3 - 3D square matrix 
+//  tmat<N, T> - N x N square matrix
 //
 
-class mat3 {
+template <int N, typename T>
+class tmat {
 
-    vec3  _m[3];
+    typedef tvec<N, T>         V;
+    typedef tmat_kernels<N, T> kernels;
+
+    V  _m[N];
 
    public:
     //
     //  --- Constructors and Destructors ---
     //
 
-    mat3( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
-	{ _m[0].x = d;  _m[1].y = d;  _m[2].z = d;   }
+    constexpr tmat( const T d = scalar_traits<T>::one() ) :  // Create a diagional matrix
+	_m() { for ( int i = 0; i < N; ++i ) _m[i][i] = d; }
+
+    template <int M = N, typename = typename std::enable_if<M == 2>::type>
+    constexpr tmat( const V& a, const V& b ) :
+	_m() { _m[0] = a;  _m[1] = b;  }
 
-    mat3( const vec3& a, const vec3& b, const vec3& c )
-	{ _m[0] = a;  _m[1] = b;  _m[2] = c;  }
+    template <int M = N, typename = typename std::enable_if<M == 3>::type>
+    constexpr tmat( const V& a, const V& b, const V& c ) :
+	_m() { _m[0] = a;  _m[1] = b;  _m[2] = c;  }
 
-    mat3( GLfloat m00, GLfloat m10, GLfloat m20,
-	  GLfloat m01, GLfloat m11, GLfloat m21,
-	  GLfloat m02, GLfloat m12, GLfloat m22 ) 
+    template <int M = N, typename = typename std::enable_if<M == 4>::type>
+    constexpr tmat( const V& a, const V& b, const V& c, const V& d ) :
+	_m() { _m[0] = a;  _m[1] = b;  _m[2] = c;  _m[3] = d; }
+
+    //  The element constructors take the matrix a column at a time
+
+    template <int M = N, typename = typename std::enable_if<M == 2>::type>
+    constexpr tmat( T m00, T m10, T m01, T m11 ) :
+	_m() { _m[0] = V( m00, m01 ); _m[1] = V( m10, m11 ); }
+
+    template <int M = N, typename = typename std::enable_if<M == 3>::type>
+    constexpr tmat( T m00, T m10, T m20,
+		    T m01, T m11, T m21,
+		    T m02, T m12, T m22 ) :
+	_m()
 	{
-	    _m[0] = vec3( m00, m01, m02 );
-	    _m[1] = vec3( m10, m11, m12 );
-	    _m[2] = vec3( m20, m21, m22 );
+	    _m[0] = V( m00, m01, m02 );
+	    _m[1] = V( m10, m11, m12 );
+	    _m[2] = V( m20, m21, m22 );
 	}
 
-    mat3( const mat3& m )
+    template <int M = N, typename = typename std::enable_if<M == 4>::type>
+    constexpr tmat( T m00, T m10, T m20, T m30,
+		    T m01, T m11, T m21, T m31,
+		    T m02, T m12, T m22, T m32,
+		    T m03, T m13, T m23, T m33 ) :
+	_m()
 	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-	    } 
+	    _m[0] = V( m00, m01, m02, m03 );
+	    _m[1] = V( m10, m11, m12, m13 );
+	    _m[2] = V( m20, m21, m22, m23 );
+	    _m[3] = V( m30, m31, m32, m33 );
 	}
 
     //
     //  --- Indexing Operator ---
     //
 
-    vec3& operator [] ( int i ) { return _m[i]; }
-    const vec3& operator [] ( int i ) const { return _m[i]; }
+    constexpr V& operator [] ( int i ) { return _m[i]; }
+    constexpr const V& operator [] ( int i ) const { return _m[i]; }
 
     //
-    //  --- (non-modifying) Arithmatic Operators ---
+    //  --- (non-modifying) Arithematic Operators ---
     //
 
-    mat3 operator + ( const mat3& m ) const
-	{ return mat3( _m[0]+m[0], _m[1]+m[1], _m[2]+m[2] ); }
+    constexpr tmat operator + ( const tmat& m ) const {
+	tmat a;
+	for ( int i = 0; i < N; ++i ) a[i] = _m[i] + m[i];
+	return a;
+    }
 
-    mat3 operator - ( const mat3& m ) const
-	{ return mat3( _m[0]-m[0], _m[1]-m[1], _m[2]-m[2] ); }
+    constexpr tmat operator - ( const tmat& m ) const {
+	tmat a;
+	for ( int i = 0; i < N; ++i ) a[i] = _m[i] - m[i];
+	return a;
+    }
 
-    mat3 operator * ( const GLfloat s ) const 
-	{ return mat3( s*_m[0], s*_m[1], s*_m[2] ); }
+    constexpr tmat operator * ( const T s ) const {
+	tmat a;
+	for ( int i = 0; i < N; ++i ) a[i] = s * _m[i];
+	return a;
+    }
 
-    mat3 operator / ( const GLfloat s ) const {
+    constexpr tmat operator / ( const T s ) const {
 #ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
+	if ( scalar_traits<T>::nearZero(s) ) {
 	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
 		      << "Division by zero" << std::endl;
-	    return mat3();
+	    return tmat();
 	}
 #endif // DEBUG
-	
-	GLfloat r = GLfloat(1.0) / s;
+
+	T r = scalar_traits<T>::one() / s;
 	return *this * r;
     }
 
-    friend mat3 operator * ( const GLfloat s, const mat3& m )
+    friend constexpr tmat operator * ( const T s, const tmat& m )
 	{ return m * s; }
-	
-    mat3 operator * ( const mat3& m ) const {
-	mat3  a( 0.0 );
-
-	for ( int i = 0; i < 3; ++i ) {
-	    for ( int j = 0; j < 3; ++j ) {
-		for ( int k = 0; k < 3; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
+
+    constexpr tmat operator * ( const tmat& m ) const {
+	tmat  a( T(0.0) );
+
+	if ( kernels::available && !ANGEL_CONSTANT_EVALUATED() ) {
+	    kernels::multiply( *this, m, a );
+	    return a;
+	}
+
+	for ( int i = 0; i < N; ++i ) {
+	    for ( int j = 0; j < N; ++j ) {
+		for ( int k = 0; k < N; ++k ) {
+		    a[i][j] = a[i][j] + _m[i][k] * m[k][j];
 		}
 	    }
 	}
@@ -272,298 +178,264 @@ class mat3 {
     }
 
     //
-    //  --- (modifying) Arithmetic Operators ---
+    //  --- (modifying) Arithematic Operators ---
     //
 
-    mat3& operator += ( const mat3& m ) {
-	_m[0] += m[0];  _m[1] += m[1];  _m[2] += m[2]; 
-	return *this;
-    }
+    constexpr tmat& operator += ( const tmat& m )
+	{ return *this = *this + m; }
 
-    mat3& operator -= ( const mat3& m ) {
-	_m[0] -= m[0];  _m[1] -= m[1];  _m[2] -= m[2]; 
-	return *this;
-    }
-
-    mat3& operator *= ( const GLfloat s ) {
-	_m[0] *= s;  _m[1] *= s;  _m[2] *= s; 
-	return *this;
-    }
+    constexpr tmat& operator -= ( const tmat& m )
+	{ return *this = *this - m; }
 
-    mat3& operator *= ( const mat3& m ) {
-	mat3  a( 0.0 );
+    constexpr tmat& operator *= ( const T s )
+	{ return *this = *this * s; }
 
-	for ( int i = 0; i < 3; ++i ) {
-	    for ( int j = 0; j < 3; ++j ) {
-		for ( int k = 0; k < 3; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
+    constexpr tmat& operator *= ( const tmat& m ) {
+	if ( kernels::available && !ANGEL_CONSTANT_EVALUATED() ) {
+	    kernels::multiply( *this, m, *this );
+	    return *this;
 	}
 
-	return *this = a;
+	return *this = *this * m;
     }
 
-    mat3& operator /= ( const GLfloat s ) {
-#ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
-	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
-		      << "Division by zero" << std::endl;
-	    return mat3();
-	}
-#endif // DEBUG
-
-	GLfloat r = GLfloat(1.0) / s;
-	return *this *= r;
-    }
+    constexpr tmat& operator /= ( const T s )
+	{ return *this = *this / s; }
 
     //
     //  --- Matrix / Vector operators ---
     //
 
-    vec3 operator * ( const vec3& v ) const {  // m * v
-	return vec3( _m[0][0]*v.x + _m[0][1]*v.y + _m[0][2]*v.z,
-		     _m[1][0]*v.x + _m[1][1]*v.y + _m[1][2]*v.z,
-		     _m[2][0]*v.x + _m[2][1]*v.y + _m[2][2]*v.z );
+    constexpr V operator * ( const V& v ) const {  // m * v
+	V r;
+
+	if ( kernels::available && !ANGEL_CONSTANT_EVALUATED() ) {
+	    kernels::multiplyVector( *this, v, r );
+	    return r;
+	}
+
+	for ( int i = 0; i < N; ++i ) r[i] = dot( _m[i], v );
+	return r;
     }
-	
+
     //
     //  --- Insertion and Extraction Operators ---
     //
-	
-    friend std::ostream& operator << ( std::ostream& os, const mat3& m ) {
-	return os << std::endl 
-		  << m[0] << std::endl
-		  << m[1] << std::endl
-		  << m[2] << std::endl;
+
+    friend std::ostream& operator << ( std::ostream& os, const tmat& m ) {
+	os << std::endl;
+	for ( int i = 0; i < N; ++i ) os << m[i] << std::endl;
+	return os;
     }
 
-    friend std::istream& operator >> ( std::istream& is, mat3& m )
-	{ return is >> m._m[0] >> m._m[1] >> m._m[2] ; }
+    friend std::istream& operator >> ( std::istream& is, tmat& m ) {
+	for ( int i = 0; i < N; ++i ) is >> m._m[i];
+	return is;
+    }
 
     //
     //  --- Conversion Operators ---
     //
 
-    operator const GLfloat* () const
-	{ return static_cast<const GLfloat*>( &_m[0].x ); }
+    operator const T* () const
+	{ return static_cast<const T*>( &_m[0].x ); }
 
-    operator GLfloat* ()
-	{ return static_cast<GLfloat*>( &_m[0].x ); }
+    operator T* ()
+	{ return static_cast<T*>( &_m[0].x ); }
 };
 
 //
-//  --- Non-class mat3 Methods ---
+//  --- Non-class tmat Methods ---
 //
 
-inline
-mat3 matrixCompMult( const mat3& A, const mat3& B ) {
-    return mat3( A[0][0]*B[0][0], A[0][1]*B[0][1], A[0][2]*B[0][2],
-		 A[1][0]*B[1][0], A[1][1]*B[1][1], A[1][2]*B[1][2],
-		 A[2][0]*B[2][0], A[2][1]*B[2][1], A[2][2]*B[2][2] );
+template <int N, typename T>
+inline constexpr
+tmat<N, T> matrixCompMult( const tmat<N, T>& A, const tmat<N, T>& B ) {
+    tmat<N, T> c;
+    for ( int i = 0; i < N; ++i ) c[i] = A[i] * B[i];
+    return c;
 }
 
-inline
-mat3 transpose( const mat3& A ) {
-    return mat3( A[0][0], A[1][0], A[2][0],
-		 A[0][1], A[1][1], A[2][1],
-		 A[0][2], A[1][2], A[2][2] );
+template <int N, typename T>
+inline constexpr
+tmat<N, T> transpose( const tmat<N, T>& A ) {
+    tmat<N, T> t;
+
+    if ( tmat_kernels<N, T>::available && !ANGEL_CONSTANT_EVALUATED() ) {
+	tmat_kernels<N, T>::transpose( A, t );
+	return t;
+    }
+
+    for ( int i = 0; i < N; ++i )
+	for ( int j = 0; j < N; ++j )
+	    t[i][j] = A[j][i];
+    return t;
 }
 
-//----------------------------------------------------------------------------
 //
-//  mat4.h - 4D square matrix
+//  General inverse.  A singular matrix gives back garbage; when that can
+//  happen, use inverse( A, det ), which also returns the determinant, and
+//  check it.
 //
 
-class mat4 {
-
-    vec4  _m[4];
-
-   public:
-    //
-    //  --- Constructors and Destructors ---
-    //
-
-    mat4( const GLfloat d = GLfloat(1.0) )  // Create a diagional matrix
-	{ _m[0].x = d;  _m[1].y = d;  _m[2].z = d;  _m[3].w = d; }
-
-    mat4( const vec4& a, const vec4& b, const vec4& c, const vec4& d )
-	{ _m[0] = a;  _m[1] = b;  _m[2] = c;  _m[3] = d; }
-
-    mat4( GLfloat m00, GLfloat m10, GLfloat m20, GLfloat m30,
-	  GLfloat m01, GLfloat m11, GLfloat m21, GLfloat m31,
-	  GLfloat m02, GLfloat m12, GLfloat m22, GLfloat m32,
-	  GLfloat m03, GLfloat m13, GLfloat m23, GLfloat m33 )
-	{
-	    _m[0] = vec4( m00, m01, m02, m03 );
-	    _m[1] = vec4( m10, m11, m12, m13 );
-	    _m[2] = vec4( m20, m21, m22, m23 );
-	    _m[3] = vec4( m30, m31, m32, m33 );
-	}
-
-    mat4( const mat4& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-		_m[3] = m._m[3];
-	    } 
-	}
-
-    //
-    //  --- Indexing Operator ---
-    //
+template <typename T>
+inline constexpr
+tmat<4, T> inverse( const tmat<4, T>& A, T& det ) {
+    tmat<4, T> inv;
 
-    vec4& operator [] ( int i ) { return _m[i]; }
-    const vec4& operator [] ( int i ) const { return _m[i]; }
-
-    //
-    //  --- (non-modifying) Arithematic Operators ---
-    //
-
-    mat4 operator + ( const mat4& m ) const
-	{ return mat4( _m[0]+m[0], _m[1]+m[1], _m[2]+m[2], _m[3]+m[3] ); }
-
-    mat4 operator - ( const mat4& m ) const
-	{ return mat4( _m[0]-m[0], _m[1]-m[1], _m[2]-m[2], _m[3]-m[3] ); }
-
-    mat4 operator * ( const GLfloat s ) const 
-	{ return mat4( s*_m[0], s*_m[1], s*_m[2], s*_m[3] ); }
-
-    mat4 operator / ( const GLfloat s ) const {
-#ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
-	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
-		      << "Division by zero" << std::endl;
-	    return mat4();
-	}
-#endif // DEBUG
-	
-	GLfloat r = GLfloat(1.0) / s;
-	return *this * r;
+    if ( tmat_kernels<4, T>::available && !ANGEL_CONSTANT_EVALUATED() ) {
+	det = tmat_kernels<4, T>::inverse( A, inv );
+	return inv;
     }
 
-    friend mat4 operator * ( const GLfloat s, const mat4& m )
-	{ return m * s; }
-	
-    mat4 operator * ( const mat4& m ) const {
-	mat4  a( 0.0 );
-
-	for ( int i = 0; i < 4; ++i ) {
-	    for ( int j = 0; j < 4; ++j ) {
-		for ( int k = 0; k < 4; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
-
-	return a;
-    }
-
-    //
-    //  --- (modifying) Arithematic Operators ---
-    //
-
-    mat4& operator += ( const mat4& m ) {
-	_m[0] += m[0];  _m[1] += m[1];  _m[2] += m[2];  _m[3] += m[3];
-	return *this;
-    }
+    // cofactors from the 2x2 determinants of the top and bottom row pairs
+    T s0 = A[0][0]*A[1][1] - A[1][0]*A[0][1];
+    T s1 = A[0][0]*A[1][2] - A[1][0]*A[0][2];
+    T s2 = A[0][0]*A[1][3] - A[1][0]*A[0][3];
+    T s3 = A[0][1]*A[1][2] - A[1][1]*A[0][2];
+    T s4 = A[0][1]*A[1][3] - A[1][1]*A[0][3];
+    T s5 = A[0][2]*A[1][3] - A[1][2]*A[0][3];
+
+    T c5 = A[2][2]*A[3][3] - A[3][2]*A[2][3];
+    T c4 = A[2][1]*A[3][3] - A[3][1]*A[2][3];
+    T c3 = A[2][1]*A[3][2] - A[3][1]*A[2][2];
+    T c2 = A[2][0]*A[3][3] - A[3][0]*A[2][3];
+    T c1 = A[2][0]*A[3][2] - A[3][0]*A[2][2];
+    T c0 = A[2][0]*A[3][1] - A[3][0]*A[2][1];
+
+    det = s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+    T r = scalar_traits<T>::one() / det;
+
+    inv[0][0] = ( A[1][1]*c5 - A[1][2]*c4 + A[1][3]*c3) * r;
+    inv[0][1] = (-A[0][1]*c5 + A[0][2]*c4 - A[0][3]*c3) * r;
+    inv[0][2] = ( A[3][1]*s5 - A[3][2]*s4 + A[3][3]*s3) * r;
+    inv[0][3] = (-A[2][1]*s5 + A[2][2]*s4 - A[2][3]*s3) * r;
+
+    inv[1][0] = (-A[1][0]*c5 + A[1][2]*c2 - A[1][3]*c1) * r;
+    inv[1][1] = ( A[0][0]*c5 - A[0][2]*c2 + A[0][3]*c1) * r;
+    inv[1][2] = (-A[3][0]*s5 + A[3][2]*s2 - A[3][3]*s1) * r;
+    inv[1][3] = ( A[2][0]*s5 - A[2][2]*s2 + A[2][3]*s1) * r;
+
+    inv[2][0] = ( A[1][0]*c4 - A[1][1]*c2 + A[1][3]*c0) * r;
+    inv[2][1] = (-A[0][0]*c4 + A[0][1]*c2 - A[0][3]*c0) * r;
+    inv[2][2] = ( A[3][0]*s4 - A[3][1]*s2 + A[3][3]*s0) * r;
+    inv[2][3] = (-A[2][0]*s4 + A[2][1]*s2 - A[2][3]*s0) * r;
+
+    inv[3][0] = (-A[1][0]*c3 + A[1][1]*c1 - A[1][2]*c0) * r;
+    inv[3][1] = ( A[0][0]*c3 - A[0][1]*c1 + A[0][2]*c0) * r;
+    inv[3][2] = (-A[3][0]*s3 + A[3][1]*s1 - A[3][2]*s0) * r;
+    inv[3][3] = ( A[2][0]*s3 - A[2][1]*s1 + A[2][2]*s0) * r;
+    return inv;
+}
 
-    mat4& operator -= ( const mat4& m ) {
-	_m[0] -= m[0];  _m[1] -= m[1];  _m[2] -= m[2];  _m[3] -= m[3];
-	return *this;
-    }
+template <typename T>
+inline constexpr
+tmat<4, T> inverse( const tmat<4, T>& A ) {
+    T det = T();
+    return inverse( A, det );
+}
 
-    mat4& operator *= ( const GLfloat s ) {
-	_m[0] *= s;  _m[1] *= s;  _m[2] *= s;  _m[3] *= s;
-	return *this;
-    }
+//----------------------------------------------------------------------------
+//
+//  Matrix types
+//
 
-    mat4& operator *= ( const mat4& m ) {
-	mat4  a( 0.0 );
+typedef tmat<2, GLfloat>   mat2;
+typedef tmat<3, GLfloat>   mat3;
+typedef tmat<4, GLfloat>   mat4;
 
-	for ( int i = 0; i < 4; ++i ) {
-	    for ( int j = 0; j < 4; ++j ) {
-		for ( int k = 0; k < 4; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
+typedef tmat<2, GLdouble>  dmat2;
+typedef tmat<3, GLdouble>  dmat3;
+typedef tmat<4, GLdouble>  dmat4;
 
-	return *this = a;
-    }
+//----------------------------------------------------------------------------
+//
+//  Batch transforms of vec4 arrays and of SoA x, y, z arrays.  Normals
+//  take the upper 3x3 of the matrix (pass a normal matrix when there is
+//  non-uniform scale) and come out unit length with w = 0.  stream writes
+//  past the caches, for outputs too big to be read back soon.
+//  ParallelTransform.h spreads big arrays over the job system.
+//
 
-    mat4& operator /= ( const GLfloat s ) {
-#ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
-	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
-		      << "Division by zero" << std::endl;
-	    return mat4();
-	}
-#endif // DEBUG
+inline
+void transformPoints( const mat4& m, const vec4* in, vec4* out, const int count,
+		      const bool stream = false )
+{
+    if ( count <= 0 ) return;
+#ifdef ANGEL_SIMD
+    simd::transformPoints( m, &in->x, &out->x, count, stream );
+#else
+    for ( int i = 0; i < count; ++i )
+	out[i] = m * in[i];
+#endif
+}
 
-	GLfloat r = GLfloat(1.0) / s;
-	return *this *= r;
+// firstOut[i] = first * in[i] and secondOut[i] = second * firstOut[i],
+// as two transformPoints would make them, in one pass over the arrays
+inline
+void transformPoints( const mat4& first, const mat4& second, const vec4* in,
+		      vec4* firstOut, vec4* secondOut, const int count )
+{
+    if ( count <= 0 ) return;
+#ifdef ANGEL_SIMD
+    simd::transformPoints( first, second, &in->x, &firstOut->x, &secondOut->x, count );
+#else
+    for ( int i = 0; i < count; ++i ) {
+	firstOut[i] = first * in[i];
+	secondOut[i] = second * firstOut[i];
     }
+#endif
+}
 
-    //
-    //  --- Matrix / Vector operators ---
-    //
-
-    vec4 operator * ( const vec4& v ) const {  // m * v
-	return vec4( _m[0][0]*v.x + _m[0][1]*v.y + _m[0][2]*v.z + _m[0][3]*v.w,
-		     _m[1][0]*v.x + _m[1][1]*v.y + _m[1][2]*v.z + _m[1][3]*v.w,
-		     _m[2][0]*v.x + _m[2][1]*v.y + _m[2][2]*v.z + _m[2][3]*v.w,
-		     _m[3][0]*v.x + _m[3][1]*v.y + _m[3][2]*v.z + _m[3][3]*v.w
-	    );
-    }
-	
-    //
-    //  --- Insertion and Extraction Operators ---
-    //
-	
-    friend std::ostream& operator << ( std::ostream& os, const mat4& m ) {
-	return os << std::endl 
-		  << m[0] << std::endl
-		  << m[1] << std::endl
-		  << m[2] << std::endl
-		  << m[3] << std::endl;
+inline
+void transformNormals( const mat4& m, const vec4* in, vec4* out, const int count,
+		       const bool stream = false )
+{
+    if ( count <= 0 ) return;
+#ifdef ANGEL_SIMD
+    simd::transformNormals( m, &in->x, &out->x, count, stream );
+#else
+    for ( int i = 0; i < count; ++i ) {
+	vec3 n( m[0][0]*in[i].x + m[0][1]*in[i].y + m[0][2]*in[i].z,
+		m[1][0]*in[i].x + m[1][1]*in[i].y + m[1][2]*in[i].z,
+		m[2][0]*in[i].x + m[2][1]*in[i].y + m[2][2]*in[i].z );
+	out[i] = vec4( n / sqrtf( dot(n, n) ), 0.0 );
     }
-
-    friend std::istream& operator >> ( std::istream& is, mat4& m )
-	{ return is >> m._m[0] >> m._m[1] >> m._m[2] >> m._m[3]; }
-
-    //
-    //  --- Conversion Operators ---
-    //
-
-    operator const GLfloat* () const
-	{ return static_cast<const GLfloat*>( &_m[0].x ); }
-
-    operator GLfloat* ()
-	{ return static_cast<GLfloat*>( &_m[0].x ); }
-};
-
-//
-//  --- Non-class mat4 Methods ---
-//
+#endif
+}
 
 inline
-mat4 matrixCompMult( const mat4& A, const mat4& B ) {
-    return mat4(
-	A[0][0]*B[0][0], A[0][1]*B[0][1], A[0][2]*B[0][2], A[0][3]*B[0][3],
-	A[1][0]*B[1][0], A[1][1]*B[1][1], A[1][2]*B[1][2], A[1][3]*B[1][3],
-	A[2][0]*B[2][0], A[2][1]*B[2][1], A[2][2]*B[2][2], A[2][3]*B[2][3],
-	A[3][0]*B[3][0], A[3][1]*B[3][1], A[3][2]*B[3][2], A[3][3]*B[3][3] );
+void transformPoints( const mat4& m, const GLfloat* x, const GLfloat* y, const GLfloat* z,
+		      GLfloat* outX, GLfloat* outY, GLfloat* outZ, GLfloat* outW, const int count )
+{
+    if ( count <= 0 ) return;
+#ifdef ANGEL_SIMD
+    simd::transformPoints( m, x, y, z, outX, outY, outZ, outW, count );
+#else
+    for ( int i = 0; i < count; ++i ) {
+	vec4 p = m * vec4( x[i], y[i], z[i], 1.0 );
+	outX[i] = p.x;  outY[i] = p.y;  outZ[i] = p.z;
+	if ( outW != NULL ) outW[i] = p.w;
+    }
+#endif
 }
 
 inline
-mat4 transpose( const mat4& A ) {
-    return mat4( A[0][0], A[1][0], A[2][0], A[3][0],
-		 A[0][1], A[1][1], A[2][1], A[3][1],
-		 A[0][2], A[1][2], A[2][2], A[3][2],
-		 A[0][3], A[1][3], A[2][3], A[3][3] );
+void transformNormals( const mat4& m, const GLfloat* x, const GLfloat* y, const GLfloat* z,
+		       GLfloat* outX, GLfloat* outY, GLfloat* outZ, const int count )
+{
+    if ( count <= 0 ) return;
+#ifdef ANGEL_SIMD
+    simd::transformNormals( m, x, y, z, outX, outY, outZ, count );
+#else
+    for ( int i = 0; i < count; ++i ) {
+	vec3 n( m[0][0]*x[i] + m[0][1]*y[i] + m[0][2]*z[i],
+		m[1][0]*x[i] + m[1][1]*y[i] + m[1][2]*z[i],
+		m[2][0]*x[i] + m[2][1]*y[i] + m[2][2]*z[i] );
+	n /= sqrtf( dot(n, n) );
+	outX[i] = n.x;  outY[i] = n.y;  outZ[i] = n.z;
+    }
+#endif
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -635,7 +507,7 @@ mat4 RotateZ( const GLfloat theta )
 //  Translation matrix generators
 //
 
-inline
+inline constexpr
 mat4 Translate( const GLfloat x, const GLfloat y, const GLfloat z )
 {
     mat4 c;
@@ -645,13 +517,13 @@ mat4 Translate( const GLfloat x, const GLfloat y, const GLfloat z )
     return c;
 }
 
-inline
+inline constexpr
 mat4 Translate( const vec3& v )
 {
     return Translate( v.x, v.y, v.z );
 }
 
-inline
+inline constexpr
 mat4 Translate( const vec4& v )
 {
     return Translate( v.x, v.y, v.z );
@@ -662,7 +534,7 @@ mat4 Translate( const vec4& v )
 //  Scale matrix generators
 //
 
-inline
+inline constexpr
 mat4 Scale( const GLfloat x, const GLfloat y, const GLfloat z )
 {
     mat4 c;
@@ -672,7 +544,7 @@ mat4 Scale( const GLfloat x, const GLfloat y, const GLfloat z )
     return c;
 }
 
-inline
+inline constexpr
 mat4 Scale( const vec3& v )
 {
     return Scale( v.x, v.y, v.z );
@@ -689,7 +561,7 @@ mat4 Scale( const vec3& v )
 
 
 
-inline
+inline constexpr
 mat4 Ortho( const GLfloat left, const GLfloat right,
 	    const GLfloat bottom, const GLfloat top,
 	    const GLfloat zNear, const GLfloat zFar )
@@ -705,14 +577,14 @@ mat4 Ortho( const GLfloat left, const GLfloat right,
     return c;
 }
 
-inline
+inline constexpr
 mat4 Ortho2D( const GLfloat left, const GLfloat right,
 	      const GLfloat bottom, const GLfloat top )
 {
     return Ortho( left, right, bottom, top, -1.0, 1.0 );
 }
 
-inline
+inline constexpr
 mat4 Frustum( const GLfloat left, const GLfloat right,
 	      const GLfloat bottom, const GLfloat top,
 	      const GLfloat zNear, const GLfloat zFar )
@@ -729,11 +601,26 @@ mat4 Frustum( const GLfloat left, const GLfloat right,
     return c;
 }
 
-inline
+//  tan() for the compile-time Perspective: the sine and cosine series,
+//    summed in double, for |x| up to pi/2
+inline constexpr
+double constantTan( const double x )
+{
+    double x2 = x*x;
+    double sine = 1.0, cosine = 1.0;
+    for ( int n = 11; n > 0; --n ) {
+	sine = 1.0 - x2 * (1.0 / ((2*n) * (2*n + 1))) * sine;
+	cosine = 1.0 - x2 * (1.0 / ((2*n - 1) * (2*n))) * cosine;
+    }
+    return x * sine / cosine;
+}
+
+inline constexpr
 mat4 Perspective( const GLfloat fovy, const GLfloat aspect,
 		  const GLfloat zNear, const GLfloat zFar)
 {
-    GLfloat top   = tan(fovy*DegreesToRadians/2) * zNear;
+    GLfloat angle = fovy*DegreesToRadians/2;
+    GLfloat top   = ( ANGEL_CONSTANT_EVALUATED() ? constantTan(angle) : tan(angle) ) * zNear;
     GLfloat right = top * aspect;
 
     mat4 c;
@@ -757,33 +644,190 @@ mat4 LookAt( const vec4& eye, const vec4& at, const vec4& up )
     vec4 n = normalize(eye - at);
     vec4 u = vec4(normalize(cross(up,n)),0.0);
     vec4 v = vec4(normalize(cross(n,u)),0.0);
-    vec4 t = vec4(0.0, 0.0, 0.0, 1.0);
-    mat4 c = mat4(u, v, n, t);
-    return c * Translate( -eye );
+
+    // mat4(u, v, n, (0, 0, 0, 1)) * Translate(-eye) multiplied out: the
+    // basis rows, with -eye taken through each in the last column, summed
+    // in the product's order.  Adding zero turns negative zeros positive,
+    // as the product's last term, 0 * 0, did.
+    vec4 e = -eye;
+    const vec4* basis[3] = { &u, &v, &n };
+    mat4 c;
+    for ( int i = 0; i < 3; ++i ) {
+	const vec4& b = *basis[i];
+	c[i] = vec4( b.x + 0.0f, b.y + 0.0f, b.z + 0.0f, b.x*e.x + b.y*e.y + b.z*e.z + b.w );
+    }
+    return c;
 }
 
 //----------------------------------------------------------------------------
 //
-// Generates a Normal Matrix
+//  Composed object transforms
+//
+//    LookAtTRS builds
+//
+//      LookAt(eye, at, up) * RotateX(r.x) * RotateY(r.y) * RotateZ(r.z)
+//          * Translate(t) * Scale(s)
+//
+//    directly: the rotation is a 3x3 and the view basis is applied to it
+//    alone, so there are no mat4 products.  quat.h has the form taking an
+//    orientation and the batch form.
+//
+
+//
+//  Sine and cosine of an angle in degrees, together.  The angle is reduced
+//  to [-45, 45] around the nearest multiple of 90 degrees, where short
+//  Taylor series are good to float precision, so multiples of 90 come out
+//  exact.  There are no branches, so random angles cost what zero does.
+//
+
+inline
+void SinCos( const GLfloat theta, GLfloat& s, GLfloat& c )
+{
+    // adding and taking away 1.5 * 2^23 rounds to the nearest integer
+    const GLfloat round = 12582912.0f;
+    GLfloat quarters = ( theta * GLfloat(1.0/90.0) + round ) - round;
+    GLfloat x = ( theta - GLfloat(90.0) * quarters ) * GLfloat(DegreesToRadians);
+    GLfloat x2 = x * x;
+
+    GLfloat sx = x * (1.0f + x2 * (-1.0f/6.0f + x2 * (1.0f/120.0f + x2 * (-1.0f/5040.0f + x2 * (1.0f/362880.0f)))));
+    GLfloat cx = 1.0f + x2 * (-0.5f + x2 * (1.0f/24.0f + x2 * (-1.0f/720.0f + x2 * (1.0f/40320.0f))));
+
+    // odd quarters swap the two, and the signs go round every half turn;
+    // the weights are all 0 and +-1, so this is exact
+    int q = (int)quarters;
+    GLfloat odd = GLfloat(q & 1);
+    GLfloat s0 = (1.0f - odd) * sx + odd * cx;
+    GLfloat c0 = (1.0f - odd) * cx + odd * sx;
+    s = GLfloat(1 - (q & 2)) * s0;
+    c = GLfloat(1 - ((q + 1) & 2)) * c0;
+}
+
+inline
+mat4 LookAtTRS( const vec4& eye, const vec4& at, const vec4& up,
+		const mat3& rotation, const vec3& translate, const vec3& scale )
+{
+    // view basis, as LookAt builds it
+    GLfloat nx = eye.x - at.x, ny = eye.y - at.y, nz = eye.z - at.z;
+    GLfloat s = GLfloat(1.0) / sqrtf( nx*nx + ny*ny + nz*nz );
+    nx *= s;  ny *= s;  nz *= s;
+
+    GLfloat ux = up.y*nz - up.z*ny, uy = up.z*nx - up.x*nz, uz = up.x*ny - up.y*nx;
+    s = GLfloat(1.0) / sqrtf( ux*ux + uy*uy + uz*uz );
+    ux *= s;  uy *= s;  uz *= s;
+
+    // already unit length
+    GLfloat vx = ny*uz - nz*uy, vy = nz*ux - nx*uz, vz = nx*uy - ny*ux;
+
+    // each basis row times the rotation, then the scale on its columns;
+    // the translation column is the basis applied to R t - eye
+    const vec3& r0 = rotation[0];
+    const vec3& r1 = rotation[1];
+    const vec3& r2 = rotation[2];
+    GLfloat px = r0.x*translate.x + r0.y*translate.y + r0.z*translate.z - eye.x;
+    GLfloat py = r1.x*translate.x + r1.y*translate.y + r1.z*translate.z - eye.y;
+    GLfloat pz = r2.x*translate.x + r2.y*translate.y + r2.z*translate.z - eye.z;
+
+    mat4 c;
+#define ANGEL_BASIS_ROW( i, bx, by, bz ) \
+    c[i] = vec4( ( bx*r0.x + by*r1.x + bz*r2.x ) * scale.x, \
+		 ( bx*r0.y + by*r1.y + bz*r2.y ) * scale.y, \
+		 ( bx*r0.z + by*r1.z + bz*r2.z ) * scale.z, \
+		 bx*px + by*py + bz*pz )
+    ANGEL_BASIS_ROW( 0, ux, uy, uz );
+    ANGEL_BASIS_ROW( 1, vx, vy, vz );
+    ANGEL_BASIS_ROW( 2, nx, ny, nz );
+#undef ANGEL_BASIS_ROW
+    return c;
+}
+
+//
+//  With Euler angles in degrees, RotateX(r.x) * RotateY(r.y) * RotateZ(r.z)
+//
+
+inline
+mat4 LookAtTRS( const vec4& eye, const vec4& at, const vec4& up,
+		const vec3& rotate, const vec3& translate, const vec3& scale )
+{
+    GLfloat sa, ca, sb, cb, sc, cc;
+    SinCos( rotate.x, sa, ca );
+    SinCos( rotate.y, sb, cb );
+    SinCos( rotate.z, sc, cc );
+
+    // RotateX * RotateY * RotateZ, multiplied out
+    mat3 rotation( vec3( cb*cc,                -cb*sc,                 sb     ),
+		   vec3( sa*sb*cc + ca*sc,     -sa*sb*sc + ca*cc,     -sa*cb  ),
+		   vec3( -ca*sb*cc + sa*sc,     ca*sb*sc + sa*cc,      ca*cb  ) );
+    return LookAtTRS( eye, at, up, rotation, translate, scale );
+}
+
+//----------------------------------------------------------------------------
+//
+// Generates a Normal Matrix: the inverse transpose of the upper 3x3, which
+//   keeps normals perpendicular to surfaces under non-uniform scales.
+//   The result is not normalized; the lighting does that.
 //
 inline
 mat3 Normal( const mat4& c)
 {
+#ifdef ANGEL_SIMD
+   ANGEL_ALIGN(16) GLfloat t[12];
+   simd::normalMatrix( c, t );
+   return mat3( vec3( t[0], t[1], t[2] ),
+		vec3( t[4], t[5], t[6] ),
+		vec3( t[8], t[9], t[10] ) );
+#else
    mat3 d;
    GLfloat det;
-   det = c[0][0]*c[1][1]*c[2][2]+c[0][1]*c[1][2]*c[2][0]
-     -c[2][0]*c[1][1]*c[0][2]-c[1][0]*c[0][1]*c[2][2]-c[0][0]*c[1][2]*c[2][1];
-   d[0][0] = (c[1][1]*c[2][2]-c[1][2]*c[2][1])/det;
-   d[0][1] = -(c[1][0]*c[2][1]-c[2][0]*c[1][1])/det;
-   d[0][2] = (c[0][1]*c[2][0]-c[2][1]*c[2][2])/det;
-   d[1][0] = -(c[0][1]*c[2][2]-c[0][2]*c[2][1])/det;
-   d[1][1] = (c[0][0]*c[2][2]-c[0][2]*c[2][0])/det;
-   d[1][2] = -(c[0][0]*c[2][1]-c[2][0]*c[0][1])/det;
-   d[2][0] = (c[0][1]*c[1][2]-c[1][1]*c[0][2])/det;
-   d[2][1] = -(c[0][0]*c[1][2]-c[0][2]*c[1][0])/det;
-   d[2][2] = (c[0][0]*c[1][1]-c[1][0]*c[0][1])/det;
+   det = c[0][0]*(c[1][1]*c[2][2]-c[1][2]*c[2][1])
+     -c[0][1]*(c[1][0]*c[2][2]-c[1][2]*c[2][0])
+     +c[0][2]*(c[1][0]*c[2][1]-c[1][1]*c[2][0]);
+   GLfloat invDet = GLfloat(1.0)/det;
+   d[0][0] = (c[1][1]*c[2][2]-c[1][2]*c[2][1])*invDet;
+   d[0][1] = -(c[1][0]*c[2][2]-c[1][2]*c[2][0])*invDet;
+   d[0][2] = (c[1][0]*c[2][1]-c[1][1]*c[2][0])*invDet;
+   d[1][0] = -(c[0][1]*c[2][2]-c[0][2]*c[2][1])*invDet;
+   d[1][1] = (c[0][0]*c[2][2]-c[0][2]*c[2][0])*invDet;
+   d[1][2] = -(c[0][0]*c[2][1]-c[0][1]*c[2][0])*invDet;
+   d[2][0] = (c[0][1]*c[1][2]-c[0][2]*c[1][1])*invDet;
+   d[2][1] = -(c[0][0]*c[1][2]-c[0][2]*c[1][0])*invDet;
+   d[2][2] = (c[0][0]*c[1][1]-c[0][1]*c[1][0])*invDet;
 
   return d;
+#endif
+}
+
+//----------------------------------------------------------------------------
+//
+// Inverse of an affine matrix, one whose bottom row is (0, 0, 0, 1), such
+//   as any product of LookAt, rotations, translations and scales.  Much
+//   cheaper than the general inverse.
+//
+inline
+mat4 affineInverse( const mat4& m )
+{
+    mat4 inv;
+#ifdef ANGEL_SIMD
+    simd::affineInverse( m, inv );
+#else
+    GLfloat det = m[0][0]*(m[1][1]*m[2][2]-m[1][2]*m[2][1])
+		- m[0][1]*(m[1][0]*m[2][2]-m[1][2]*m[2][0])
+		+ m[0][2]*(m[1][0]*m[2][1]-m[1][1]*m[2][0]);
+    GLfloat invDet = GLfloat(1.0)/det;
+
+    inv[0][0] = (m[1][1]*m[2][2]-m[1][2]*m[2][1])*invDet;
+    inv[0][1] = (m[0][2]*m[2][1]-m[0][1]*m[2][2])*invDet;
+    inv[0][2] = (m[0][1]*m[1][2]-m[0][2]*m[1][1])*invDet;
+    inv[1][0] = (m[1][2]*m[2][0]-m[1][0]*m[2][2])*invDet;
+    inv[1][1] = (m[0][0]*m[2][2]-m[0][2]*m[2][0])*invDet;
+    inv[1][2] = (m[0][2]*m[1][0]-m[0][0]*m[1][2])*invDet;
+    inv[2][0] = (m[1][0]*m[2][1]-m[1][1]*m[2][0])*invDet;
+    inv[2][1] = (m[0][1]*m[2][0]-m[0][0]*m[2][1])*invDet;
+    inv[2][2] = (m[0][0]*m[1][1]-m[0][1]*m[1][0])*invDet;
+
+    for ( int r = 0; r < 3; ++r )
+	inv[r][3] = -( inv[r][0]*m[0][3] + inv[r][1]*m[1][3] + inv[r][2]*m[2][3] );
+#endif
+    return inv;
 }
 
 //----------------------------------------------------------------------------
@@ -0,0 +1,277 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- quat.h ---
+//
+//   Unit quaternions for orientations, stored (x, y, z, w) with w the
+//   scalar part.  Angles are in degrees, as in mat.h, and quaternions
+//   compose like the matrices they stand for: Rotate(a * b) is
+//   Rotate(a) * Rotate(b).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_QUAT_H__
+#define __ANGEL_QUAT_H__
+
+#include "mat.h"
+
+namespace Angel {
+
+//----------------------------------------------------------------------------
+//
+//  quat - rotation quaternion
+//
+
+// 16-byte aligned so the kernels in simd.h can load it whole
+struct ANGEL_ALIGN(16) quat {
+
+    GLfloat  x;
+    GLfloat  y;
+    GLfloat  z;
+    GLfloat  w;
+
+    //
+    //  --- Constructors and Destructors ---
+    //
+
+    quat() :  // the identity
+	x(0.0), y(0.0), z(0.0), w(1.0) {}
+
+    quat( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) :
+	x(x), y(y), z(z), w(w) {}
+
+    quat( const vec3& v, const GLfloat s ) :
+	x(v.x), y(v.y), z(v.z), w(s) {}
+
+    //
+    //  --- Indexing Operator ---
+    //
+
+    GLfloat& operator [] ( int i ) { return *(&x + i); }
+    const GLfloat operator [] ( int i ) const { return *(&x + i); }
+
+    //
+    //  --- (non-modifying) Arithematic Operators ---
+    //
+
+    quat operator - () const  // the same rotation
+	{ return quat( -x, -y, -z, -w ); }
+
+    quat operator + ( const quat& q ) const
+	{ return quat( x + q.x, y + q.y, z + q.z, w + q.w ); }
+
+    quat operator - ( const quat& q ) const
+	{ return quat( x - q.x, y - q.y, z - q.z, w - q.w ); }
+
+    quat operator * ( const GLfloat s ) const
+	{ return quat( s*x, s*y, s*z, s*w ); }
+
+    friend quat operator * ( const GLfloat s, const quat& q )
+	{ return q * s; }
+
+    // Hamilton product; the rotation q then this one
+    quat operator * ( const quat& q ) const {
+	quat r;
+#ifdef ANGEL_SIMD
+	simd::quatMultiply( &x, &q.x, &r.x );
+#else
+	r.x = w*q.x + x*q.w + y*q.z - z*q.y;
+	r.y = w*q.y - x*q.z + y*q.w + z*q.x;
+	r.z = w*q.z + x*q.y - y*q.x + z*q.w;
+	r.w = w*q.w - x*q.x - y*q.y - z*q.z;
+#endif
+	return r;
+    }
+
+    //
+    //  --- (modifying) Arithematic Operators ---
+    //
+
+    quat& operator *= ( const quat& q )
+	{ *this = *this * q;  return *this; }
+
+    //
+    //  --- Insertion and Extraction Operators ---
+    //
+
+    friend std::ostream& operator << ( std::ostream& os, const quat& q ) {
+	return os << "( " << q.x << ", " << q.y
+		  << ", " << q.z << ", " << q.w << " )";
+    }
+
+    //
+    //  --- Conversion Operators ---
+    //
+
+    operator const GLfloat* () const
+	{ return static_cast<const GLfloat*>( &x ); }
+
+    operator GLfloat* ()
+	{ return static_cast<GLfloat*>( &x ); }
+};
+
+//----------------------------------------------------------------------------
+//
+//  Non-class quat Methods
+//
+
+inline
+GLfloat dot( const quat& p, const quat& q ) {
+    return p.x*q.x + p.y*q.y + p.z*q.z + p.w*q.w;
+}
+
+// The inverse rotation, for a unit quaternion
+inline
+quat conjugate( const quat& q ) {
+    return quat( -q.x, -q.y, -q.z, q.w );
+}
+
+inline
+quat normalize( const quat& q ) {
+    quat r;
+#ifdef ANGEL_SIMD
+    simd::normalize( &q.x, &r.x );
+#else
+    r = q * ( GLfloat(1.0) / std::sqrt( dot(q, q) ) );
+#endif
+    return r;
+}
+
+//
+//  Rotation by theta degrees about an axis, the same one Rotate in mat.h
+//  would build.  The axis needs to be unit length.
+//
+
+inline
+quat AngleAxis( const GLfloat theta, const vec3& axis ) {
+    GLfloat s, c;
+    SinCos( GLfloat(0.5) * theta, s, c );
+    return quat( s * axis, c );
+}
+
+//
+//  The orientation of RotateX(r.x) * RotateY(r.y) * RotateZ(r.z)
+//
+
+inline
+quat FromEuler( const vec3& rotate ) {
+    GLfloat sa, ca, sb, cb, sc, cc;
+    SinCos( GLfloat(0.5) * rotate.x, sa, ca );
+    SinCos( GLfloat(0.5) * rotate.y, sb, cb );
+    SinCos( GLfloat(0.5) * rotate.z, sc, cc );
+
+    // qx * qy * qz, multiplied out
+    return quat( sa*cb*cc + ca*sb*sc,
+		 ca*sb*cc - sa*cb*sc,
+		 ca*cb*sc + sa*sb*cc,
+		 ca*cb*cc - sa*sb*sc );
+}
+
+//
+//  Interpolation from p at t = 0 to q at t = 1, both the short way round.
+//  nlerp is a straight line normalized back onto the sphere: cheap, but
+//  its speed sags in the middle of wide turns.  slerp keeps the speed
+//  constant, and falls back to nlerp where the two are too close to tell
+//  apart.
+//
+
+inline
+quat nlerp( const quat& p, const quat& q, const GLfloat t ) {
+    quat target = dot(p, q) < 0.0 ? -q : q;
+    return normalize( p + t * (target - p) );
+}
+
+inline
+quat slerp( const quat& p, const quat& q, const GLfloat t ) {
+    GLfloat d = dot(p, q);
+    quat target = d < 0.0 ? -q : q;
+    d = std::fabs(d);
+    if ( d > GLfloat(0.9995) )
+	return nlerp( p, target, t );
+
+    GLfloat angle = std::acos(d);
+    GLfloat s = GLfloat(1.0) / std::sin(angle);
+    return std::sin((1 - t) * angle) * s * p + std::sin(t * angle) * s * target;
+}
+
+//----------------------------------------------------------------------------
+//
+//  Rotation matrices, for a unit quaternion
+//
+
+inline
+mat3 RotationMatrix( const quat& q ) {
+    GLfloat x2 = q.x + q.x,  y2 = q.y + q.y,  z2 = q.z + q.z;
+    GLfloat xx = q.x*x2,  yy = q.y*y2,  zz = q.z*z2;
+    GLfloat xy = q.x*y2,  xz = q.x*z2,  yz = q.y*z2;
+    GLfloat wx = q.w*x2,  wy = q.w*y2,  wz = q.w*z2;
+
+    return mat3( vec3( 1.0 - (yy + zz),  xy - wz,          xz + wy         ),
+		 vec3( xy + wz,          1.0 - (xx + zz),  yz - wx         ),
+		 vec3( xz - wy,          yz + wx,          1.0 - (xx + yy) ) );
+}
+
+inline
+mat4 Rotate( const quat& q ) {
+    GLfloat x2 = q.x + q.x,  y2 = q.y + q.y,  z2 = q.z + q.z;
+    GLfloat xx = q.x*x2,  yy = q.y*y2,  zz = q.z*z2;
+    GLfloat xy = q.x*y2,  xz = q.x*z2,  yz = q.y*z2;
+    GLfloat wx = q.w*x2,  wy = q.w*y2,  wz = q.w*z2;
+
+    return mat4( vec4( 1.0 - (yy + zz),  xy - wz,          xz + wy,          0.0 ),
+		 vec4( xy + wz,          1.0 - (xx + zz),  yz - wx,          0.0 ),
+		 vec4( xz - wy,          yz + wx,          1.0 - (xx + yy),  0.0 ),
+		 vec4( 0.0,              0.0,              0.0,              1.0 ) );
+}
+
+//----------------------------------------------------------------------------
+//
+//  LookAtTRS in mat.h with the rotation an orientation:
+//
+//    LookAt(eye, at, up) * Rotate(orientation) * Translate(t) * Scale(s)
+//
+
+inline
+mat4 LookAtTRS( const vec4& eye, const vec4& at, const vec4& up,
+		const quat& orientation, const vec3& translate, const vec3& scale )
+{
+    return LookAtTRS( eye, at, up, RotationMatrix(orientation), translate, scale );
+}
+
+//
+//  Batch form over an array of anything with eye, at, up, orientation,
+//  translate and scale members
+//
+
+template <class T>
+inline
+void LookAtTRS( const T* objects, const int count, mat4* out )
+{
+    int i = 0;
+#ifdef ANGEL_SIMD
+    // four objects at a time, a lane each
+#define ANGEL_LANES( field ) \
+    simd::set( objects[i].field, objects[i + 1].field, objects[i + 2].field, objects[i + 3].field )
+    for ( ; i + 4 <= count; i += 4 ) {
+	simd::float4 lanes[19] = {
+	    ANGEL_LANES(eye.x),           ANGEL_LANES(eye.y),           ANGEL_LANES(eye.z),
+	    ANGEL_LANES(at.x),            ANGEL_LANES(at.y),            ANGEL_LANES(at.z),
+	    ANGEL_LANES(up.x),            ANGEL_LANES(up.y),            ANGEL_LANES(up.z),
+	    ANGEL_LANES(orientation.x),   ANGEL_LANES(orientation.y),
+	    ANGEL_LANES(orientation.z),   ANGEL_LANES(orientation.w),
+	    ANGEL_LANES(translate.x),     ANGEL_LANES(translate.y),     ANGEL_LANES(translate.z),
+	    ANGEL_LANES(scale.x),         ANGEL_LANES(scale.y),         ANGEL_LANES(scale.z) };
+	simd::lookAtTRS4( lanes, &out[i][0][0] );
+    }
+#undef ANGEL_LANES
+#endif
+    for ( ; i < count; ++i ) {
+	const T& o = objects[i];
+	out[i] = LookAtTRS( o.eye, o.at, o.up, o.orientation, o.translate, o.scale );
+    }
+}
+
+//----------------------------------------------------------------------------
+
+}  // namespace Angel
+
+#endif // __ANGEL_QUAT_H__
@@ -0,0 +1,699 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  --- simd.h ---
+//
+//   Four-wide float kernels behind the mat4 operators in mat.h.  SSE is
+//   used on x86 (with AVX for mat4 products when the compiler targets it)
+//   and NEON on 64-bit ARM; both are written against the same handful of
+//   float4 operations, so the kernels themselves exist once.  ANGEL_SIMD is
+//   defined when one of them is available.  Define ANGEL_NO_SIMD to build
+//   the plain scalar operators instead.
+//
+//   Matrices are the 16 floats of a row-major mat4, 16-byte aligned.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ANGEL_SIMD_H__
+#define __ANGEL_SIMD_H__
+
+#if defined(_MSC_VER)
+#  define ANGEL_ALIGN( n )  __declspec(align(n))
+#else
+#  define ANGEL_ALIGN( n )  __attribute__((aligned(n)))
+#endif
+
+#if !defined(ANGEL_NO_SIMD)
+#  if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define ANGEL_SIMD_SSE 1
+#    include <emmintrin.h>
+#    if defined(__AVX__)
+#      define ANGEL_SIMD_AVX 1
+#      include <immintrin.h>
+#    endif
+#  elif defined(__aarch64__) && defined(__ARM_NEON)
+#    define ANGEL_SIMD_NEON 1
+#    include <arm_neon.h>
+#  endif
+#endif
+
+#if defined(ANGEL_SIMD_SSE) || defined(ANGEL_SIMD_NEON)
+#  define ANGEL_SIMD 1
+#endif
+
+#ifdef ANGEL_SIMD
+
+namespace Angel {
+namespace simd {
+
+//----------------------------------------------------------------------------
+//
+//  float4 - one register of four floats
+//
+
+#if defined(ANGEL_SIMD_SSE)
+
+typedef __m128 float4;
+
+// the same register as a plain vector type, to use as a template argument,
+// which would drop __m128's may_alias attribute.  Only GCC and Clang give
+// vector types arithmetic operators.
+#if defined(__GNUC__)
+typedef float lanes4 __attribute__((vector_size(16)));
+#  define ANGEL_SIMD_LANES 1
+#endif
+
+inline float4 load( const float* p ) { return _mm_load_ps(p); }
+inline void store( float* p, float4 v ) { _mm_store_ps(p, v); }
+inline float4 loadUnaligned( const float* p ) { return _mm_loadu_ps(p); }
+inline void storeUnaligned( float* p, float4 v ) { _mm_storeu_ps(p, v); }
+inline float4 set( float x, float y, float z, float w ) { return _mm_setr_ps(x, y, z, w); }
+inline float4 splat( float s ) { return _mm_set1_ps(s); }
+inline float4 add( float4 a, float4 b ) { return _mm_add_ps(a, b); }
+inline float4 sub( float4 a, float4 b ) { return _mm_sub_ps(a, b); }
+inline float4 mul( float4 a, float4 b ) { return _mm_mul_ps(a, b); }
+inline float4 div( float4 a, float4 b ) { return _mm_div_ps(a, b); }
+inline float4 sqrt( float4 a ) { return _mm_sqrt_ps(a); }
+
+// a * b + c
+inline float4 madd( float4 a, float4 b, float4 c ) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+// (a[x], a[y], b[z], b[w])
+template <int x, int y, int z, int w>
+inline float4 shuffle( float4 a, float4 b ) { return _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x)); }
+
+inline void transpose( float4& r0, float4& r1, float4& r2, float4& r3 ) { _MM_TRANSPOSE4_PS(r0, r1, r2, r3); }
+
+#elif defined(ANGEL_SIMD_NEON)
+
+typedef float32x4_t float4;
+
+#if defined(__GNUC__)
+typedef float4 lanes4;
+#  define ANGEL_SIMD_LANES 1
+#endif
+
+inline float4 load( const float* p ) { return vld1q_f32(p); }
+inline void store( float* p, float4 v ) { vst1q_f32(p, v); }
+inline float4 loadUnaligned( const float* p ) { return vld1q_f32(p); }
+inline void storeUnaligned( float* p, float4 v ) { vst1q_f32(p, v); }
+inline float4 set( float x, float y, float z, float w ) { float v[4] = { x, y, z, w };  return vld1q_f32(v); }
+inline float4 splat( float s ) { return vdupq_n_f32(s); }
+inline float4 add( float4 a, float4 b ) { return vaddq_f32(a, b); }
+inline float4 sub( float4 a, float4 b ) { return vsubq_f32(a, b); }
+inline float4 mul( float4 a, float4 b ) { return vmulq_f32(a, b); }
+inline float4 div( float4 a, float4 b ) { return vdivq_f32(a, b); }
+inline float4 sqrt( float4 a ) { return vsqrtq_f32(a); }
+inline float4 madd( float4 a, float4 b, float4 c ) { return vmlaq_f32(c, a, b); }
+
+template <int x, int y, int z, int w>
+inline float4 shuffle( float4 a, float4 b )
+{
+#  if defined(__clang__)
+    return __builtin_shufflevector(a, b, x, y, z + 4, w + 4);
+#  else
+    return __builtin_shuffle(a, b, (uint32x4_t){ x, y, z + 4, w + 4 });
+#  endif
+}
+
+inline void transpose( float4& r0, float4& r1, float4& r2, float4& r3 )
+{
+    float4 t0 = vzip1q_f32(r0, r1), t1 = vzip2q_f32(r0, r1);
+    float4 t2 = vzip1q_f32(r2, r3), t3 = vzip2q_f32(r2, r3);
+    r0 = vcombine_f32(vget_low_f32(t0), vget_low_f32(t2));
+    r1 = vcombine_f32(vget_high_f32(t0), vget_high_f32(t2));
+    r2 = vcombine_f32(vget_low_f32(t1), vget_low_f32(t3));
+    r3 = vcombine_f32(vget_high_f32(t1), vget_high_f32(t3));
+}
+
+#endif
+
+// Every lane set to a[i]
+template <int i>
+inline float4 lane( float4 a ) { return shuffle<i, i, i, i>(a, a); }
+
+// The sum of a's lanes, in every lane
+inline float4 sumLanes( float4 a )
+{
+    a = add(a, shuffle<2, 3, 0, 1>(a, a));
+    return add(a, shuffle<1, 0, 3, 2>(a, a));
+}
+
+//----------------------------------------------------------------------------
+//
+//  floatN - the widest register the compiler targets: 16 lanes with
+//  AVX-512, 8 with AVX, otherwise a float4.  Only the batch kernels below
+//  use it, so they pick up wider registers from -mavx2 or -mavx512f
+//  without any other code changing.  laneN and repeatN work on each
+//  128-bit group, which is one vec4 of an array of them.
+//
+
+#if defined(__AVX512F__)
+
+typedef __m512 floatN;
+const int LanesN = 16;
+
+inline floatN loadN( const float* p ) { return _mm512_loadu_ps(p); }
+inline void storeN( float* p, floatN v ) { _mm512_storeu_ps(p, v); }
+inline void streamN( float* p, floatN v ) { _mm512_stream_ps(p, v); }
+inline void streamFence() { _mm_sfence(); }
+inline floatN splatN( float s ) { return _mm512_set1_ps(s); }
+inline floatN addN( floatN a, floatN b ) { return _mm512_add_ps(a, b); }
+inline floatN mulN( floatN a, floatN b ) { return _mm512_mul_ps(a, b); }
+inline floatN maddN( floatN a, floatN b, floatN c ) { return _mm512_fmadd_ps(a, b, c); }
+inline floatN rsqrtN( floatN a ) { return _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_sqrt_ps(a)); }
+template <int i>
+inline floatN laneN( floatN a ) { return _mm512_permute_ps(a, i * 0x55); }
+inline floatN repeatN( const float* p ) { return _mm512_broadcast_f32x4(_mm_loadu_ps(p)); }
+
+#elif defined(ANGEL_SIMD_AVX)
+
+typedef __m256 floatN;
+const int LanesN = 8;
+
+inline floatN loadN( const float* p ) { return _mm256_loadu_ps(p); }
+inline void storeN( float* p, floatN v ) { _mm256_storeu_ps(p, v); }
+inline void streamN( float* p, floatN v ) { _mm256_stream_ps(p, v); }
+inline void streamFence() { _mm_sfence(); }
+inline floatN splatN( float s ) { return _mm256_set1_ps(s); }
+inline floatN addN( floatN a, floatN b ) { return _mm256_add_ps(a, b); }
+inline floatN mulN( floatN a, floatN b ) { return _mm256_mul_ps(a, b); }
+#  if defined(__FMA__)
+inline floatN maddN( floatN a, floatN b, floatN c ) { return _mm256_fmadd_ps(a, b, c); }
+#  else
+inline floatN maddN( floatN a, floatN b, floatN c ) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#  endif
+inline floatN rsqrtN( floatN a ) { return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(a)); }
+template <int i>
+inline floatN laneN( floatN a ) { return _mm256_permute_ps(a, i * 0x55); }
+inline floatN repeatN( const float* p ) { return _mm256_broadcast_ps((const __m128*)p); }
+
+#else
+
+typedef float4 floatN;
+const int LanesN = 4;
+
+inline floatN loadN( const float* p ) { return loadUnaligned(p); }
+inline void storeN( float* p, floatN v ) { storeUnaligned(p, v); }
+#  if defined(ANGEL_SIMD_SSE)
+inline void streamN( float* p, floatN v ) { _mm_stream_ps(p, v); }
+inline void streamFence() { _mm_sfence(); }
+#  else
+inline void streamN( float* p, floatN v ) { vst1q_f32(p, v); }
+inline void streamFence() {}
+#  endif
+inline floatN splatN( float s ) { return splat(s); }
+inline floatN addN( floatN a, floatN b ) { return add(a, b); }
+inline floatN mulN( floatN a, floatN b ) { return mul(a, b); }
+inline floatN maddN( floatN a, floatN b, floatN c ) { return madd(a, b, c); }
+inline floatN rsqrtN( floatN a ) { return div(splat(1.0f), sqrt(a)); }
+template <int i>
+inline floatN laneN( floatN a ) { return lane<i>(a); }
+inline floatN repeatN( const float* p ) { return loadUnaligned(p); }
+
+#endif
+
+//----------------------------------------------------------------------------
+//
+//  mat4 kernels
+//
+
+// out = a * b; out may be a or b
+inline void multiply( const float* a, const float* b, float* out )
+{
+#if defined(ANGEL_SIMD_AVX)
+    // two rows of the result at a time, each half against a copy of b's rows
+    __m256 b0 = _mm256_broadcast_ps((const __m128*)(b + 0));
+    __m256 b1 = _mm256_broadcast_ps((const __m128*)(b + 4));
+    __m256 b2 = _mm256_broadcast_ps((const __m128*)(b + 8));
+    __m256 b3 = _mm256_broadcast_ps((const __m128*)(b + 12));
+
+    // rows load in halves: a matrix written row by row just before can't
+    // be forwarded to a full-width load
+    __m256 a01 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(a)), _mm_load_ps(a + 4), 1);
+    __m256 a23 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(a + 8)), _mm_load_ps(a + 12), 1);
+
+    __m256 r01 = _mm256_mul_ps(_mm256_permute_ps(a01, 0x00), b0);
+    r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_permute_ps(a01, 0x55), b1));
+    r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_permute_ps(a01, 0xaa), b2));
+    r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_permute_ps(a01, 0xff), b3));
+
+    __m256 r23 = _mm256_mul_ps(_mm256_permute_ps(a23, 0x00), b0);
+    r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_permute_ps(a23, 0x55), b1));
+    r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_permute_ps(a23, 0xaa), b2));
+    r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_permute_ps(a23, 0xff), b3));
+
+    _mm256_storeu_ps(out, r01);
+    _mm256_storeu_ps(out + 8, r23);
+#else
+    // each result row is a's row weighting b's rows
+    float4 b0 = load(b), b1 = load(b + 4), b2 = load(b + 8), b3 = load(b + 12);
+    float4 r[4];
+    for (int i = 0; i < 4; i++)
+    {
+        float4 row = load(a + 4 * i);
+        r[i] = mul(lane<0>(row), b0);
+        r[i] = madd(lane<1>(row), b1, r[i]);
+        r[i] = madd(lane<2>(row), b2, r[i]);
+        r[i] = madd(lane<3>(row), b3, r[i]);
+    }
+    for (int i = 0; i < 4; i++)
+        store(out + 4 * i, r[i]);
+#endif
+}
+
+// out = m * v; out may be v
+inline void multiplyVector( const float* m, const float* v, float* out )
+{
+    float4 x = load(v);
+    float4 r0 = mul(load(m), x);
+    float4 r1 = mul(load(m + 4), x);
+    float4 r2 = mul(load(m + 8), x);
+    float4 r3 = mul(load(m + 12), x);
+
+    // lane i of the sum of the transposed products is row i's dot product
+    transpose(r0, r1, r2, r3);
+    store(out, add(add(r0, r1), add(r2, r3)));
+}
+
+inline void transpose( const float* m, float* out )
+{
+    float4 r0 = load(m), r1 = load(m + 4), r2 = load(m + 8), r3 = load(m + 12);
+    transpose(r0, r1, r2, r3);
+    store(out, r0);
+    store(out + 4, r1);
+    store(out + 8, r2);
+    store(out + 12, r3);
+}
+
+// 2x2 matrices, one per register as (m00, m01, m10, m11)
+
+// a * b
+inline float4 mul2x2( float4 a, float4 b )
+{
+    return add(mul(a, shuffle<0, 3, 0, 3>(b, b)), mul(shuffle<1, 0, 3, 2>(a, a), shuffle<2, 1, 2, 1>(b, b)));
+}
+
+// adjugate(a) * b
+inline float4 adjMul2x2( float4 a, float4 b )
+{
+    return sub(mul(shuffle<3, 3, 0, 0>(a, a), b), mul(shuffle<1, 1, 2, 2>(a, a), shuffle<2, 3, 0, 1>(b, b)));
+}
+
+// a * adjugate(b)
+inline float4 mulAdj2x2( float4 a, float4 b )
+{
+    return sub(mul(a, shuffle<3, 0, 3, 0>(b, b)), mul(shuffle<1, 0, 3, 2>(a, a), shuffle<2, 1, 2, 1>(b, b)));
+}
+
+// General inverse by 2x2 blocks
+//     | A B |-1                 | X Y |
+//     | C D |     = 1 / |M|  *  | Z W |
+// with X = adj(|D| A - B adj(D) C) and so on.  Returns the determinant;
+// out is not meaningful when it is 0.
+inline float inverse( const float* m, float* out )
+{
+    float4 r0 = load(m), r1 = load(m + 4), r2 = load(m + 8), r3 = load(m + 12);
+
+    float4 A = shuffle<0, 1, 0, 1>(r0, r1);
+    float4 B = shuffle<2, 3, 2, 3>(r0, r1);
+    float4 C = shuffle<0, 1, 0, 1>(r2, r3);
+    float4 D = shuffle<2, 3, 2, 3>(r2, r3);
+
+    // (|A|, |B|, |C|, |D|)
+    float4 detSub = sub(mul(shuffle<0, 2, 0, 2>(r0, r2), shuffle<1, 3, 1, 3>(r1, r3)),
+                        mul(shuffle<1, 3, 1, 3>(r0, r2), shuffle<0, 2, 0, 2>(r1, r3)));
+    float4 detA = lane<0>(detSub);
+    float4 detB = lane<1>(detSub);
+    float4 detC = lane<2>(detSub);
+    float4 detD = lane<3>(detSub);
+
+    float4 D_C = adjMul2x2(D, C);
+    float4 A_B = adjMul2x2(A, B);
+    float4 X_ = sub(mul(detD, A), mul2x2(B, D_C));
+    float4 W_ = sub(mul(detA, D), mul2x2(C, A_B));
+    float4 Y_ = sub(mul(detB, C), mulAdj2x2(D, A_B));
+    float4 Z_ = sub(mul(detC, B), mulAdj2x2(A, D_C));
+
+    // |M| = |A||D| + |B||C| - tr(adj(A) B adj(D) C)
+    float4 detM = add(mul(detA, detD), mul(detB, detC));
+    detM = sub(detM, sumLanes(mul(A_B, shuffle<0, 2, 1, 3>(D_C, D_C))));
+
+    float4 rDetM = div(set(1.0f, -1.0f, -1.0f, 1.0f), detM);
+    X_ = mul(X_, rDetM);
+    Y_ = mul(Y_, rDetM);
+    Z_ = mul(Z_, rDetM);
+    W_ = mul(W_, rDetM);
+
+    // the last adjugate and the block layout in one shuffle each
+    store(out, shuffle<3, 1, 3, 1>(X_, Y_));
+    store(out + 4, shuffle<2, 0, 2, 0>(X_, Y_));
+    store(out + 8, shuffle<3, 1, 3, 1>(Z_, W_));
+    store(out + 12, shuffle<2, 0, 2, 0>(Z_, W_));
+
+    ANGEL_ALIGN(16) float det[4];
+    store(det, detM);
+    return det[0];
+}
+
+// a x b in lanes 0..2, with lane 3 zero
+inline float4 cross( float4 a, float4 b )
+{
+    return sub(mul(shuffle<1, 2, 0, 3>(a, a), shuffle<2, 0, 1, 3>(b, b)),
+               mul(shuffle<2, 0, 1, 3>(a, a), shuffle<1, 2, 0, 3>(b, b)));
+}
+
+// Cofactors of m's upper 3x3 over its determinant, one row in each of
+// c0..c2 with lane 3 zero.  They are the rows of the inverse transpose,
+// the normal matrix, and the columns of the inverse.
+inline void inverseTranspose3( const float* m, float4& c0, float4& c1, float4& c2 )
+{
+    float4 r0 = load(m), r1 = load(m + 4), r2 = load(m + 8);
+    c0 = cross(r1, r2);
+    c1 = cross(r2, r0);
+    c2 = cross(r0, r1);
+
+    float4 rDet = div(splat(1.0f), sumLanes(mul(r0, c0)));
+    c0 = mul(c0, rDet);
+    c1 = mul(c1, rDet);
+    c2 = mul(c2, rDet);
+}
+
+// Inverse of an m whose last row is (0, 0, 0, 1): the 3x3 inverse, and
+// the translation taken back through it
+inline void affineInverse( const float* m, float* out )
+{
+    float4 c0, c1, c2;
+    inverseTranspose3(m, c0, c1, c2);
+
+    float4 t = mul(splat(m[3]), c0);
+    t = madd(splat(m[7]), c1, t);
+    t = madd(splat(m[11]), c2, t);
+    t = sub(splat(0.0f), t);
+
+    transpose(c0, c1, c2, t);
+    store(out, c0);
+    store(out + 4, c1);
+    store(out + 8, c2);
+    store(out + 12, set(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+// The normal matrix of m, its upper 3x3's inverse transpose, as three
+// rows of four floats with the fourth zero
+inline void normalMatrix( const float* m, float* out )
+{
+    float4 c0, c1, c2;
+    inverseTranspose3(m, c0, c1, c2);
+    store(out, c0);
+    store(out + 4, c1);
+    store(out + 8, c2);
+}
+
+//----------------------------------------------------------------------------
+//
+//  Batch transforms
+//
+//    Each output is m's columns weighted by the input's components, summed
+//    in the same order as the scalar mat4 * vec4, so without FMA the
+//    results match it exactly.  Arrays of vec4 are four floats per element with no
+//    alignment needed; SoA arrays are one float per element.  Outputs
+//    bigger than the caches can be written with streaming stores, which
+//    skip reading the destination in first.
+//
+
+// One vec4 against columns c0..c3; c3 is unused for normals
+template <bool normal>
+inline void transformVector( float4 c0, float4 c1, float4 c2, float4 c3, const float* in, float* out )
+{
+    float4 v = loadUnaligned(in);
+    float4 r = mul(lane<0>(v), c0);
+    r = madd(lane<1>(v), c1, r);
+    r = madd(lane<2>(v), c2, r);
+    if (normal)
+    {
+        float4 r2 = mul(r, r);
+        r = mul(r, div(splat(1.0f), sqrt(add(add(lane<0>(r2), lane<1>(r2)), lane<2>(r2)))));
+    }
+    else
+        r = madd(lane<3>(v), c3, r);
+    storeUnaligned(out, r);
+}
+
+// A register's worth of vec4s
+template <bool normal>
+inline floatN transformVectors( floatN c0, floatN c1, floatN c2, floatN c3, floatN v )
+{
+    floatN r = mulN(laneN<0>(v), c0);
+    r = maddN(laneN<1>(v), c1, r);
+    r = maddN(laneN<2>(v), c2, r);
+    if (normal)
+    {
+        floatN r2 = mulN(r, r);
+        return mulN(r, rsqrtN(addN(addN(laneN<0>(r2), laneN<1>(r2)), laneN<2>(r2))));
+    }
+    return maddN(laneN<3>(v), c3, r);
+}
+
+template <bool normal>
+inline floatN transformVectors( floatN c0, floatN c1, floatN c2, floatN c3, const float* in )
+{
+    return transformVectors<normal>(c0, c1, c2, c3, loadN(in));
+}
+
+template <bool normal>
+inline void transformVectors( const float* m, const float* in, float* out, int count, bool stream )
+{
+    ANGEL_ALIGN(16) float t[16];
+    transpose(m, t);
+    if (normal)
+        t[3] = t[7] = t[11] = 0.0f;
+    float4 d0 = load(t), d1 = load(t + 4), d2 = load(t + 8), d3 = load(t + 12);
+    floatN c0 = repeatN(t), c1 = repeatN(t + 4), c2 = repeatN(t + 8), c3 = repeatN(t + 12);
+
+    int i = 0;
+    // streaming stores need a destination aligned to the register
+    if (stream)
+        for (; i < count && ((size_t)(out + 4 * i) & (sizeof(floatN) - 1)) != 0; i++)
+            transformVector<normal>(d0, d1, d2, d3, in + 4 * i, out + 4 * i);
+
+    const int perRegister = LanesN / 4;
+    if (stream && ((size_t)(out + 4 * i) & (sizeof(floatN) - 1)) == 0)
+    {
+        for (; i + perRegister <= count; i += perRegister)
+            streamN(out + 4 * i, transformVectors<normal>(c0, c1, c2, c3, in + 4 * i));
+        streamFence();
+    }
+    else
+    {
+        for (; i + perRegister <= count; i += perRegister)
+            storeN(out + 4 * i, transformVectors<normal>(c0, c1, c2, c3, in + 4 * i));
+    }
+
+    for (; i < count; i++)
+        transformVector<normal>(d0, d1, d2, d3, in + 4 * i, out + 4 * i);
+}
+
+// out[i] = m * in[i]
+inline void transformPoints( const float* m, const float* in, float* out, int count, bool stream = false )
+{
+    transformVectors<false>(m, in, out, count, stream);
+}
+
+// firstOut[i] = a * in[i] and secondOut[i] = b * firstOut[i], in one pass:
+// the first result goes on to b from the register it was made in
+inline void transformPoints( const float* a, const float* b, const float* in,
+                             float* firstOut, float* secondOut, int count )
+{
+    ANGEL_ALIGN(16) float ta[16], tb[16];
+    transpose(a, ta);
+    transpose(b, tb);
+    float4 d0 = load(ta), d1 = load(ta + 4), d2 = load(ta + 8), d3 = load(ta + 12);
+    float4 e0 = load(tb), e1 = load(tb + 4), e2 = load(tb + 8), e3 = load(tb + 12);
+    floatN c0 = repeatN(ta), c1 = repeatN(ta + 4), c2 = repeatN(ta + 8), c3 = repeatN(ta + 12);
+    floatN f0 = repeatN(tb), f1 = repeatN(tb + 4), f2 = repeatN(tb + 8), f3 = repeatN(tb + 12);
+
+    const int perRegister = LanesN / 4;
+    int i = 0;
+    for (; i + perRegister <= count; i += perRegister)
+    {
+        floatN r = transformVectors<false>(c0, c1, c2, c3, in + 4 * i);
+        storeN(firstOut + 4 * i, r);
+        storeN(secondOut + 4 * i, transformVectors<false>(f0, f1, f2, f3, r));
+    }
+
+    for (; i < count; i++)
+    {
+        transformVector<false>(d0, d1, d2, d3, in + 4 * i, firstOut + 4 * i);
+        transformVector<false>(e0, e1, e2, e3, firstOut + 4 * i, secondOut + 4 * i);
+    }
+}
+
+// out[i] = the upper 3x3 of m times in[i]'s xyz, normalized, with w = 0
+inline void transformNormals( const float* m, const float* in, float* out, int count, bool stream = false )
+{
+    transformVectors<true>(m, in, out, count, stream);
+}
+
+// SoA points with w = 1: out = m * (x, y, z, 1).  outW may be NULL when m
+// is affine and w is known to stay 1.
+inline void transformPoints( const float* m, const float* x, const float* y, const float* z,
+                             float* outX, float* outY, float* outZ, float* outW, int count )
+{
+    floatN e[16];
+    for (int k = 0; k < 16; k++)
+        e[k] = splatN(m[k]);
+
+    int i = 0;
+    for (; i + LanesN <= count; i += LanesN)
+    {
+        floatN vx = loadN(x + i), vy = loadN(y + i), vz = loadN(z + i);
+        storeN(outX + i, addN(maddN(vz, e[2], maddN(vy, e[1], mulN(vx, e[0]))), e[3]));
+        storeN(outY + i, addN(maddN(vz, e[6], maddN(vy, e[5], mulN(vx, e[4]))), e[7]));
+        storeN(outZ + i, addN(maddN(vz, e[10], maddN(vy, e[9], mulN(vx, e[8]))), e[11]));
+        if (outW != NULL)
+            storeN(outW + i, addN(maddN(vz, e[14], maddN(vy, e[13], mulN(vx, e[12]))), e[15]));
+    }
+
+    for (; i < count; i++)
+    {
+        outX[i] = m[0]*x[i] + m[1]*y[i] + m[2]*z[i] + m[3];
+        outY[i] = m[4]*x[i] + m[5]*y[i] + m[6]*z[i] + m[7];
+        outZ[i] = m[8]*x[i] + m[9]*y[i] + m[10]*z[i] + m[11];
+        if (outW != NULL)
+            outW[i] = m[12]*x[i] + m[13]*y[i] + m[14]*z[i] + m[15];
+    }
+}
+
+// SoA normals: the upper 3x3 of m times (x, y, z), normalized
+inline void transformNormals( const float* m, const float* x, const float* y, const float* z,
+                              float* outX, float* outY, float* outZ, int count )
+{
+    floatN e[11];
+    for (int k = 0; k < 11; k++)
+        e[k] = splatN(m[k]);
+
+    int i = 0;
+    for (; i + LanesN <= count; i += LanesN)
+    {
+        floatN vx = loadN(x + i), vy = loadN(y + i), vz = loadN(z + i);
+        floatN nx = maddN(vz, e[2], maddN(vy, e[1], mulN(vx, e[0])));
+        floatN ny = maddN(vz, e[6], maddN(vy, e[5], mulN(vx, e[4])));
+        floatN nz = maddN(vz, e[10], maddN(vy, e[9], mulN(vx, e[8])));
+        floatN scale = rsqrtN(maddN(nz, nz, maddN(ny, ny, mulN(nx, nx))));
+        storeN(outX + i, mulN(nx, scale));
+        storeN(outY + i, mulN(ny, scale));
+        storeN(outZ + i, mulN(nz, scale));
+    }
+
+    for (; i < count; i++)
+    {
+        float nx = m[0]*x[i] + m[1]*y[i] + m[2]*z[i];
+        float ny = m[4]*x[i] + m[5]*y[i] + m[6]*z[i];
+        float nz = m[8]*x[i] + m[9]*y[i] + m[10]*z[i];
+        float scale = 1.0f / sqrtf(nx*nx + ny*ny + nz*nz);
+        outX[i] = nx * scale;
+        outY[i] = ny * scale;
+        outZ[i] = nz * scale;
+    }
+}
+
+//----------------------------------------------------------------------------
+//
+//  Quaternions, stored (x, y, z, w)
+//
+
+// Hamilton product a * b
+inline void quatMultiply( const float* a, const float* b, float* out )
+{
+    float4 qa = load(a), qb = load(b);
+    float4 r = mul(lane<3>(qa), qb);
+    r = madd(lane<0>(qa), mul(shuffle<3, 2, 1, 0>(qb, qb), set(1.0f, -1.0f, 1.0f, -1.0f)), r);
+    r = madd(lane<1>(qa), mul(shuffle<2, 3, 0, 1>(qb, qb), set(1.0f, 1.0f, -1.0f, -1.0f)), r);
+    r = madd(lane<2>(qa), mul(shuffle<1, 0, 3, 2>(qb, qb), set(-1.0f, 1.0f, 1.0f, -1.0f)), r);
+    store(out, r);
+}
+
+// v / |v| over all four lanes
+inline void normalize( const float* v, float* out )
+{
+    float4 a = load(v);
+    store(out, mul(a, div(splat(1.0f), sqrt(sumLanes(mul(a, a))))));
+}
+
+//----------------------------------------------------------------------------
+//
+//  Composed object transforms, four at a time
+//
+
+// LookAtTRS in quat.h for four objects.  in is 19 registers with a lane
+// per object: eye x, y, z, at x, y, z, up x, y, z, orientation x, y, z, w,
+// translate x, y, z and scale x, y, z.  out is the four mat4s.
+inline void lookAtTRS4( const float4* in, float* out )
+{
+    const float4* eye = in;
+    const float4* at = in + 3;
+    const float4* up = in + 6;
+    const float4* q = in + 9;
+    const float4* translate = in + 13;
+    const float4* scale = in + 16;
+    const float4 one = splat(1.0f);
+
+    // view basis
+    float4 n[3] = { sub(eye[0], at[0]), sub(eye[1], at[1]), sub(eye[2], at[2]) };
+    float4 len = div(one, sqrt(madd(n[0], n[0], madd(n[1], n[1], mul(n[2], n[2])))));
+    for (int k = 0; k < 3; k++)
+        n[k] = mul(n[k], len);
+
+    float4 u[3] = { sub(mul(up[1], n[2]), mul(up[2], n[1])),
+                    sub(mul(up[2], n[0]), mul(up[0], n[2])),
+                    sub(mul(up[0], n[1]), mul(up[1], n[0])) };
+    len = div(one, sqrt(madd(u[0], u[0], madd(u[1], u[1], mul(u[2], u[2])))));
+    for (int k = 0; k < 3; k++)
+        u[k] = mul(u[k], len);
+
+    float4 v[3] = { sub(mul(n[1], u[2]), mul(n[2], u[1])),
+                    sub(mul(n[2], u[0]), mul(n[0], u[2])),
+                    sub(mul(n[0], u[1]), mul(n[1], u[0])) };
+
+    // the orientation's rotation matrix, as Rotate(quat) builds it
+    float4 x2 = add(q[0], q[0]), y2 = add(q[1], q[1]), z2 = add(q[2], q[2]);
+    float4 xx = mul(q[0], x2), yy = mul(q[1], y2), zz = mul(q[2], z2);
+    float4 xy = mul(q[0], y2), xz = mul(q[0], z2), yz = mul(q[1], z2);
+    float4 wx = mul(q[3], x2), wy = mul(q[3], y2), wz = mul(q[3], z2);
+    float4 r[3][3] = {
+        { sub(one, add(yy, zz)), sub(xy, wz), add(xz, wy) },
+        { add(xy, wz), sub(one, add(xx, zz)), sub(yz, wx) },
+        { sub(xz, wy), add(yz, wx), sub(one, add(xx, yy)) } };
+
+    float4 p[3];
+    for (int k = 0; k < 3; k++)
+        p[k] = sub(madd(r[k][0], translate[0], madd(r[k][1], translate[1], mul(r[k][2], translate[2]))), eye[k]);
+
+    const float4* basis[3] = { u, v, n };
+    float4 rows[3][4];
+    for (int i = 0; i < 3; i++)
+    {
+        const float4* b = basis[i];
+        for (int j = 0; j < 3; j++)
+            rows[i][j] = mul(madd(b[0], r[0][j], madd(b[1], r[1][j], mul(b[2], r[2][j]))), scale[j]);
+        rows[i][3] = madd(b[0], p[0], madd(b[1], p[1], mul(b[2], p[2])));
+
+        // lanes are objects; transposed, they are the objects' row i
+        transpose(rows[i][0], rows[i][1], rows[i][2], rows[i][3]);
+    }
+
+    float4 last = set(0.0f, 0.0f, 0.0f, 1.0f);
+    for (int o = 0; o < 4; o++)
+    {
+        store(out + 16 * o, rows[0][o]);
+        store(out + 16 * o + 4, rows[1][o]);
+        store(out + 16 * o + 8, rows[2][o]);
+        store(out + 16 * o + 12, last);
+    }
+}
+
+}  // namespace simd
+}  // namespace Angel
+
+#endif // ANGEL_SIMD
+
+#endif // __ANGEL_SIMD_H__
@@ -2,455 +2,354 @@
 //
 //  --- vec.h ---
 //
+//   tvec<N, T> is an N-component vector of scalars of type T.  vec2, vec3
+//   and vec4 are the float ones; dvec holds doubles, hvec halves (half.h)
+//   for compact bulk storage, and vec3x4/vec4x4 a SIMD register per
+//   component, four vectors to a register.  Vectors of one size convert to
+//   each other's scalar types implicitly.
+//
+//   The arithmetic is written once for every size and scalar type, and is
+//   constexpr, so constant vectors can be built at compile time.
+//
 //////////////////////////////////////////////////////////////////////////////
 
 #ifndef __ANGEL_VEC_H__
 #define __ANGEL_VEC_H__
 
 #include "Angel.h"
+#include "simd.h"
+#include "half.h"
 
 namespace Angel {
 
-//////////////////////////////////////////////////////////////////////////////
+//----------------------------------------------------------------------------
 //
-//  vec2.h - 2D vector
+//  Scalars the templates take, and the few things the arithmetic needs
+//  from each
 //
 
-struct vec2 {
-
-    GLfloat  x;
-    GLfloat  y;
-
-    //
-    //  --- Constructors and Destructors ---
-    //
+template <typename T>
+struct scalar_traits {
+    static constexpr T one() { return T(1.0); }
+    static T sqrt( const T s ) { return std::sqrt( s ); }
+    static constexpr bool nearZero( const T s ) { return ( s < T(0.0) ? -s : s ) < DivideByZeroTolerance; }
+};
 
-    vec2( GLfloat s = GLfloat(0.0) ) :
-	x(s), y(s) {}
+#ifdef ANGEL_SIMD_LANES
+template <>
+struct scalar_traits<simd::lanes4> {
+    static simd::lanes4 one() { return simd::splat( 1.0f ); }
+    static simd::lanes4 sqrt( const simd::lanes4 s ) { return simd::sqrt( s ); }
+    static bool nearZero( const simd::lanes4 ) { return false; }
+};
+#endif
 
-    vec2( GLfloat x, GLfloat y ) :
-	x(x), y(y) {}
+template <int N, typename T> struct tvec;
 
-    vec2( const vec2& v )
-	{ x = v.x;  y = v.y;  }
+//----------------------------------------------------------------------------
+//
+//  tvec_operators - the arithmetic every tvec<N, T> shares.  The
+//    operators are friends of the vector type, so they convert their
+//    arguments the way member operators would: a vec3 added to a vec4
+//    becomes a point, and a scalar becomes a vector of it.
+//
 
-    //
-    //  --- Indexing Operator ---
-    //
+template <int N, typename T>
+struct tvec_operators {
 
-    GLfloat& operator [] ( int i ) { return *(&x + i); }
-    const GLfloat operator [] ( int i ) const { return *(&x + i); }
+    typedef tvec<N, T>  V;
 
     //
     //  --- (non-modifying) Arithematic Operators ---
     //
 
-    vec2 operator - () const // unary minus operator
-	{ return vec2( -x, -y ); }
+    friend constexpr V operator - ( const V& v ) {  // unary minus operator
+	V r;
+	for ( int i = 0; i < N; ++i ) r[i] = -v[i];
+	return r;
+    }
 
-    vec2 operator + ( const vec2& v ) const
-	{ return vec2( x + v.x, y + v.y ); }
+    friend constexpr V operator + ( const V& u, const V& v ) {
+	V r;
+	for ( int i = 0; i < N; ++i ) r[i] = u[i] + v[i];
+	return r;
+    }
 
-    vec2 operator - ( const vec2& v ) const
-	{ return vec2( x - v.x, y - v.y ); }
+    friend constexpr V operator - ( const V& u, const V& v ) {
+	V r;
+	for ( int i = 0; i < N; ++i ) r[i] = u[i] - v[i];
+	return r;
+    }
 
-    vec2 operator * ( const GLfloat s ) const
-	{ return vec2( s*x, s*y ); }
+    friend constexpr V operator * ( const V& v, const T s ) {
+	V r;
+	for ( int i = 0; i < N; ++i ) r[i] = s * v[i];
+	return r;
+    }
 
-    vec2 operator * ( const vec2& v ) const
-	{ return vec2( x*v.x, y*v.y ); }
+    friend constexpr V operator * ( const V& u, const V& v ) {
+	V r;
+	for ( int i = 0; i < N; ++i ) r[i] = u[i] * v[i];
+	return r;
+    }
 
-    friend vec2 operator * ( const GLfloat s, const vec2& v )
+    friend constexpr V operator * ( const T s, const V& v )
 	{ return v * s; }
 
-    vec2 operator / ( const GLfloat s ) const {
+    friend constexpr V operator / ( const V& v, const T s ) {
 #ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
+	if ( scalar_traits<T>::nearZero(s) ) {
 	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
 		      << "Division by zero" << std::endl;
-	    return vec2();
+	    return V();
 	}
 #endif // DEBUG
 
-	GLfloat r = GLfloat(1.0) / s;
-	return *this * r;
+	T r = scalar_traits<T>::one() / s;
+	return v * r;
     }
 
     //
     //  --- (modifying) Arithematic Operators ---
     //
 
-    vec2& operator += ( const vec2& v )
-	{ x += v.x;  y += v.y;   return *this; }
+    friend constexpr V& operator += ( V& u, const V& v )
+	{ return u = u + v; }
 
-    vec2& operator -= ( const vec2& v )
-	{ x -= v.x;  y -= v.y;  return *this; }
+    friend constexpr V& operator -= ( V& u, const V& v )
+	{ return u = u - v; }
 
-    vec2& operator *= ( const GLfloat s )
-	{ x *= s;  y *= s;   return *this; }
+    friend constexpr V& operator *= ( V& v, const T s )
+	{ return v = v * s; }
 
-    vec2& operator *= ( const vec2& v )
-	{ x *= v.x;  y *= v.y; return *this; }
+    friend constexpr V& operator *= ( V& u, const V& v )
+	{ return u = u * v; }
 
-    vec2& operator /= ( const GLfloat s ) {
-#ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
-	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
-		      << "Division by zero" << std::endl;
-	}
-#endif // DEBUG
-
-	GLfloat r = GLfloat(1.0) / s;
-	*this *= r;
+    friend constexpr V& operator /= ( V& v, const T s )
+	{ return v = v / s; }
 
-	return *this;
-    }
-	
     //
     //  --- Insertion and Extraction Operators ---
     //
 
-    friend std::ostream& operator << ( std::ostream& os, const vec2& v ) {
-	return os << "( " << v.x << ", " << v.y <<  " )";
+    friend std::ostream& operator << ( std::ostream& os, const V& v ) {
+	os << "( ";
+	for ( int i = 0; i < N; ++i )
+	    os << v[i] << ( i + 1 < N ? ", " : " )" );
+	return os;
     }
 
-    friend std::istream& operator >> ( std::istream& is, vec2& v )
-	{ return is >> v.x >> v.y ; }
+    friend std::istream& operator >> ( std::istream& is, V& v ) {
+	for ( int i = 0; i < N; ++i ) is >> v[i];
+	return is;
+    }
 
     //
     //  --- Conversion Operators ---
     //
 
-    operator const GLfloat* () const
-	{ return static_cast<const GLfloat*>( &x ); }
+    operator const T* () const
+	{ return &static_cast<const V*>( this )->x; }
 
-    operator GLfloat* ()
-	{ return static_cast<GLfloat*>( &x ); }
+    operator T* ()
+	{ return &static_cast<V*>( this )->x; }
 };
 
-//----------------------------------------------------------------------------
-//
-//  Non-class vec2 Methods
-//
-
-inline
-GLfloat dot( const vec2& u, const vec2& v ) {
-    return u.x * v.x + u.y * v.y;
-}
-
-inline
-GLfloat length( const vec2& v ) {
-    return std::sqrt( dot(v,v) );
-}
-
-inline
-vec2 normalize( const vec2& v ) {
-    return v / length(v);
-}
-
 //////////////////////////////////////////////////////////////////////////////
 //
-//  vec3.h - 3D vector
+//  tvec<2, T> - 2D vector
 //
-//////////////////////////////////////////////////////////////////////////////
 
-struct vec3 {
+template <typename T>
+struct tvec<2, T> : tvec_operators<2, T> {
 
-    GLfloat  x;
-    GLfloat  y;
-    GLfloat  z;
+    T  x;
+    T  y;
 
     //
     //  --- Constructors and Destructors ---
     //
 
-    vec3( GLfloat s = GLfloat(0.0) ) :
-	x(s), y(s), z(s) {}
-
-    vec3( GLfloat x, GLfloat y, GLfloat z ) :
-	x(x), y(y), z(z) {}
+    constexpr tvec( const T s = T() ) :
+	x(s), y(s) {}
 
-    vec3( const vec3& v ) { x = v.x;  y = v.y;  z = v.z; }
+    constexpr tvec( const T x, const T y ) :
+	x(x), y(y) {}
 
-    vec3( const vec2& v, const float f ) { x = v.x;  y = v.y;  z = f; }
+    template <typename U>
+    constexpr tvec( const tvec<2, U>& v ) :
+	x(v.x), y(v.y) {}
 
     //
     //  --- Indexing Operator ---
     //
-
-    GLfloat& operator [] ( int i ) { return *(&x + i); }
-    const GLfloat operator [] ( int i ) const { return *(&x + i); }
-
-    //
-    //  --- (non-modifying) Arithematic Operators ---
+    //    Pointer arithmetic at run time; compile time can only name members.
     //
 
-    vec3 operator - () const  // unary minus operator
-	{ return vec3( -x, -y, -z ); }
-
-    vec3 operator + ( const vec3& v ) const
-	{ return vec3( x + v.x, y + v.y, z + v.z ); }
-
-    vec3 operator - ( const vec3& v ) const
-	{ return vec3( x - v.x, y - v.y, z - v.z ); }
-
-    vec3 operator * ( const GLfloat s ) const
-	{ return vec3( s*x, s*y, s*z ); }
-
-    vec3 operator * ( const vec3& v ) const
-	{ return vec3( x*v.x, y*v.y, z*v.z ); }
+    constexpr T& operator [] ( int i )
+	{ return ANGEL_CONSTANT_EVALUATED() ? ( i == 0 ? x : y ) : *(&x + i); }
+    constexpr const T operator [] ( int i ) const
+	{ return ANGEL_CONSTANT_EVALUATED() ? ( i == 0 ? x : y ) : *(&x + i); }
+};
 
-    friend vec3 operator * ( const GLfloat s, const vec3& v )
-	{ return v * s; }
+//////////////////////////////////////////////////////////////////////////////
+//
+//  tvec<3, T> - 3D vector
+//
+//////////////////////////////////////////////////////////////////////////////
 
-    vec3 operator / ( const GLfloat s ) const {
-#ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
-	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
-		      << "Division by zero" << std::endl;
-	    return vec3();
-	}
-#endif // DEBUG
+template <typename T>
+struct tvec<3, T> : tvec_operators<3, T> {
 
-	GLfloat r = GLfloat(1.0) / s;
-	return *this * r;
-    }
+    T  x;
+    T  y;
+    T  z;
 
     //
-    //  --- (modifying) Arithematic Operators ---
+    //  --- Constructors and Destructors ---
     //
 
-    vec3& operator += ( const vec3& v )
-	{ x += v.x;  y += v.y;  z += v.z;  return *this; }
-
-    vec3& operator -= ( const vec3& v )
-	{ x -= v.x;  y -= v.y;  z -= v.z;  return *this; }
-
-    vec3& operator *= ( const GLfloat s )
-	{ x *= s;  y *= s;  z *= s;  return *this; }
-
-    vec3& operator *= ( const vec3& v )
-	{ x *= v.x;  y *= v.y;  z *= v.z;  return *this; }
-
-    vec3& operator /= ( const GLfloat s ) {
-#ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
-	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
-		      << "Division by zero" << std::endl;
-	}
-#endif // DEBUG
-
-	GLfloat r = GLfloat(1.0) / s;
-	*this *= r;
+    constexpr tvec( const T s = T() ) :
+	x(s), y(s), z(s) {}
 
-	return *this;
-    }
-	
-    //
-    //  --- Insertion and Extraction Operators ---
-    //
+    constexpr tvec( const T x, const T y, const T z ) :
+	x(x), y(y), z(z) {}
 
-    friend std::ostream& operator << ( std::ostream& os, const vec3& v ) {
-	return os << "( " << v.x << ", " << v.y << ", " << v.z <<  " )";
-    }
+    constexpr tvec( const tvec<2, T>& v, const T f ) :
+	x(v.x), y(v.y), z(f) {}
 
-    friend std::istream& operator >> ( std::istream& is, vec3& v )
-	{ return is >> v.x >> v.y >> v.z ; }
+    template <typename U>
+    constexpr tvec( const tvec<3, U>& v ) :
+	x(v.x), y(v.y), z(v.z) {}
 
     //
-    //  --- Conversion Operators ---
+    //  --- Indexing Operator ---
     //
 
-    operator const GLfloat* () const
-	{ return static_cast<const GLfloat*>( &x ); }
-
-    operator GLfloat* ()
-	{ return static_cast<GLfloat*>( &x ); }
+    constexpr T& operator [] ( int i )
+	{ return ANGEL_CONSTANT_EVALUATED() ? ( i == 0 ? x : i == 1 ? y : z ) : *(&x + i); }
+    constexpr const T operator [] ( int i ) const
+	{ return ANGEL_CONSTANT_EVALUATED() ? ( i == 0 ? x : i == 1 ? y : z ) : *(&x + i); }
 };
 
-//----------------------------------------------------------------------------
-//
-//  Non-class vec3 Methods
-//
-
-inline
-GLfloat dot( const vec3& u, const vec3& v ) {
-    return u.x*v.x + u.y*v.y + u.z*v.z ;
-}
-
-inline
-GLfloat length( const vec3& v ) {
-    return std::sqrt( dot(v,v) );
-}
-
-inline
-vec3 normalize( const vec3& v ) {
-    return v / length(v);
-}
-
-inline
-vec3 cross(const vec3& a, const vec3& b )
-{
-    return vec3( a.y * b.z - a.z * b.y,
-		 a.z * b.x - a.x * b.z,
-		 a.x * b.y - a.y * b.x );
-}
-
-
 //////////////////////////////////////////////////////////////////////////////
 //
-//  vec4 - 4D vector
+//  tvec<4, T> - 4D vector
 //
 //////////////////////////////////////////////////////////////////////////////
 
-struct vec4 {
+// Four floats are 16-byte aligned so the mat4 kernels in simd.h can load
+// rows directly; other scalars keep their own alignment
+template <typename T>
+struct tvec4_alignment {
+    enum { value = sizeof(T) == 4 ? 16 : alignof(T) };
+};
+
+template <typename T>
+struct alignas(tvec4_alignment<T>::value) tvec<4, T> : tvec_operators<4, T> {
 
-    GLfloat  x;
-    GLfloat  y;
-    GLfloat  z;
-    GLfloat  w;
+    T  x;
+    T  y;
+    T  z;
+    T  w;
 
     //
     //  --- Constructors and Destructors ---
     //
 
-    vec4( GLfloat s = GLfloat(0.0) ) :
+    constexpr tvec( const T s = T() ) :
 	x(s), y(s), z(s), w(s) {}
 
-    vec4( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) :
+    constexpr tvec( const T x, const T y, const T z, const T w ) :
 	x(x), y(y), z(z), w(w) {}
 
-    vec4( const vec4& v ) { x = v.x;  y = v.y;  z = v.z;  w = v.w; }
+    constexpr tvec( const tvec<3, T>& v, const T w = scalar_traits<T>::one() ) :
+	x(v.x), y(v.y), z(v.z), w(w) {}
 
-    vec4( const vec3& v, const float w = 1.0 ) : w(w)
-	{ x = v.x;  y = v.y;  z = v.z; }
+    constexpr tvec( const tvec<2, T>& v, const T z, const T w ) :
+	x(v.x), y(v.y), z(z), w(w) {}
 
-    vec4( const vec2& v, const float z, const float w ) : z(z), w(w)
-	{ x = v.x;  y = v.y; }
+    template <typename U>
+    constexpr tvec( const tvec<4, U>& v ) :
+	x(v.x), y(v.y), z(v.z), w(v.w) {}
 
     //
     //  --- Indexing Operator ---
     //
 
-    GLfloat& operator [] ( int i ) { return *(&x + i); }
-    const GLfloat operator [] ( int i ) const { return *(&x + i); }
-
-    //
-    //  --- (non-modifying) Arithematic Operators ---
-    //
-
-    vec4 operator - () const  // unary minus operator
-	{ return vec4( -x, -y, -z, -w ); }
-
-    vec4 operator + ( const vec4& v ) const
-	{ return vec4( x + v.x, y + v.y, z + v.z, w + v.w ); }
-
-    vec4 operator - ( const vec4& v ) const
-	{ return vec4( x - v.x, y - v.y, z - v.z, w - v.w ); }
-
-    vec4 operator * ( const GLfloat s ) const
-	{ return vec4( s*x, s*y, s*z, s*w ); }
-
-    vec4 operator * ( const vec4& v ) const
-	{ return vec4( x*v.x, y*v.y, z*v.z, w*v.z ); }
-
-    friend vec4 operator * ( const GLfloat s, const vec4& v )
-	{ return v * s; }
-
-    vec4 operator / ( const GLfloat s ) const {
-#ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
-	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
-		      << "Division by zero" << std::endl;
-	    return vec4();
-	}
-#endif // DEBUG
-
-	GLfloat r = GLfloat(1.0) / s;
-	return *this * r;
-    }
-
-    //
-    //  --- (modifying) Arithematic Operators ---
-    //
-
-    vec4& operator += ( const vec4& v )
-	{ x += v.x;  y += v.y;  z += v.z;  w += v.w;  return *this; }
-
-    vec4& operator -= ( const vec4& v )
-	{ x -= v.x;  y -= v.y;  z -= v.z;  w -= v.w;  return *this; }
-
-    vec4& operator *= ( const GLfloat s )
-	{ x *= s;  y *= s;  z *= s;  w *= s;  return *this; }
-
-    vec4& operator *= ( const vec4& v )
-	{ x *= v.x, y *= v.y, z *= v.z, w *= v.w;  return *this; }
-
-    vec4& operator /= ( const GLfloat s ) {
-#ifdef DEBUG
-	if ( std::fabs(s) < DivideByZeroTolerance ) {
-	    std::cerr << "[" << __FILE__ << ":" << __LINE__ << "] "
-		      << "Division by zero" << std::endl;
-	}
-#endif // DEBUG
-
-	GLfloat r = GLfloat(1.0) / s;
-	*this *= r;
-
-	return *this;
-    }
-	
-    //
-    //  --- Insertion and Extraction Operators ---
-    //
-
-    friend std::ostream& operator << ( std::ostream& os, const vec4& v ) {
-	return os << "( " << v.x << ", " << v.y
-		  << ", " << v.z << ", " << v.w << " )";
-    }
-
-    friend std::istream& operator >> ( std::istream& is, vec4& v )
-	{ return is >> v.x >> v.y >> v.z >> v.w; }
-
-    //
-    //  --- Conversion Operators ---
-    //
-
-    operator const GLfloat* () const
-	{ return static_cast<const GLfloat*>( &x ); }
-
-    operator GLfloat* ()
-	{ return static_cast<GLfloat*>( &x ); }
+    constexpr T& operator [] ( int i )
+	{ return ANGEL_CONSTANT_EVALUATED() ? ( i == 0 ? x : i == 1 ? y : i == 2 ? z : w ) : *(&x + i); }
+    constexpr const T operator [] ( int i ) const
+	{ return ANGEL_CONSTANT_EVALUATED() ? ( i == 0 ? x : i == 1 ? y : i == 2 ? z : w ) : *(&x + i); }
 };
 
 //----------------------------------------------------------------------------
 //
-//  Non-class vec4 Methods
+//  Non-class tvec Methods
 //
 
-inline
-GLfloat dot( const vec4& u, const vec4& v ) {
-    return u.x*v.x + u.y*v.y + u.z*v.z + u.w+v.w;
+template <int N, typename T>
+inline constexpr
+T dot( const tvec<N, T>& u, const tvec<N, T>& v ) {
+    T s = u[0] * v[0];
+    for ( int i = 1; i < N; ++i ) s = s + u[i] * v[i];
+    return s;
 }
 
+template <int N, typename T>
 inline
-GLfloat length( const vec4& v ) {
-    return std::sqrt( dot(v,v) );
+T length( const tvec<N, T>& v ) {
+    return scalar_traits<T>::sqrt( dot(v,v) );
 }
 
+template <int N, typename T>
 inline
-vec4 normalize( const vec4& v ) {
+tvec<N, T> normalize( const tvec<N, T>& v ) {
     return v / length(v);
 }
 
-inline
-vec3 cross(const vec4& a, const vec4& b )
+template <typename T>
+inline constexpr
+tvec<3, T> cross( const tvec<3, T>& a, const tvec<3, T>& b )
 {
-    return vec3( a.y * b.z - a.z * b.y,
-		 a.z * b.x - a.x * b.z,
-		 a.x * b.y - a.y * b.x );
+    return tvec<3, T>( a.y * b.z - a.z * b.y,
+		       a.z * b.x - a.x * b.z,
+		       a.x * b.y - a.y * b.x );
 }
 
+// the cross product of the xyz parts
+template <typename T>
+inline constexpr
+tvec<3, T> cross( const tvec<4, T>& a, const tvec<4, T>& b )
+{
+    return tvec<3, T>( a.y * b.z - a.z * b.y,
+		       a.z * b.x - a.x * b.z,
+		       a.x * b.y - a.y * b.x );
+}
+
+//----------------------------------------------------------------------------
+//
+//  Vector types
+//
+
+typedef tvec<2, GLfloat>   vec2;
+typedef tvec<3, GLfloat>   vec3;
+typedef tvec<4, GLfloat>   vec4;
+
+typedef tvec<2, GLdouble>  dvec2;
+typedef tvec<3, GLdouble>  dvec3;
+typedef tvec<4, GLdouble>  dvec4;
+
+typedef tvec<2, half>      hvec2;
+typedef tvec<3, half>      hvec3;
+typedef tvec<4, half>      hvec4;
+
+#ifdef ANGEL_SIMD_LANES
+// lane i of each component is vector i
+typedef tvec<3, simd::lanes4>  vec3x4;
+typedef tvec<4, simd::lanes4>  vec4x4;
+#endif
+
 //----------------------------------------------------------------------------
 
 }  // namespace Angel
@@ -4,6 +4,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include <sys/stat.h>
 
 namespace Angel
 {
@@ -25,10 +29,141 @@ namespace Angel
         return buf;
     }
 
+//----------------------------------------------------------------------------
+//
+//  Program binary cache
+//
+//    A linked program is saved with glGetProgramBinary under a key built
+//    from the shader sources and the GL_RENDERER/GL_VERSION strings, and is
+//    reloaded with glProgramBinary on later runs.  The driver may reject a
+//    binary at any time (driver update, different GPU), in which case we
+//    quietly fall back to compiling from source.  Set ANGEL_NO_SHADER_CACHE
+//    in the environment to always compile, e.g. to time the difference.
+//
+
+    static const char*   ShaderCacheDir = "shadercache";
+    static const GLuint  ShaderCacheMagic = 0x42505341;  // "ASPB"
+
+    struct ProgramBinaryHeader {
+        GLuint  magic;
+        GLenum  format;
+        GLint   length;
+    };
+
+    // 64-bit FNV-1a, good enough to key cache files
+    static unsigned long long hashString(const char* s, unsigned long long h)
+    {
+        for ( ; s != NULL && *s; ++s) {
+            h ^= (unsigned char) *s;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    static bool programCacheEnabled()
+    {
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+        if (getenv("ANGEL_NO_SHADER_CACHE") != NULL) {
+            return false;
+        }
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        while (glGetError() != GL_NO_ERROR)
+            ;  // pre-4.1 contexts without the extension reject the enum
+        return formats > 0;
+#else
+        return false;
+#endif
+    }
+
+    static std::string programCachePath(const char* vSource, const char* fSource)
+    {
+        unsigned long long h = 14695981039346656037ULL;
+        h = hashString(vSource, h);
+        h = hashString("\n--fragment--\n", h);
+        h = hashString(fSource, h);
+        h = hashString((const char*) glGetString(GL_VENDOR), h);
+        h = hashString((const char*) glGetString(GL_RENDERER), h);
+        h = hashString((const char*) glGetString(GL_VERSION), h);
+
+        char name[64];
+        snprintf(name, sizeof(name), "/%016llx.bin", h);
+        return std::string(ShaderCacheDir) + name;
+    }
+
+    // Returns a linked program, or 0 if there is no usable cached binary
+    static GLuint loadCachedProgram(const std::string& path)
+    {
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (fp == NULL) {
+            return 0;
+        }
+        ProgramBinaryHeader header;
+        char* binary = NULL;
+        if (fread(&header, sizeof(header), 1, fp) == 1 &&
+            header.magic == ShaderCacheMagic && header.length > 0) {
+            binary = new char[header.length];
+            if (fread(binary, 1, header.length, fp) != (size_t) header.length) {
+                delete [] binary;
+                binary = NULL;
+            }
+        }
+        fclose(fp);
+        if (binary == NULL) {
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.format, binary, header.length);
+        delete [] binary;
+
+        GLint linked;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            // stale or foreign binary; drop it so we rewrite it below
+            while (glGetError() != GL_NO_ERROR)
+                ;
+            glDeleteProgram(program);
+            remove(path.c_str());
+            return 0;
+        }
+        return program;
+#else
+        return 0;
+#endif
+    }
+
+    static void saveCachedProgram(GLuint program, const std::string& path)
+    {
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+        ProgramBinaryHeader header;
+        header.magic = ShaderCacheMagic;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+        if (header.length <= 0) {
+            return;
+        }
+        char* binary = new char[header.length];
+        glGetProgramBinary(program, header.length, NULL, &header.format, binary);
+
+        mkdir(ShaderCacheDir, 0755);
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (fp != NULL) {
+            fwrite(&header, sizeof(header), 1, fp);
+            fwrite(binary, 1, header.length, fp);
+            fclose(fp);
+        }
+        delete [] binary;
+#endif
+    }
+
+//----------------------------------------------------------------------------
 
 // Create a GLSL program object from vertex and fragment shader files
     GLuint InitShader(const char* vShaderFile, const char* fShaderFile)
     {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
         struct Shader {
             const char*  filename;
             GLenum       type;
@@ -37,7 +172,6 @@ namespace Angel
             { vShaderFile, GL_VERTEX_SHADER, NULL },
             { fShaderFile, GL_FRAGMENT_SHADER, NULL }
         };
-        GLuint program = glCreateProgram();
         for (int i = 0; i < 2; ++i) {
             Shader& s = shaders[i];
             s.source = readShaderSource(s.filename);
@@ -45,38 +179,69 @@ namespace Angel
                 std::cerr << "Failed to read " << s.filename << std::endl;
                 exit(EXIT_FAILURE);
             }
-            GLuint shader = glCreateShader(s.type);
-            glShaderSource(shader, 1, (const GLchar**) &s.source, NULL);
-            glCompileShader(shader);
-            GLint  compiled;
-            glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-            if (!compiled) {
-                std::cerr << s.filename << " failed to compile:" << std::endl;
+        }
+
+        bool useCache = programCacheEnabled();
+        std::string cachePath;
+        GLuint program = 0;
+        if (useCache) {
+            cachePath = programCachePath(shaders[0].source, shaders[1].source);
+            program = loadCachedProgram(cachePath);
+        }
+        bool fromCache = program != 0;
+
+        if (!fromCache) {
+            program = glCreateProgram();
+            for (int i = 0; i < 2; ++i) {
+                Shader& s = shaders[i];
+                GLuint shader = glCreateShader(s.type);
+                glShaderSource(shader, 1, (const GLchar**) &s.source, NULL);
+                glCompileShader(shader);
+                GLint  compiled;
+                glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+                if (!compiled) {
+                    std::cerr << s.filename << " failed to compile:" << std::endl;
+                    GLint  logSize;
+                    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logSize);
+                    char* logMsg = new char[logSize];
+                    glGetShaderInfoLog(shader, logSize, NULL, logMsg);
+                    std::cerr << logMsg << std::endl;
+                    delete [] logMsg;
+                    exit(EXIT_FAILURE);
+                }
+                glAttachShader(program, shader);
+            }
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+            if (useCache) {
+                glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            }
+#endif
+            /* link  and error check */
+            glLinkProgram(program);
+            GLint  linked;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            if (!linked) {
+                std::cerr << "Shader program failed to link" << std::endl;
                 GLint  logSize;
-                glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logSize);
+                glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logSize);
                 char* logMsg = new char[logSize];
-                glGetShaderInfoLog(shader, logSize, NULL, logMsg);
+                glGetProgramInfoLog(program, logSize, NULL, logMsg);
                 std::cerr << logMsg << std::endl;
                 delete [] logMsg;
                 exit(EXIT_FAILURE);
             }
-            delete [] s.source;
-            glAttachShader(program, shader);
-        }
-        /* link  and error check */
-        glLinkProgram(program);
-        GLint  linked;
-        glGetProgramiv(program, GL_LINK_STATUS, &linked);
-        if (!linked) {
-            std::cerr << "Shader program failed to link" << std::endl;
-            GLint  logSize;
-            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logSize);
-            char* logMsg = new char[logSize];
-            glGetProgramInfoLog(program, logSize, NULL, logMsg);
-            std::cerr << logMsg << std::endl;
-            delete [] logMsg;
-            exit(EXIT_FAILURE);
+            if (useCache) {
+                saveCachedProgram(program, cachePath);
+            }
         }
+        delete [] shaders[0].source;
+        delete [] shaders[1].source;
+
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "InitShader: %s + %s %s in %.2f ms\n", vShaderFile, fShaderFile,
+                fromCache ? "loaded from cache" : "compiled", ms);
+
         /* use program object */
         glUseProgram(program);
         return program;
@@ -6,10 +6,32 @@
 // Include the vector and matrix utilities from the textbook, as well as some
 // macro definitions.
 #include "Angel.h"
+#include "ShaderManager.h"
+#include "FrameScheduler.h"
+#include "InputQueue.h"
+#include "RenderThread.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "Headless.h"
+#include "JobSystem.h"
+#include "SoftwareRasterizer.h"
+#include "DrawList.h"
+#include "MeshBVH.h"
+#include "SceneBVH.h"
+#include "SelectionRegion.h"
+#include "PickBuffer.h"
+#include "ObjLoader.h"
+#include "Splitter.h"
 #include <stdio.h>
 #include <vector>
 #include <string>
 #include <fstream>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <sys/resource.h>
 
 #ifdef __APPLE__
 #  include <OpenGL/gl3.h>
@@ -17,58 +39,28 @@
 
 using namespace std;
 
-class Splitter {
-	std::vector<std::string> _tokens;
-public:
-	typedef std::vector<std::string>::size_type size_type;
-public:
-
-	Splitter ( const std::string& src, const std::string& delim )
-	{
-		reset ( src, delim );
-	}
-
-	std::string& operator[] ( size_type i )
-	{
-		return _tokens.at ( i );
-	}
-
-	size_type size() const
-	{
-		return _tokens.size();
-	}
-
-	void reset ( const std::string& src, const std::string& delim )
-	{
-		std::vector<std::string> tokens;
-		std::string::size_type start = 0;
-		std::string::size_type end;
-		for ( ; ; ) {
-			end = src.find ( delim, start );
-			tokens.push_back ( src.substr ( start, end - start ) );
-			// We just copied the last token
-			if ( end == std::string::npos )
-				break;
-			// Exclude the delimiter in the next search
-			start = end + delim.size();
-		}
-		_tokens.swap ( tokens );
-	}
-};
-
-
 #define NO_OBJECT_SELECTED -1
 #define NO_PREVIOUS_X -INT_MAX
 #define WINDOW_SIZE 512
+// pixels on a side of the scissored ID pass around the cursor
+#define PICK_REGION 3
+// pick IDs: object index + 1 in the low bits, end-cap axis + 1 above them
+#define PICK_OBJECT_MASK 0x3fffffff
+#define PICK_AXIS_SHIFT 30
+// window pixels between lasso points
+#define LASSO_SPACING 3.0f
+// objects one region-selection job tests
+#define REGION_OBJECTS_PER_JOB 16
+// objects one job composes model-view matrices for
+#define MODEL_VIEWS_PER_JOB 256
 
 typedef Angel::vec4  color4;
 typedef Angel::vec4  point4;
 
 GLuint  model_view;  // model-view matrix uniform shader variable location
+GLuint  normal_matrix;  // its inverse transpose, for the normals
 GLuint  projection; // projection matrix uniform shader variable location
-
-vector<vector<point4>>	vertexStore;
-vector<vector<vec4>>	normalStore;
+GLuint  color_id;   // pick/flat color uniform shader variable location
 
 // vectors of each objects vertices/normals
 vector<vector<point4>>	vertices;
@@ -78,27 +70,130 @@ vector<struct LookAtInfo> modelViewMatrices;
 
 vector<GLuint> VBOs;
 vector<GLuint> VAOs;
-vector<color4> colors;
+// the same buffers, laid out for the pick program's attributes
+vector<GLuint> pickVAOs;
+// object-space box around each object, axis gizmo included
+vector<AABB> objectBounds;
+
+// this frame's draw packets, built on the job system
+DrawList drawList;
+
+// per-object hierarchy over the mesh triangles, for ray picking
+vector<MeshBVH> meshBVHs;
+
+// the objects' eye-space boxes, for culling and picking without visiting
+// every object; kept current by whatever edits a transform
+SceneBVH sceneBVH;
+// this frame's frustum query, one flag per object
+vector<char> objectVisible;
+// this frame's model-view matrices, composed in batches
+vector<mat4> objectModelViews;
+
+enum PickMode {
+	PickRay = 0,		// cast a ray on the CPU
+	PickIDBuffer,		// render IDs and read the pixel back
+	PickModeCount
+};
+
+const char* pickModeNames[PickModeCount] = { "ray", "id buffer" };
+PickMode pickMode = PickRay;
+
+// offscreen ID target for the pick pass, and the program that fills it
+PickBuffer pickBuffer;
+GLuint pickProgram;
+GLuint pick_model_view;
+GLuint pick_object_id;
 
-bool mouseDown;
+// the next frame starts with an ID pass under mouseLoc
+bool pickPending;
+// the object with the gizmo; edits to it are applied to the whole selection
 int objectSelected;
+// every selected object, objectSelected included; one flag per object
+vector<char> objectInSelection;
+
+// shift-drag draws a rubber band, alt-drag a lasso
+enum RegionMode {
+	RegionNone = 0,
+	RegionRectangle,
+	RegionLasso
+};
+
+RegionMode regionMode = RegionNone;
+// window pixels of the drag so far, origin at the bottom left
+vector<vec2> regionPoints;
+GLuint bandVAO;
+GLuint bandVBO;
 // number of vertices used for axis lines
-int axisLineVerticesCount = 0;
+const int axisLineVerticesCount = 6;
 // number of vertices used for axis line end caps
-int endCapVerticesCount = 216;
+const int endCapVerticesCount = 216;
 
 struct LookAtInfo
 {
 	vec4 eye;
 	vec4 at;
 	vec4 up;
-	vec3 rotate;
+	quat orientation;
 	vec3 scale;
 	vec3 translate;
 };
 
 GLuint program;
 
+enum LightingMode {
+	LightingPhong = 0,
+	LightingDiffuse,
+	LightingAmbient,
+	LightingModeCount
+};
+
+const char* lightingModeNames[LightingModeCount] = { "phong", "diffuse", "ambient" };
+
+// lighting variants of vshader.glsl/fshader.glsl, compiled in the background
+ShaderManager shaders;
+int lightingVariants[LightingModeCount];
+LightingMode lighting = LightingPhong;
+
+// posts frames only when something on screen has changed
+FrameScheduler frames;
+// keyboard and mouse events waiting for the next frame to apply them
+InputQueue input;
+// an alt-drag lasso is under way; its motion keeps every point
+bool lassoDragging = false;
+
+// Everything the render thread needs for a frame, copied out of the scene
+// by the GLUT thread.  It is never changed once published.
+struct FrameSnapshot {
+	DrawList		drawList;
+	LightingMode	lighting;
+	unsigned long	pickSerial;		// a new value asks for an ID pass under pickX, pickY
+	int				pickX;
+	int				pickY;
+	vector<vec2>	regionOutline;	// window pixels of the band or lasso being dragged
+	unsigned long	profileExports;	// a new value asks for the profile to be written
+};
+
+// What the render thread read back from a pick pass
+struct PickReadback {
+	unsigned long	serial;			// the FrameSnapshot::pickSerial it answers
+	PickSample		sample;
+};
+
+// frames on their way to the render thread, and picks on their way back
+TripleBuffer<FrameSnapshot> frameSnapshots;
+TripleBuffer<PickReadback> pickReadbacks;
+
+// the newest pick asked for and answered, and the profile writes asked
+// for; GLUT thread only
+unsigned long pickSerial;
+unsigned long pickAnswered;
+unsigned long profileExports;
+// the same as far as the render thread has got; render thread only
+unsigned long pickSerialDrawn;
+unsigned long profileExportsDone;
+// cleared by the render thread once every shader variant is in
+std::atomic<bool> shadersCompiling(true);
+
 enum TransformMode {
 	ModeRotate = 0,
 	ModeTranslate,
@@ -125,45 +220,50 @@ struct Coordinates {
 TransformMode mode;
 Axis selectedAxis;
 struct Coordinates mouseLoc;
+// where the newest pick pass goes
+struct Coordinates pickLoc;
 
 static int previousMousePointX = NO_PREVIOUS_X;
 
 #pragma mark Function declarations
 vector<string> readSceneFile(string fileName);
 void loadObjectFromFile(string objFileName);
-void normalizeVector(vec4 *vector, vec4 min, vec4 max);
+LightingParams sceneLighting();
+mat4 sceneProjection();
+void setupProgram(GLuint prog);
+void initScene();
+void computeObjectBounds();
+void buildMeshBVHs();
+void buildSceneBVH();
+void updateSceneBVH(int i);
+mat4 objectModelView(int i);
+void prepareFrame();
+void regionOutline(vector<vec2>& corners);
+void renderFrame();
+void drawScene(const DrawList& list);
+void drawRegionBand(const vector<vec2>& corners);
+void drawPickPass(const DrawList& list, int x, int y);
+void drawSceneSoftware(SoftwareRasterizer& raster, const DrawList& list);
+int runHeadlessBenchmark(int frameCount, const char* dumpPath);
+int runSoftwareBenchmark(int frameCount, const char* dumpPath);
+unsigned transformChanges(const LookAtInfo& before, const LookAtInfo& after);
+void selectObject(int object, Axis axis);
+void selectWithRegion();
+void applyToSelection(const LookAtInfo& before);
+void applyInput(const InputEvent& event);
+void applyKey(unsigned char key);
+void applyButton(int button, int state, int x, int y, int modifiers);
+void applyMotion(int x, int y);
 
 #pragma mark -
 
 
 //----------------------------------------------------------------------------
 
-void addTri( int pointA, int pointB, int pointC, int normalA, int normalB, int normalC, int index )
-{
-	vertices.back().push_back(vertexStore[index][pointA-1]);
-	vertices.back().push_back(vertexStore[index][pointB-1]);
-	vertices.back().push_back(vertexStore[index][pointC-1]);
-
-	normals.back().push_back(normalStore[index][normalA-1]);
-	normals.back().push_back(normalStore[index][normalB-1]);
-	normals.back().push_back(normalStore[index][normalC-1]);
-}
-
-void addLine( vec4 pointA, vec4 pointB )
-{
-	vertices.back().push_back(pointA);
-	vertices.back().push_back(pointB);
-
-	normals.back().push_back(pointA);
-	normals.back().push_back(pointB);
-
-	axisLineVerticesCount += 2;
-}
-
 // Vertices of a unit cube centered at origin, sides aligned with axes
-point4 cubeVertex(vec3 center, GLfloat sideLength, int vertexIndex)
+constexpr point4 cubeVertex(vec3 center, GLfloat sideLength, int vertexIndex)
 {
-	point4 cubeVertices[8] = {
+	const point4 cubeVertices[8] = {
 		point4( center.x-sideLength/2, center.y-sideLength/2, center.z+sideLength/2, 1.0 ),
 		point4( center.x-sideLength/2, center.y+sideLength/2, center.z+sideLength/2, 1.0 ),
 		point4( center.x+sideLength/2, center.y+sideLength/2, center.z+sideLength/2, 1.0 ),
@@ -177,48 +277,111 @@ point4 cubeVertex(vec3 center, GLfloat sideLength, int vertexIndex)
 	return cubeVertices[vertexIndex];
 }
 
+// addCube generates two triangles for each face, 36 vertices from out on.
+//    Notice we keep the relative ordering when constructing the tris
+constexpr void addCube( point4* out, vec3 center, GLfloat sideLength )
+{
+	const int faces[36] = {
+		4, 5, 6,  4, 6, 7,
+		5, 4, 0,  5, 0, 1,
+		1, 0, 3,  1, 3, 2,
+		2, 3, 7,  2, 7, 6,
+		3, 0, 4,  3, 4, 7,
+		6, 5, 1,  6, 1, 2
+	};
+
+	for (int i = 0; i < 36; i++)
+		out[i] = cubeVertex(center, sideLength, faces[i]);
+}
+
+// The axis gizmo every object ends with: the end cap cubes of the x, y and
+// z axes, then the axis lines.  It's the same for every object, so it's
+// built once, at compile time.
+struct AxisGizmo
+{
+	point4 endCaps[endCapVerticesCount];
+	point4 lines[axisLineVerticesCount];
+};
+
+constexpr AxisGizmo makeAxisGizmo()
+{
+	AxisGizmo gizmo = {};
+
+	addCube( gizmo.endCaps, vec3(-1.0, 0.0, 0.0), .1);
+	addCube( gizmo.endCaps + 36, vec3(1.0, 0.0, 0.0), .1);
+	addCube( gizmo.endCaps + 72, vec3(0.0, -1.0, 0.0), .1);
+	addCube( gizmo.endCaps + 108, vec3(0.0, 1.0, 0.0), .1);
+	addCube( gizmo.endCaps + 144, vec3(0.0, 0.0, -1.0), .1);
+	addCube( gizmo.endCaps + 180, vec3(0.0, 0.0, 1.0), .1);
+
+	gizmo.lines[0] = point4(-1.0, 0.0, 0.0, 1.0);
+	gizmo.lines[1] = point4(1.0, 0.0, 0.0, 1.0);
+	gizmo.lines[2] = point4(0.0, -1.0, 0.0, 1.0);
+	gizmo.lines[3] = point4(0.0, 1.0, 0.0, 1.0);
+	gizmo.lines[4] = point4(0.0, 0.0, -1.0, 1.0);
+	gizmo.lines[5] = point4(0.0, 0.0, 1.0, 1.0);
+	return gizmo;
+}
+
+constexpr AxisGizmo axisGizmo = makeAxisGizmo();
+
 //----------------------------------------------------------------------------
 
-// quad generates two triangles for each face and assigns colors
-//    to the vertices.  Notice we keep the relative ordering when constructing the tris
-void addCube( vec3 center, GLfloat sideLength )
-{
-	vertices.back().push_back(cubeVertex(center, sideLength, 4));
-	vertices.back().push_back(cubeVertex(center, sideLength, 5));
-	vertices.back().push_back(cubeVertex(center, sideLength, 6));
-	vertices.back().push_back(cubeVertex(center, sideLength, 4));
-	vertices.back().push_back(cubeVertex(center, sideLength, 6));
-	vertices.back().push_back(cubeVertex(center, sideLength, 7));
-	vertices.back().push_back(cubeVertex(center, sideLength, 5));
-	vertices.back().push_back(cubeVertex(center, sideLength, 4));
-	vertices.back().push_back(cubeVertex(center, sideLength, 0));
-	vertices.back().push_back(cubeVertex(center, sideLength, 5));
-	vertices.back().push_back(cubeVertex(center, sideLength, 0));
-	vertices.back().push_back(cubeVertex(center, sideLength, 1));
-	vertices.back().push_back(cubeVertex(center, sideLength, 1));
-	vertices.back().push_back(cubeVertex(center, sideLength, 0));
-	vertices.back().push_back(cubeVertex(center, sideLength, 3));
-	vertices.back().push_back(cubeVertex(center, sideLength, 1));
-	vertices.back().push_back(cubeVertex(center, sideLength, 3));
-	vertices.back().push_back(cubeVertex(center, sideLength, 2));
-	vertices.back().push_back(cubeVertex(center, sideLength, 2));
-	vertices.back().push_back(cubeVertex(center, sideLength, 3));
-	vertices.back().push_back(cubeVertex(center, sideLength, 7));
-	vertices.back().push_back(cubeVertex(center, sideLength, 2));
-	vertices.back().push_back(cubeVertex(center, sideLength, 7));
-	vertices.back().push_back(cubeVertex(center, sideLength, 6));
-	vertices.back().push_back(cubeVertex(center, sideLength, 3));
-	vertices.back().push_back(cubeVertex(center, sideLength, 0));
-	vertices.back().push_back(cubeVertex(center, sideLength, 4));
-	vertices.back().push_back(cubeVertex(center, sideLength, 3));
-	vertices.back().push_back(cubeVertex(center, sideLength, 4));
-	vertices.back().push_back(cubeVertex(center, sideLength, 7));
-	vertices.back().push_back(cubeVertex(center, sideLength, 6));
-	vertices.back().push_back(cubeVertex(center, sideLength, 5));
-	vertices.back().push_back(cubeVertex(center, sideLength, 1));
-	vertices.back().push_back(cubeVertex(center, sideLength, 6));
-	vertices.back().push_back(cubeVertex(center, sideLength, 1));
-	vertices.back().push_back(cubeVertex(center, sideLength, 2));
+// Lighting for the current mode; shared by the GL programs and the software
+// rasterizer
+LightingParams sceneLighting()
+{
+    // Initialize shader lighting parameters
+    // RAM: No need to change these...we'll learn about the details when we
+    // cover Illumination and Shading
+    vec4 light_position( 1.5, 0.5, 2.0, 1.0 );
+    color4 light_ambient( 0.2, 0.5, 0.2, 1.0 );
+    color4 light_diffuse( 1.0, 1.0, 1.0, 1.0 );
+    color4 light_specular( 1.0, 1.0, 1.0, 1.0 );
+
+    color4 material_ambient( 1.0, 0.0, 1.0, 1.0 );
+    color4 material_diffuse( 1.0, 0.8, 0.0, 1.0 );
+    color4 material_specular( 1.0, 0.8, 0.0, 1.0 );
+    float  material_shininess = 100.0;
+
+	LightingParams params;
+    params.ambientProduct = light_ambient * material_ambient;
+    params.diffuseProduct = light_diffuse * material_diffuse;
+    params.specularProduct = light_specular * material_specular;
+	params.lightPosition = light_position;
+	params.shininess = material_shininess;
+	params.diffuse = (lighting != LightingAmbient);
+	params.specular = (lighting == LightingPhong);
+	return params;
+}
+
+mat4 sceneProjection()
+{
+//	mat4 p = Ortho(-0.094552, 0.06105, 0.033349, 0.186195, -5, 5);
+	static constexpr mat4 projection = Perspective (90.0, 1.0, 0.1, 20.0);
+	return projection;
+}
+
+// Uniforms that stay the same for the life of a program; run for the base
+// program and for every shader variant once it links.
+void setupProgram(GLuint prog)
+{
+	LightingParams params = sceneLighting();
+
+    glUniform4fv( glGetUniformLocation(prog, "AmbientProduct"), 1, params.ambientProduct );
+    glUniform4fv( glGetUniformLocation(prog, "DiffuseProduct"), 1, params.diffuseProduct );
+    glUniform4fv( glGetUniformLocation(prog, "SpecularProduct"), 1, params.specularProduct );
+    glUniform4fv( glGetUniformLocation(prog, "LightPosition"), 1, params.lightPosition );
+    glUniform1f( glGetUniformLocation(prog, "Shininess"), params.shininess );
+
+
+//	mat4 mv = LookAt( eye, at, up );
+
+//	glUniformMatrix4fv( model_view, 1, GL_TRUE, LookAt(vec4(0.0, 0.0, 1.5, 1.0),
+//													   vec4(0.0, 0.0, 0.0, 1.0),
+//													   vec4(0.0, 1.0, 0.0, 0.0)) );
+
+    glUniformMatrix4fv( glGetUniformLocation(prog, "Projection"), 1, GL_TRUE, sceneProjection() );
 }
 
 //----------------------------------------------------------------------------
@@ -226,10 +389,27 @@ void addCube( vec3 center, GLfloat sideLength )
 // OpenGL initialization
 void init()
 {
+	PROFILE_SCOPE("init");
+
     // Load shaders and use the resulting shader program
     program = InitShader( "vshader.glsl", "fshader.glsl" );
     glUseProgram( program );
 
+	GLuint vPosition = glGetAttribLocation( program, "vPosition" );
+	GLuint vNormal = glGetAttribLocation( program, "vNormal" );
+
+	// the phong variant is the base program itself; the others are compiled
+	// in the background and replace it once they have linked
+	shaders.setSources( "vshader.glsl", "fshader.glsl" );
+	shaders.setFallback( program );
+	shaders.bindAttribLocation( "vPosition", vPosition );
+	shaders.bindAttribLocation( "vNormal", vNormal );
+	shaders.setProgramSetup( setupProgram );
+	lightingVariants[LightingPhong] = ShaderManager::Fallback;
+	lightingVariants[LightingDiffuse] = shaders.addVariant( vector<string>(1, "LIGHTING_DIFFUSE") );
+	lightingVariants[LightingAmbient] = shaders.addVariant( vector<string>(1, "LIGHTING_AMBIENT") );
+	shaders.compileAll();
+
 	for (int i = 0; i < vertices.size(); i++)
 	{
 		GLuint buffer1;
@@ -251,196 +431,552 @@ void init()
 		glBufferSubData( GL_ARRAY_BUFFER, vertices[i].size() * sizeof(point4), normals[i].size() * sizeof(vec4), &normals[i][0] );
 
 		// set up vertex arrays
-		GLuint vPosition = glGetAttribLocation( program, "vPosition" );
 		glEnableVertexAttribArray( vPosition );
 		glVertexAttribPointer( vPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
 
-		GLuint vNormal = glGetAttribLocation( program, "vNormal" );
 		glEnableVertexAttribArray( vNormal );
 		glVertexAttribPointer( vNormal, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(vertices[i].size() * sizeof(point4)) );
 	}
 
-    // Initialize shader lighting parameters
-    // RAM: No need to change these...we'll learn about the details when we
-    // cover Illumination and Shading
-    vec4 light_position( 1.5, 0.5, 2.0, 1.0 );
-    color4 light_ambient( 0.2, 0.5, 0.2, 1.0 );
-    color4 light_diffuse( 1.0, 1.0, 1.0, 1.0 );
-    color4 light_specular( 1.0, 1.0, 1.0, 1.0 );
-
-    color4 material_ambient( 1.0, 0.0, 1.0, 1.0 );
-    color4 material_diffuse( 1.0, 0.8, 0.0, 1.0 );
-    color4 material_specular( 1.0, 0.8, 0.0, 1.0 );
-    float  material_shininess = 100.0;
-
-    color4 ambient_product = light_ambient * material_ambient;
-    color4 diffuse_product = light_diffuse * material_diffuse;
-    color4 specular_product = light_specular * material_specular;
+	// the rubber band and lasso outline, rewritten as the mouse drags
+	glGenVertexArrays( 1, &bandVAO );
+	glGenBuffers( 1, &bandVBO );
+	glBindVertexArray( bandVAO );
+	glBindBuffer( GL_ARRAY_BUFFER, bandVBO );
+	glEnableVertexAttribArray( vPosition );
+	glVertexAttribPointer( vPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
+
+	setupProgram( program );
+	profiler.init();
+
+	pickProgram = InitShader( "pick_vshader.glsl", "pick_fshader.glsl" );
+	GLuint pickPosition = glGetAttribLocation( pickProgram, "vPosition" );
+	glUniformMatrix4fv( glGetUniformLocation(pickProgram, "Projection"), 1, GL_TRUE, sceneProjection() );
+	pick_model_view = glGetUniformLocation( pickProgram, "ModelView" );
+	pick_object_id = glGetUniformLocation( pickProgram, "objectID" );
+
+	pickVAOs.resize(VBOs.size());
+	glGenVertexArrays( (int)pickVAOs.size(), &pickVAOs[0] );
+	for (size_t i = 0; i < VBOs.size(); i++)
+	{
+		glBindVertexArray( pickVAOs[i] );
+		glBindBuffer( GL_ARRAY_BUFFER, VBOs[i] );
+		glEnableVertexAttribArray( pickPosition );
+		glVertexAttribPointer( pickPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
+	}
 
-    glUniform4fv( glGetUniformLocation(program, "AmbientProduct"), 1, ambient_product );
-    glUniform4fv( glGetUniformLocation(program, "DiffuseProduct"), 1, diffuse_product );
-    glUniform4fv( glGetUniformLocation(program, "SpecularProduct"), 1, specular_product );
-    glUniform4fv( glGetUniformLocation(program, "LightPosition"), 1, light_position );
-    glUniform1f( glGetUniformLocation(program, "Shininess"), material_shininess );
+	if (!pickBuffer.init( WINDOW_SIZE, WINDOW_SIZE, glGetFragDataLocation(pickProgram, "fObjectID"),
+						  glGetFragDataLocation(pickProgram, "fPrimitiveID") ))
+		pickMode = PickRay;
 
+	glUseProgram( program );
 
     model_view = glGetUniformLocation( program, "ModelView" );
+    normal_matrix = glGetUniformLocation( program, "NormalMatrix" );
     projection = glGetUniformLocation( program, "Projection" );
+    color_id = glGetUniformLocation( program, "colorID" );
 
-//	mat4 mv = LookAt( eye, at, up );
-//	mat4 p = Ortho(-0.094552, 0.06105, 0.033349, 0.186195, -5, 5);
-
-//	glUniformMatrix4fv( model_view, 1, GL_TRUE, LookAt(vec4(0.0, 0.0, 1.5, 1.0),
-//													   vec4(0.0, 0.0, 0.0, 1.0),
-//													   vec4(0.0, 1.0, 0.0, 0.0)) );
-
-	mat4 p = Perspective (90.0, 1.0, 0.1, 20.0);
-    glUniformMatrix4fv( projection, 1, GL_TRUE, p );
+    glEnable( GL_DEPTH_TEST );
+    glClearColor( 1.0, 1.0, 1.0, 1.0 );
+}
 
+//----------------------------------------------------------------------------
 
+// Per-object transforms, bounds and selection; no GL needed
+void initScene()
+{
 	for (int i = 0; i < vertices.size(); i++)
 	{
 		struct LookAtInfo lookAtInfo;
 		lookAtInfo.eye = vec4(0.0+i-2, 0.0, 3.0, 1.0);
 		lookAtInfo.at = vec4(0.0+i-2, 0.0, 0.0, 1.0);
 		lookAtInfo.up = vec4(0.0, 1.0, 0.0, 0.0);
-		lookAtInfo.rotate = 0.0;
+		lookAtInfo.orientation = quat();
 		lookAtInfo.translate = 0.0;
 		lookAtInfo.scale = 1.0;
 		modelViewMatrices.push_back(lookAtInfo);
 	}
 
-	for (int i = 0; i < modelViewMatrices.size(); i++)
+	computeObjectBounds();
+	buildMeshBVHs();
+	buildSceneBVH();
+
+	objectSelected = NO_OBJECT_SELECTED;
+	objectInSelection.assign(vertices.size(), 0);
+}
+
+// Bounding boxes for culling.  They cover the axis gizmo as well, which
+// is drawn from the same vertices.
+void computeObjectBounds()
+{
+	objectBounds.clear();
+	for (size_t i = 0; i < vertices.size(); i++)
 	{
-		float r;
-		float g;
-		float b;
-		do
-		{
-			r = (arc4random() % 255);
-			g = (arc4random() % 255);
-			b = (arc4random() % 255);
-		} while (r == 1 || g == 1 || b == 1);
+		AABB box;
+		for (size_t v = 0; v < vertices[i].size(); v++)
+			box.grow(vec3(vertices[i][v].x, vertices[i][v].y, vertices[i][v].z));
+		objectBounds.push_back(box);
+	}
+}
 
-		colors.push_back(vec4(r, g, b, 1.0f));
+// The gizmo is left out; its end caps are only pickable while shown, and
+// are tested directly.
+void buildMeshBVHs()
+{
+	PROFILE_SCOPE("bvh build");
+
+	meshBVHs.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		int triangles = ((int)vertices[i].size() - axisLineVerticesCount - endCapVerticesCount) / 3;
+		meshBVHs[i].build(&vertices[i][0], triangles);
 	}
+}
 
-    glEnable( GL_DEPTH_TEST );
-    glClearColor( 1.0, 1.0, 1.0, 1.0 );
+void buildSceneBVH()
+{
+	sceneBVH.clear();
+	if (modelViewMatrices.empty())
+		return;
+
+	int objects = (int)modelViewMatrices.size();
+	vector<mat4> modelViews(objects);
+	LookAtTRS(&modelViewMatrices[0], objects, &modelViews[0]);
+	for (int i = 0; i < objects; i++)
+		sceneBVH.update(i, objectBounds[i].transformed(modelViews[i]));
+}
 
-	objectSelected = NO_OBJECT_SELECTED;
+// Call after changing an object's LookAtInfo
+void updateSceneBVH(int i)
+{
+	sceneBVH.update(i, objectBounds[i].transformed(objectModelView(i)));
 }
 
 //----------------------------------------------------------------------------
 
-void display( void )
+mat4 objectModelView(int i)
 {
-	printf("mouse at (%i, %i)\n", mouseLoc.x, mouseLoc.y);
+	const LookAtInfo& info = modelViewMatrices[i];
+	return LookAtTRS(info.eye, info.at, info.up, info.orientation, info.translate, info.scale);
+}
 
+// Turns an object by degrees about one of its own axes
+void rotateObject(LookAtInfo& info, Axis axis, float degrees)
+{
+	vec3 axes[3] = { vec3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, 1.0) };
+	info.orientation = normalize(info.orientation * AngleAxis(degrees, axes[axis]));
+}
 
-	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+// Builds this frame's draw packets on the job system: matrices, frustum
+// culling and draw state.  Reads the scene only.
+void prepareFrame()
+{
+	PROFILE_SCOPE("prepare");
+
+	ViewFrustum frustum(sceneProjection());
+
+	objectVisible.assign(modelViewMatrices.size(), 0);
+	sceneBVH.queryFrustum(frustum, [](int i) { objectVisible[i] = 1; });
+
+	objectModelViews.resize(modelViewMatrices.size());
+	jobs.parallelFor((int)modelViewMatrices.size(), MODEL_VIEWS_PER_JOB, [](int begin, int end, int) {
+		LookAtTRS(&modelViewMatrices[begin], end - begin, &objectModelViews[begin]);
+	});
+
+	drawList.build((int)modelViewMatrices.size(), [&](int i, DrawPacket& packet) {
+		if (!objectVisible[i])
+			return false;
+
+		packet.modelView = objectModelViews[i];
+		packet.normalMatrix = Normal(packet.modelView);
+		packet.gizmo = (i == objectSelected);
+		// draw selected objects in wireframe mode.
+		packet.wireframe = packet.gizmo || objectInSelection[i];
+		packet.pickID = i + 1;
+		return true;
+	});
+}
 
-	mat4 transformedMatrix;
+// Draws every packet in list with the current program
+void drawScene(const DrawList& list)
+{
+	PROFILE_SCOPE("draw");
 
-	for (int i = 0; i < VAOs.size(); i++)
-	{
-		glBindVertexArray(VAOs[i]);
+	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
-		transformedMatrix = LookAt(modelViewMatrices[i].eye, modelViewMatrices[i].at, modelViewMatrices[i].up) * RotateX(modelViewMatrices[i].rotate.x)
-		*= RotateY(modelViewMatrices[i].rotate.y)
-		*= RotateZ(modelViewMatrices[i].rotate.z)
-		*= Translate(modelViewMatrices[i].translate.x, modelViewMatrices[i].translate.y, modelViewMatrices[i].translate.z)
-		*= Scale(modelViewMatrices[i].scale.x, modelViewMatrices[i].scale.y, modelViewMatrices[i].scale.z);
+	list.forEach([](const DrawPacket& packet) {
+		int i = packet.object;
+		glBindVertexArray(VAOs[i]);
 
-		glUniformMatrix4fv(model_view, 1, GL_TRUE, transformedMatrix);
+		glUniformMatrix4fv(model_view, 1, GL_TRUE, packet.modelView);
+		glUniformMatrix3fv(normal_matrix, 1, GL_TRUE, packet.normalMatrix);
+		profiler.countUniform();
+		profiler.countUniform();
 
-		if (mouseDown)
+		if (packet.wireframe)
 		{
-			// set the colorID for the current object being checked.
-			glUniform4f(glGetUniformLocation(program, "colorID"), colors[i].x/255.0, colors[i].y/255.0, colors[i].z/255.0, 1.0f);
+			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+			glPolygonOffset(1.0, 2 );
 		}
 		else
 		{
-			if (i == objectSelected)
-			{
-				// if there's an object selected, draw it in wireframe mode.
-				glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-				glPolygonOffset(1.0, 2 );
-			}
-			else
-			{
-				// else draw it filled.
-				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-			}
-			// set colorID of fshader to -1 to let it know mouse is not down.
-			glUniform4f(glGetUniformLocation(program, "colorID"), -1.0f, 0.0f, 0.0f, 0.0f);
+			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 		}
 
+		// set colorID of fshader to -1 to light the object
+		glUniform4f(color_id, -1.0f, 0.0f, 0.0f, 0.0f);
+		profiler.countUniform();
+
 		// draw the object
 		glDrawArrays(GL_TRIANGLES, 0, (int)vertices[i].size()-axisLineVerticesCount-endCapVerticesCount);
+		profiler.countDraw(GL_TRIANGLES, (int)vertices[i].size()-axisLineVerticesCount-endCapVerticesCount);
 
 		// draw axis lines/endcaps if object is selected
-		if (i == objectSelected)
+		if (packet.gizmo)
 		{
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-			glUniform4f(glGetUniformLocation(program, "colorID"), 1.0, 0.0, 0.0, 1.0);
+			glUniform4f(color_id, 1.0, 0.0, 0.0, 1.0);
+			profiler.countUniform();
 			glDrawArrays(GL_TRIANGLES, (int)vertices[i].size() - axisLineVerticesCount - endCapVerticesCount, endCapVerticesCount/3);
+			profiler.countDraw(GL_TRIANGLES, endCapVerticesCount/3);
 
-			glUniform4f(glGetUniformLocation(program, "colorID"), 0.0, 1.0, 0.0, 1.0);
+			glUniform4f(color_id, 0.0, 1.0, 0.0, 1.0);
+			profiler.countUniform();
 			glDrawArrays(GL_TRIANGLES, (int)vertices[i].size() - axisLineVerticesCount - endCapVerticesCount + endCapVerticesCount/3, endCapVerticesCount/3);
+			profiler.countDraw(GL_TRIANGLES, endCapVerticesCount/3);
 
-			glUniform4f(glGetUniformLocation(program, "colorID"), 0.0, 0.0, 1.0, 1.0);
+			glUniform4f(color_id, 0.0, 0.0, 1.0, 1.0);
+			profiler.countUniform();
 			glDrawArrays(GL_TRIANGLES, (int)vertices[i].size() - axisLineVerticesCount - endCapVerticesCount + (2*endCapVerticesCount/3), endCapVerticesCount/3);
+			profiler.countDraw(GL_TRIANGLES, endCapVerticesCount/3);
 
-			glUniform4f(glGetUniformLocation(program, "colorID"), 0.0, 0.0, 0.0, 1.0);
+			glUniform4f(color_id, 0.0, 0.0, 0.0, 1.0);
+			profiler.countUniform();
 			glDrawArrays(GL_LINES, (int)vertices[i].size()-axisLineVerticesCount, axisLineVerticesCount);
+			profiler.countDraw(GL_LINES, axisLineVerticesCount);
 		}
-	}
+	});
+}
 
-	glutSwapBuffers();
+// Corners of the rubber band or lasso being dragged, none if there isn't one
+void regionOutline(vector<vec2>& corners)
+{
+	corners.clear();
+	if (regionMode == RegionNone || regionPoints.size() < 2)
+		return;
 
-	if (mouseDown)
+	if (regionMode == RegionRectangle)
 	{
-		mouseDown = false;
+		corners.push_back(regionPoints[0]);
+		corners.push_back(vec2(regionPoints[1].x, regionPoints[0].y));
+		corners.push_back(regionPoints[1]);
+		corners.push_back(vec2(regionPoints[0].x, regionPoints[1].y));
+	}
+	else
+		corners = regionPoints;
+}
 
-		glFlush();
-		glFinish();
+// The outline from regionOutline(), over the scene
+void drawRegionBand(const vector<vec2>& corners)
+{
+	vector<point4> outline;
+	for (size_t c = 0; c < corners.size(); c++)
+		outline.push_back(point4(2.0f * corners[c].x / WINDOW_SIZE - 1.0f, 2.0f * corners[c].y / WINDOW_SIZE - 1.0f, 0.0, 1.0));
+
+	glBindVertexArray(bandVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, bandVBO);
+	glBufferData(GL_ARRAY_BUFFER, outline.size() * sizeof(point4), &outline[0], GL_STREAM_DRAW);
+
+	// already in clip space
+	glDisable(GL_DEPTH_TEST);
+	glUniformMatrix4fv(model_view, 1, GL_TRUE, mat4());
+	glUniformMatrix4fv(projection, 1, GL_TRUE, mat4());
+	glUniform4f(color_id, 0.0, 0.0, 0.0, 1.0);
+	profiler.countUniform();
+	glDrawArrays(GL_LINE_LOOP, 0, (int)outline.size());
+	profiler.countDraw(GL_LINE_LOOP, (int)outline.size());
+
+	glUniformMatrix4fv(projection, 1, GL_TRUE, sceneProjection());
+	glEnable(GL_DEPTH_TEST);
+}
 
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-		unsigned char data[4];
+//----------------------------------------------------------------------------
+
+// drawScene() for the software rasterizer, minus the pick pass
+void drawSceneSoftware(SoftwareRasterizer& raster, const DrawList& list)
+{
+	PROFILE_SCOPE("draw");
 
-		glReadPixels(mouseLoc.x, mouseLoc.y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	raster.clear(color4(1.0, 1.0, 1.0, 1.0));
+	raster.setProjection(sceneProjection());
+	raster.setLighting(sceneLighting());
 
-		for (int i = 0; i < colors.size(); i++)
+	static const color4 capColors[3] = {
+		color4(1.0, 0.0, 0.0, 1.0), color4(0.0, 1.0, 0.0, 1.0), color4(0.0, 0.0, 1.0, 1.0)
+	};
+	static const color4 lineColor(0.0, 0.0, 0.0, 1.0);
+
+	list.forEach([&](const DrawPacket& packet) {
+		int i = packet.object;
+		int objectVertices = (int)vertices[i].size() - axisLineVerticesCount - endCapVerticesCount;
+
+		raster.draw(packet.wireframe ? SoftwareRasterizer::Wireframe : SoftwareRasterizer::Triangles,
+					&vertices[i][0], &normals[i][0], 0, objectVertices, packet.modelView, packet.normalMatrix);
+		profiler.countDraw(GL_TRIANGLES, objectVertices);
+
+		if (packet.gizmo)
 		{
-			if (data[0] == 255 && data[1] == 255 && data[2] == 255)
-				objectSelected = NO_OBJECT_SELECTED;
-			if (colors[i].x == data[0] && colors[i].y == data[1] && colors[i].z == data[2])
-				objectSelected = i;
+			for (int axis = 0; axis < 3; axis++)
+				raster.draw(SoftwareRasterizer::Triangles, &vertices[i][0], &normals[i][0],
+							objectVertices + axis * endCapVerticesCount/3, endCapVerticesCount/3,
+							packet.modelView, packet.normalMatrix, &capColors[axis]);
+			profiler.countDraw(GL_TRIANGLES, endCapVerticesCount);
+			raster.draw(SoftwareRasterizer::Lines, &vertices[i][0], &normals[i][0],
+						(int)vertices[i].size() - axisLineVerticesCount, axisLineVerticesCount,
+						packet.modelView, packet.normalMatrix, &lineColor);
+			profiler.countDraw(GL_LINES, axisLineVerticesCount);
+		}
+	});
 
-			if (data[0] == 255 && data[1] == 0 && data[2] == 0)
-				selectedAxis = XAxis;
-			else if (data[0] == 0 && data[1] == 255 && data[2] == 0)
-				selectedAxis = YAxis;
-			else if (data[0] == 0 && data[1] == 0 && data[2] == 255)
-				selectedAxis = ZAxis;
-			else
-				selectedAxis = NoAxis;
+	raster.render();
+}
+
+//----------------------------------------------------------------------------
+
+// Draws object IDs under window pixel (x, y) into the pick buffer and
+// queues their readback.  Only end caps and meshes are drawn; like a ray,
+// a click on an axis line goes through to what is behind it.
+void drawPickPass(const DrawList& list, int x, int y)
+{
+	PROFILE_SCOPE("draw");
+
+	pickBuffer.begin(x, y, PICK_REGION);
+	glUseProgram(pickProgram);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
+	list.forEach([](const DrawPacket& packet) {
+		int i = packet.object;
+		glBindVertexArray(pickVAOs[i]);
 
-			printf("\nobj selected: %i\n", objectSelected);
+		glUniformMatrix4fv(pick_model_view, 1, GL_TRUE, packet.modelView);
+		glUniform1ui(pick_object_id, packet.pickID);
+		profiler.countUniform();
+		profiler.countUniform();
+
+		int objectVertices = (int)vertices[i].size() - axisLineVerticesCount - endCapVerticesCount;
+		glDrawArrays(GL_TRIANGLES, 0, objectVertices);
+		profiler.countDraw(GL_TRIANGLES, objectVertices);
+
+		if (packet.gizmo)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				glUniform1ui(pick_object_id, packet.pickID | (GLuint)(axis + 1) << PICK_AXIS_SHIFT);
+				profiler.countUniform();
+				glDrawArrays(GL_TRIANGLES, objectVertices + axis * endCapVerticesCount/3, endCapVerticesCount/3);
+				profiler.countDraw(GL_TRIANGLES, endCapVerticesCount/3);
+			}
 		}
+	});
+
+	pickBuffer.end(x, y);
+	glUseProgram(program);
+}
+
+// Selection from the IDs under the cursor: an end cap picks an axis of the
+// selected object, anything else picks an object
+void applyPickSample(const PickSample& sample)
+{
+	GLuint axis = sample.object >> PICK_AXIS_SHIFT;
+	selectObject((int)(sample.object & PICK_OBJECT_MASK) - 1, axis > 0 ? (Axis)(axis - 1) : NoAxis);
+
+	LOG_DEBUG("obj selected: %i, axis: %i, triangle %u", objectSelected, selectedAxis, sample.primitive);
+}
 
-		glutPostRedisplay();
+//----------------------------------------------------------------------------
+
+// Runs on the GLUT thread: applies the input that has come in, builds the
+// frame and hands it to the render thread
+void display( void )
+{
+	// everything that arrived since the last frame, before drawing it
+	{
+		PROFILE_SCOPE("input");
+		input.update(applyInput);
+	}
+
+	LOG_TRACE("mouse at (%i, %i)", mouseLoc.x, mouseLoc.y);
+
+	// a readback for an older pick went stale when the newer one was drawn
+	if (pickReadbacks.acquire() && pickReadbacks.front().serial == pickSerial && pickAnswered != pickSerial)
+	{
+		applyPickSample(pickReadbacks.front().sample);
+		pickAnswered = pickSerial;
+	}
+
+	if (pickPending)
+	{
+		// the next frame draws IDs under the cursor
+		pickPending = false;
+		pickSerial++;
+		pickLoc = mouseLoc;
+	}
+
+	prepareFrame();
+
+	FrameSnapshot& frame = frameSnapshots.back();
+	frame.drawList = drawList;
+	frame.lighting = lighting;
+	frame.pickSerial = pickSerial;
+	frame.pickX = pickLoc.x;
+	frame.pickY = pickLoc.y;
+	regionOutline(frame.regionOutline);
+	frame.profileExports = profileExports;
+	frameSnapshots.publish();
+	renderThread.wake();
+
+	frames.frameRendered();
+
+	// keep frames coming until the GPU has the pixel
+	if (pickAnswered != pickSerial)
+		frames.invalidate(DirtySelection);
+
+	// and until the variants are in, so a pending one shows up
+	if (shadersCompiling.load())
+		frames.invalidate(DirtyShaders);
+}
+
+// Runs on the render thread, or in display() without one: draws the newest
+// frame the GLUT thread has published
+void renderFrame()
+{
+	if (!frameSnapshots.acquire())
+		return;
+	const FrameSnapshot& frame = frameSnapshots.front();
+
+	profiler.beginFrame();
+
+	// switch to the selected lighting variant once it has finished compiling
+	shaders.poll();
+	GLuint activeProgram = shaders.program(lightingVariants[frame.lighting]);
+	if (activeProgram != program)
+	{
+		program = activeProgram;
+		glUseProgram(program);
+		model_view = glGetUniformLocation(program, "ModelView");
+		normal_matrix = glGetUniformLocation(program, "NormalMatrix");
+		projection = glGetUniformLocation(program, "Projection");
+		color_id = glGetUniformLocation(program, "colorID");
+	}
+
+	if (frame.pickSerial != pickSerialDrawn)
+	{
+		// draw IDs into just the pixels under the cursor, offscreen, and
+		// queue their readback
+		profiler.beginPass("pick");
+		pickSerialDrawn = frame.pickSerial;
+		drawPickPass(frame.drawList, frame.pickX, frame.pickY);
+		profiler.endPass();
+	}
+
+	profiler.beginPass("scene");
+	drawScene(frame.drawList);
+	if (!frame.regionOutline.empty())
+		drawRegionBand(frame.regionOutline);
+	profiler.endPass();
+
+	renderThread.present();
+
+	PickReadback& readback = pickReadbacks.back();
+	if (pickBuffer.poll(readback.sample))
+	{
+		readback.serial = pickSerialDrawn;
+		pickReadbacks.publish();
 	}
 
+	shadersCompiling = shaders.pending();
+
+	profiler.endFrame();
+
+	if (frame.profileExports != profileExportsDone)
+	{
+		// dump the rolling frame history
+		profileExportsDone = frame.profileExports;
+		if (profiler.exportCSV("profile.csv") && profiler.exportJSON("profile.json"))
+			LOG_INFO("profile written to profile.csv and profile.json");
+		else
+			LOG_WARN("couldn't write profile");
+	}
 }
 
 //----------------------------------------------------------------------------
 
+// GLUT callbacks: queue the event for the next frame's update
+
 void keyboard( unsigned char key, int x, int y )
 {
+	InputEvent event = InputEvent();
+	event.type = InputKey;
+	event.key = key;
+	event.x = x;
+	event.y = y;
+	input.push(event);
+	frames.invalidate(DirtyInput);
+}
+
+void mouse(int button, int state, int x, int y)
+{
+	InputEvent event = InputEvent();
+	event.type = InputButton;
+	event.button = button;
+	event.state = state;
+	event.x = x;
+	event.y = y;
+	event.modifiers = glutGetModifiers();
+	input.push(event);
+	frames.invalidate(DirtyInput);
+
+	// decided here rather than when the button is applied, since the
+	// motion that follows is queued before then
+	if (button == GLUT_LEFT_BUTTON)
+		lassoDragging = state == GLUT_DOWN &&
+			(event.modifiers & (GLUT_ACTIVE_SHIFT | GLUT_ACTIVE_ALT)) == GLUT_ACTIVE_ALT;
+}
+
+void mouseDidMove(int x, int y)
+{
+	InputEvent event = InputEvent();
+	event.type = InputMotion;
+	event.x = x;
+	event.y = y;
+	event.path = lassoDragging;
+	input.push(event);
+	frames.invalidate(DirtyInput);
+}
+
+// Runs in display(), oldest event first
+void applyInput(const InputEvent& event)
+{
+	switch (event.type) {
+		case InputKey:
+			applyKey(event.key);
+			break;
+		case InputButton:
+			applyButton(event.button, event.state, event.x, event.y, event.modifiers);
+			break;
+		case InputMotion:
+			applyMotion(event.x, event.y);
+			break;
+	}
+}
+
+void applyKey(unsigned char key)
+{
+	LookAtInfo before;
+	if (objectSelected != NO_OBJECT_SELECTED)
+		before = modelViewMatrices[objectSelected];
+	LightingMode lightingBefore = lighting;
 
     switch( key ) {
 	case 'a':
@@ -481,50 +1017,71 @@ void keyboard( unsigned char key, int x, int y )
 		}
 	case 'u':
 		{
-			modelViewMatrices[objectSelected].rotate.x -= 45;
+			rotateObject(modelViewMatrices[objectSelected], XAxis, -45);
 			break;
 		}
 	case 'i':
 		{
-			modelViewMatrices[objectSelected].rotate.x += 45;
+			rotateObject(modelViewMatrices[objectSelected], XAxis, 45);
 			break;
 		}
 	case 'j':
 		{
-			modelViewMatrices[objectSelected].rotate.y -= 45;
+			rotateObject(modelViewMatrices[objectSelected], YAxis, -45);
 			break;
 		}
 	case 'k':
 		{
-			modelViewMatrices[objectSelected].rotate.y += 45;
+			rotateObject(modelViewMatrices[objectSelected], YAxis, 45);
 			break;
 		}
 	case 'n':
 		{
-			modelViewMatrices[objectSelected].rotate.z -= 45;
+			rotateObject(modelViewMatrices[objectSelected], ZAxis, -45);
 			break;
 		}
 	case 'm':
 		{
-			modelViewMatrices[objectSelected].rotate.z += 45;
+			rotateObject(modelViewMatrices[objectSelected], ZAxis, 45);
 			break;
 		}
 	case '1':
 		{
 			mode = ModeRotate;
-			printf("mode: rotate\n");
+			LOG_INFO("mode: rotate");
 			break;
 		}
 	case '2':
 		{
 			mode = ModeScale;
-			printf("mode: scale\n");
+			LOG_INFO("mode: scale");
 			break;
 		}
 	case '3':
 		{
 			mode = ModeTranslate;
-			printf("mode: translate\n");
+			LOG_INFO("mode: translate");
+			break;
+		}
+	case 'p':
+		{
+			// the render thread owns the profiler, and writes it out
+			// after its next frame
+			profileExports++;
+			frames.invalidate(DirtyScene);
+			break;
+		}
+	case 'g':
+		{
+			pickMode = (PickMode)((pickMode + 1) % PickModeCount);
+			LOG_INFO("picking: %s", pickModeNames[pickMode]);
+			break;
+		}
+	case 'l':
+		{
+			lighting = (LightingMode)((lighting + 1) % LightingModeCount);
+			LOG_INFO("lighting: %s%s", lightingModeNames[lighting],
+				   shadersCompiling.load() && lightingVariants[lighting] != ShaderManager::Fallback ? " (compiling)" : "");
 			break;
 		}
 	case '-':
@@ -533,18 +1090,17 @@ void keyboard( unsigned char key, int x, int y )
 				case ModeRotate:
 					switch (selectedAxis) {
 						case XAxis:
-							modelViewMatrices[objectSelected].rotate.x -= 1;
+							rotateObject(modelViewMatrices[objectSelected], XAxis, -1);
 							break;
 						case YAxis:
-							modelViewMatrices[objectSelected].rotate.y -= 1;
+							rotateObject(modelViewMatrices[objectSelected], YAxis, -1);
 							break;
 						case ZAxis:
-							modelViewMatrices[objectSelected].rotate.z -= 1;
+							rotateObject(modelViewMatrices[objectSelected], ZAxis, -1);
 							break;
 						default:
 							break;
 					}
-					glutPostRedisplay();
 					break;
 				case ModeTranslate:
 					switch (selectedAxis) {
@@ -560,7 +1116,6 @@ void keyboard( unsigned char key, int x, int y )
 						default:
 							break;
 					}
-					glutPostRedisplay();
 					break;
 				case ModeScale:
 					switch (selectedAxis) {
@@ -576,7 +1131,6 @@ void keyboard( unsigned char key, int x, int y )
 						default:
 							break;
 					}
-					glutPostRedisplay();
 					break;
 				default:
 					break;
@@ -589,18 +1143,17 @@ void keyboard( unsigned char key, int x, int y )
 				case ModeRotate:
 					switch (selectedAxis) {
 						case XAxis:
-							modelViewMatrices[objectSelected].rotate.x += 1;
+							rotateObject(modelViewMatrices[objectSelected], XAxis, 1);
 							break;
 						case YAxis:
-							modelViewMatrices[objectSelected].rotate.y += 1;
+							rotateObject(modelViewMatrices[objectSelected], YAxis, 1);
 							break;
 						case ZAxis:
-							modelViewMatrices[objectSelected].rotate.z += 1;
+							rotateObject(modelViewMatrices[objectSelected], ZAxis, 1);
 							break;
 						default:
 							break;
 					}
-					glutPostRedisplay();
 					break;
 				case ModeTranslate:
 					switch (selectedAxis) {
@@ -616,7 +1169,6 @@ void keyboard( unsigned char key, int x, int y )
 						default:
 							break;
 					}
-					glutPostRedisplay();
 					break;
 				case ModeScale:
 					switch (selectedAxis) {
@@ -632,7 +1184,6 @@ void keyboard( unsigned char key, int x, int y )
 						default:
 							break;
 					}
-					glutPostRedisplay();
 					break;
 				default:
 					break;
@@ -641,15 +1192,273 @@ void keyboard( unsigned char key, int x, int y )
 		}
     }
 
-	glutPostRedisplay();
+	unsigned changes = DirtyNone;
+	if (objectSelected != NO_OBJECT_SELECTED)
+	{
+		changes |= transformChanges(before, modelViewMatrices[objectSelected]);
+		if (changes != DirtyNone)
+			applyToSelection(before);
+	}
+	if (lighting != lightingBefore)
+		changes |= DirtyScene;
+	frames.invalidate(changes);
 
-	printf("eye= (%f, %f, %f)\nat= (%f, %f, %f)\nrotate= (%f, %f, %f)\n",
+	LOG_DEBUG("eye= (%f, %f, %f) at= (%f, %f, %f) orientation= (%f, %f, %f, %f)",
 		   modelViewMatrices[0].eye.x, modelViewMatrices[0].eye.y, modelViewMatrices[0].eye.z,
 		   modelViewMatrices[0].at.x, modelViewMatrices[0].at.y, modelViewMatrices[0].at.z,
-		   modelViewMatrices[0].rotate.x, modelViewMatrices[0].rotate.y, modelViewMatrices[0].rotate.z);
+		   modelViewMatrices[0].orientation.x, modelViewMatrices[0].orientation.y,
+		   modelViewMatrices[0].orientation.z, modelViewMatrices[0].orientation.w);
 }
 
-void mouse(int button, int state, int x, int y)
+// Eye-space ray through the center of window pixel (x, y), origin at the
+// bottom left.  sceneProjection() is a symmetric Perspective, so only its
+// scale terms are needed to undo it.
+Ray eyeRay(int x, int y)
+{
+	mat4 p = sceneProjection();
+	float ndcX = 2.0f * (x + 0.5f) / WINDOW_SIZE - 1.0f;
+	float ndcY = 2.0f * (y + 0.5f) / WINDOW_SIZE - 1.0f;
+
+	Ray ray;
+	ray.origin = vec3(0.0, 0.0, 0.0);
+	ray.direction = vec3(ndcX / p[0][0], ndcY / p[1][1], -1.0);
+	return ray;
+}
+
+struct PickResult {
+	int		object;			// NO_OBJECT_SELECTED on a miss
+	int		triangle;		// in the object's vertex array
+	Axis	axis;			// end cap hit on the selected object, or NoAxis
+	vec3	point;			// in eye space
+};
+
+// Nearest object under window pixel (x, y).  The scene hierarchy hands over
+// the objects whose boxes the ray enters, nearest first.  Every object has
+// its own view, so the ray is taken into each object's space; an affine map
+// keeps the ray parameter, so hits compare by t across objects.
+PickResult pickRay(int x, int y)
+{
+	Ray eye = eyeRay(x, y);
+
+	PickResult result;
+	result.object = NO_OBJECT_SELECTED;
+	result.triangle = -1;
+	result.axis = NoAxis;
+
+	float distance = sceneBVH.queryRay(eye, INFINITY, [&](int i, float tMax) {
+		float nearest = tMax;
+		mat4 toObject = affineInverse(objectModelView(i));
+		vec4 origin = toObject * vec4(eye.origin, 1.0);
+		vec4 direction = toObject * vec4(eye.direction, 0.0);
+
+		Ray ray;
+		ray.origin = vec3(origin.x, origin.y, origin.z);
+		ray.direction = vec3(direction.x, direction.y, direction.z);
+
+		RayHit hit;
+		hit.t = nearest;
+		if (meshBVHs[i].intersect(ray, hit))
+		{
+			nearest = hit.t;
+			result.object = i;
+			result.triangle = hit.triangle;
+			result.axis = NoAxis;
+		}
+
+		if (i == objectSelected)
+		{
+			// the end caps follow the mesh, a third of them per axis
+			int firstCap = (int)vertices[i].size() - axisLineVerticesCount - endCapVerticesCount;
+			for (int v = firstCap; v < firstCap + endCapVerticesCount; v += 3)
+			{
+				const point4* tri = &vertices[i][v];
+				float t, u, w;
+				if (intersectTriangle(ray, vec3(tri[0].x, tri[0].y, tri[0].z), vec3(tri[1].x, tri[1].y, tri[1].z),
+									  vec3(tri[2].x, tri[2].y, tri[2].z), t, u, w) && t < nearest)
+				{
+					nearest = t;
+					result.object = i;
+					result.triangle = v / 3;
+					result.axis = (Axis)((v - firstCap) / (endCapVerticesCount/3));
+				}
+			}
+		}
+		return nearest;
+	});
+
+	if (result.object != NO_OBJECT_SELECTED)
+		result.point = eye.origin + distance * eye.direction;
+	return result;
+}
+
+// Applies a click at window pixel (x, y) the way the ID pass does: an end
+// cap picks an axis of the selected object, anything else picks an object.
+void selectWithRay(int x, int y)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	PickResult pick = pickRay(x, y);
+	double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+	int objectBefore = objectSelected;
+	Axis axisBefore = selectedAxis;
+	selectObject(pick.object, pick.axis);
+
+	LOG_DEBUG("obj selected: %i, axis: %i, triangle %i at (%.3f, %.3f, %.3f), %.1f us",
+			  objectSelected, selectedAxis, pick.triangle, pick.point.x, pick.point.y, pick.point.z, us);
+
+	frames.invalidate(objectSelected != objectBefore || selectedAxis != axisBefore ? DirtySelection : DirtyNone);
+}
+
+// Makes the object the only one selected, unless the pick was on an axis
+// end cap, which picks an axis of the selection as it is
+void selectObject(int object, Axis axis)
+{
+	if (axis == NoAxis || object != objectSelected)
+	{
+		objectInSelection.assign(modelViewMatrices.size(), 0);
+		if (object != NO_OBJECT_SELECTED)
+			objectInSelection[object] = 1;
+	}
+
+	objectSelected = object;
+	selectedAxis = axis;
+}
+
+// Window position of a clip-space point in front of the eye
+inline vec2 windowPoint(const vec4& clip)
+{
+	return vec2((clip.x / clip.w + 1.0f) * 0.5f * WINDOW_SIZE, (clip.y / clip.w + 1.0f) * 0.5f * WINDOW_SIZE);
+}
+
+// Projection for just the region's pixel bounds, the way gluPickMatrix
+// narrows a pick to a few pixels
+mat4 regionProjection(const SelectionRegion& region)
+{
+	float x0 = 2.0f * region.left() / WINDOW_SIZE - 1.0f;
+	float x1 = 2.0f * region.right() / WINDOW_SIZE - 1.0f;
+	float y0 = 2.0f * region.bottom() / WINDOW_SIZE - 1.0f;
+	float y1 = 2.0f * region.top() / WINDOW_SIZE - 1.0f;
+	return Scale(2.0f / (x1 - x0), 2.0f / (y1 - y0), 1.0f) * Translate(-(x0 + x1) / 2.0f, -(y0 + y1) / 2.0f, 0.0f) * sceneProjection();
+}
+
+// Clips a clip-space triangle to the near plane and tests what is left
+bool triangleInRegion(const SelectionRegion& region, const vec4* clip)
+{
+	float d[3];
+	int inFront = 0;
+	for (int k = 0; k < 3; k++)
+	{
+		d[k] = clip[k].z + clip[k].w;
+		inFront += d[k] >= 0.0f;
+	}
+	if (inFront == 0)
+		return false;
+
+	vec2 p[4];
+	int n = 0;
+	for (int k = 0; k < 3; k++)
+	{
+		int next = (k + 1) % 3;
+		if (d[k] >= 0.0f)
+			p[n++] = windowPoint(clip[k]);
+		if ((d[k] >= 0.0f) != (d[next] >= 0.0f))
+			p[n++] = windowPoint(clip[k] + d[k] / (d[k] - d[next]) * (clip[next] - clip[k]));
+	}
+
+	return region.overlapsTriangle(p[0], p[1], p[2]) || (n == 4 && region.overlapsTriangle(p[0], p[2], p[3]));
+}
+
+// How a box's projection sits against the region.  Boxes reaching behind
+// the near plane are never settled here.
+MeshBVH::BoxOverlap boxInRegion(const AABB& box, const mat4& toClip, const SelectionRegion& region)
+{
+	vec2 lo(INFINITY), hi(-INFINITY);
+	for (int c = 0; c < 8; c++)
+	{
+		vec4 corner(c & 1 ? box.hi.x : box.lo.x, c & 2 ? box.hi.y : box.lo.y, c & 4 ? box.hi.z : box.lo.z, 1.0);
+		vec4 clip = toClip * corner;
+		if (clip.z < -clip.w)
+			return MeshBVH::BoxPartial;
+
+		vec2 p = windowPoint(clip);
+		lo.x = min(lo.x, p.x);  hi.x = max(hi.x, p.x);
+		lo.y = min(lo.y, p.y);  hi.y = max(hi.y, p.y);
+	}
+
+	if (!region.overlapsRect(lo, hi))
+		return MeshBVH::BoxOutside;
+	return region.containsRect(lo, hi) ? MeshBVH::BoxInside : MeshBVH::BoxPartial;
+}
+
+// Whether any of the object's mesh projects into the region.  Its box
+// settles most objects; the rest go down the mesh BVH, which settles
+// whole subtrees by their boxes and leaves few triangles to test.
+bool objectInRegion(int i, const SelectionRegion& region)
+{
+	mat4 toClip = sceneProjection() * objectModelView(i);
+
+	MeshBVH::BoxOverlap overlap = boxInRegion(objectBounds[i], toClip, region);
+	if (overlap != MeshBVH::BoxPartial)
+		return overlap == MeshBVH::BoxInside;
+
+	const point4* v = &vertices[i][0];
+	return meshBVHs[i].any([&](const AABB& box) {
+		return boxInRegion(box, toClip, region);
+	}, [&](int t) {
+		vec4 clip[3] = { toClip * v[3*t], toClip * v[3*t + 1], toClip * v[3*t + 2] };
+		return triangleInRegion(region, clip);
+	});
+}
+
+// Every object whose projected mesh overlaps the region, in object order.
+// The scene hierarchy narrows it to objects inside the region's bounds;
+// those are tested on the job system.
+void selectRegion(const SelectionRegion& region, vector<int>& selected)
+{
+	selected.clear();
+	if (region.empty())
+		return;
+
+	vector<int> candidates;
+	sceneBVH.queryFrustum(ViewFrustum(regionProjection(region)), [&](int i) { candidates.push_back(i); });
+
+	vector<char> inside(candidates.size(), 0);
+	jobs.parallelFor((int)candidates.size(), REGION_OBJECTS_PER_JOB, [&](int begin, int end, int) {
+		for (int c = begin; c < end; c++)
+			inside[c] = objectInRegion(candidates[c], region);
+	});
+
+	for (size_t c = 0; c < candidates.size(); c++)
+		if (inside[c])
+			selected.push_back(candidates[c]);
+	sort(selected.begin(), selected.end());
+}
+
+// Replaces the selection with what the finished drag covers
+void selectWithRegion()
+{
+	SelectionRegion region;
+	if (regionMode == RegionRectangle)
+		region.setRectangle(regionPoints.front(), regionPoints.back());
+	else
+		region.setLasso(regionPoints);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<int> selected;
+	selectRegion(region, selected);
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	objectInSelection.assign(modelViewMatrices.size(), 0);
+	for (size_t s = 0; s < selected.size(); s++)
+		objectInSelection[selected[s]] = 1;
+	objectSelected = selected.empty() ? NO_OBJECT_SELECTED : selected[0];
+	selectedAxis = NoAxis;
+
+	LOG_DEBUG("%s selected %i objects, %.2f ms", regionMode == RegionRectangle ? "rectangle" : "lasso",
+			  (int)selected.size(), ms);
+}
+
+void applyButton(int button, int state, int x, int y, int modifiers)
 {
 	if (button == GLUT_LEFT_BUTTON)
 	{
@@ -657,46 +1466,86 @@ void mouse(int button, int state, int x, int y)
 		{
 			mouseLoc.x = x;
 			mouseLoc.y = y + 2*(WINDOW_SIZE/2 - y);
-			mouseDown = true;
+
+			if (modifiers & (GLUT_ACTIVE_SHIFT | GLUT_ACTIVE_ALT))
+			{
+				regionMode = (modifiers & GLUT_ACTIVE_SHIFT) ? RegionRectangle : RegionLasso;
+				regionPoints.assign(1, vec2(mouseLoc.x + 0.5f, mouseLoc.y + 0.5f));
+			}
+			else if (pickMode == PickRay)
+				selectWithRay(mouseLoc.x, mouseLoc.y);
+			else
+			{
+				// the next frame is the pick pass
+				pickPending = true;
+				frames.invalidate(DirtySelection);
+			}
 		}
 		else if (state == GLUT_UP)
 		{
-			mouseDown = false;
 			previousMousePointX = NO_PREVIOUS_X;
-		}
 
-		glutPostRedisplay();
+			if (regionMode != RegionNone)
+			{
+				selectWithRegion();
+				regionMode = RegionNone;
+				frames.invalidate(DirtySelection);
+			}
+			else
+			{
+				// a release changes nothing on screen
+				frames.invalidate(DirtyNone);
+			}
+		}
 	}
 }
 
-void mouseDidMove(int x, int y)
+void applyMotion(int x, int y)
 {
 	mouseLoc.x = x;
 	mouseLoc.y = y + 2*(WINDOW_SIZE/2 - y);
 
+	if (regionMode != RegionNone)
+	{
+		vec2 point(mouseLoc.x + 0.5f, mouseLoc.y + 0.5f);
+		if (regionMode == RegionRectangle)
+		{
+			regionPoints.resize(2);
+			regionPoints[1] = point;
+		}
+		else if (length(point - regionPoints.back()) >= LASSO_SPACING)
+			regionPoints.push_back(point);
+
+		frames.invalidate(DirtySelection);
+		return;
+	}
+
 	if (previousMousePointX == NO_PREVIOUS_X)
 		previousMousePointX = x;
 
 	int diffX = x - previousMousePointX;
 
-	printf("x= %i, prevX = %i, diffX= %i\n", x, previousMousePointX, diffX);
+	LOG_TRACE("x= %i, prevX = %i, diffX= %i", x, previousMousePointX, diffX);
+
+	LookAtInfo before;
+	if (objectSelected != NO_OBJECT_SELECTED)
+		before = modelViewMatrices[objectSelected];
 
 	switch (mode) {
 		case ModeRotate:
 			switch (selectedAxis) {
 				case XAxis:
-					modelViewMatrices[objectSelected].rotate.x += diffX;
+					rotateObject(modelViewMatrices[objectSelected], XAxis, diffX);
 					break;
 				case YAxis:
-					modelViewMatrices[objectSelected].rotate.y += diffX;
+					rotateObject(modelViewMatrices[objectSelected], YAxis, diffX);
 					break;
 				case ZAxis:
-					modelViewMatrices[objectSelected].rotate.z += diffX;
+					rotateObject(modelViewMatrices[objectSelected], ZAxis, diffX);
 					break;
 				default:
 					break;
 			}
-			glutPostRedisplay();
 			break;
 		case ModeTranslate:
 			switch (selectedAxis) {
@@ -712,7 +1561,6 @@ void mouseDidMove(int x, int y)
 				default:
 					break;
 			}
-			glutPostRedisplay();
 			break;
 		case ModeScale:
 			switch (selectedAxis) {
@@ -728,46 +1576,156 @@ void mouseDidMove(int x, int y)
 				default:
 					break;
 			}
-			glutPostRedisplay();
 			break;
 		default:
 			break;
 	}
 
+	if (objectSelected != NO_OBJECT_SELECTED)
+	{
+		unsigned changes = transformChanges(before, modelViewMatrices[objectSelected]);
+		if (changes != DirtyNone)
+			applyToSelection(before);
+		frames.invalidate(changes);
+	}
+	else
+		frames.invalidate(DirtyNone);
+
 	previousMousePointX = x;
 }
 
+// What a keyboard or mouse edit of an object's LookAtInfo changed
+unsigned transformChanges(const LookAtInfo& before, const LookAtInfo& after)
+{
+	unsigned changes = DirtyNone;
+
+	if (memcmp(&before.eye, &after.eye, sizeof(vec4)) != 0 ||
+		memcmp(&before.at, &after.at, sizeof(vec4)) != 0)
+		changes |= DirtyCamera;
+
+	if (memcmp(&before.orientation, &after.orientation, sizeof(quat)) != 0 ||
+		memcmp(&before.scale, &after.scale, sizeof(vec3)) != 0 ||
+		memcmp(&before.translate, &after.translate, sizeof(vec3)) != 0)
+		changes |= DirtyScene;
+
+	return changes;
+}
+
+// Repeats the edit that took objectSelected from before to its current
+// transform on the rest of the selection, and refreshes their bounds
+void applyToSelection(const LookAtInfo& before)
+{
+	const LookAtInfo& after = modelViewMatrices[objectSelected];
+	int objects = (int)modelViewMatrices.size();
+	for (int i = 0; i < objects; i++)
+	{
+		if (objectInSelection[i] && i != objectSelected)
+		{
+			LookAtInfo& info = modelViewMatrices[i];
+			info.eye += after.eye - before.eye;
+			info.at += after.at - before.at;
+			info.orientation = normalize(info.orientation * conjugate(before.orientation) * after.orientation);
+			info.translate += after.translate - before.translate;
+			info.scale += after.scale - before.scale;
+			updateSceneBVH(i);
+		}
+	}
+	updateSceneBVH(objectSelected);
+}
+
 //----------------------------------------------------------------------------
 
 
+// A count from the command line, or 0 if it isn't a positive integer
+static int parseCount(const char* text)
+{
+	char* end;
+	long count = strtol(text, &end, 10);
+	if (end == text || *end != '\0' || count <= 0 || count > INT_MAX)
+		return 0;
+	return (int)count;
+}
+
+static int usage(const char* program)
+{
+	fprintf(stderr, "usage: %s [--headless frames | --software frames] [--threads n] [--dump image.ppm] [scene file]\n",
+			program);
+	return 1;
+}
+
 int main(int argc, char** argv)
 {
 	string sceneFileName;
 	vector<string> objectFileNames;
 
-	if (argc > 10)
+	logInit();
+
+	// prog [--headless frames | --software frames] [--threads n] [--dump image.ppm] [scene file]
+	int headlessFrames = 0;
+	int softwareFrames = 0;
+	int threads = 0;
+	const char* dumpPath = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			if (i + 1 == argc || (headlessFrames = parseCount(argv[++i])) == 0)
+				return usage(argv[0]);
+		}
+		else if (strcmp(argv[i], "--software") == 0)
+		{
+			if (i + 1 == argc || (softwareFrames = parseCount(argv[++i])) == 0)
+				return usage(argv[0]);
+		}
+		else if (strcmp(argv[i], "--threads") == 0)
+		{
+			if (i + 1 == argc || (threads = parseCount(argv[++i])) == 0)
+				return usage(argv[0]);
+		}
+		else if (strcmp(argv[i], "--dump") == 0)
+		{
+			if (i + 1 == argc)
+				return usage(argv[0]);
+			dumpPath = argv[++i];
+		}
+		else if (argv[i][0] == '-' || !sceneFileName.empty())
+			return usage(argv[0]);
+		else
+			sceneFileName = argv[i];
+	}
+
+	// one benchmark at a time
+	if (headlessFrames > 0 && softwareFrames > 0)
+		return usage(argv[0]);
+
+	if (!sceneFileName.empty())
 	{
-		sceneFileName = argv[1];
+		objectFileNames = readSceneFile(sceneFileName);
 	}
 	else
 	{
-		sceneFileName = "test.scn";
+		objectFileNames.push_back("bunnyS.obj");
+		objectFileNames.push_back("cow.obj");
+		objectFileNames.push_back("frog.obj");
+//		objectFileNames.push_back("sandal.obj");
+//		objectFileNames.push_back("streetlamp.obj");
+//		objectFileNames.push_back("teapotL.obj");
 	}
 
-
-//	objectFileNames = readSceneFile(sceneFileName);
-	objectFileNames.push_back("bunnyS.obj");
-	objectFileNames.push_back("cow.obj");
-	objectFileNames.push_back("frog.obj");
-//	objectFileNames.push_back("sandal.obj");
-//	objectFileNames.push_back("streetlamp.obj");
-//	objectFileNames.push_back("teapotL.obj");
-
 	for (int i = 0; i < objectFileNames.size(); i++)
 	{
 		loadObjectFromFile(objectFileNames[i]);
 	}
 
+	// frame preparation and the software rasterizer run on these
+	jobs.start(threads);
+
+	if (headlessFrames > 0)
+		return runHeadlessBenchmark(headlessFrames, dumpPath);
+	if (softwareFrames > 0)
+		return runSoftwareBenchmark(softwareFrames, dumpPath);
+
+    RenderThread::initThreads();
     glutInit(&argc, argv);
 #ifdef __APPLE__
     glutInitDisplayMode(GLUT_3_2_CORE_PROFILE | GLUT_RGBA | GLUT_DEPTH);
@@ -779,199 +1737,258 @@ int main(int argc, char** argv)
     glutInitWindowSize(WINDOW_SIZE, WINDOW_SIZE);
     glutInitWindowPosition(500, 300);
     glutCreateWindow("Simple Open GL Program");
-    printf("%s\n%s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    LOG_INFO("%s, %s", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
 
 #ifndef __APPLE__
     glewExperimental = GL_TRUE;
     glewInit();
 #endif
 
-    init();
+	// GL setup and every frame after it run on the render thread
+	renderThread.start(init, renderFrame);
+	initScene();
 
     //NOTE:  callbacks must go after window is created!!!
     glutKeyboardFunc(keyboard);
     glutDisplayFunc(display);
 	glutMouseFunc(mouse);
 	glutMotionFunc(mouseDidMove);
+#ifndef __APPLE__
+	// come back from the main loop when the window closes, so the render
+	// thread is stopped while the display connection is still open
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+#endif
     glutMainLoop();
 
+	renderThread.stop();
     return(0);
 }
 
-vector<string> readSceneFile(string fileName)
+//----------------------------------------------------------------------------
+//
+//  Headless benchmark
+//
+//    Renders frameCount frames into an offscreen framebuffer with no window,
+//    moving the objects along a fixed script so runs are comparable across
+//    commits, then prints one JSON object with the results on stdout.
+//    --software runs the same script through the software rasterizer,
+//    without a GL context.  --dump writes the last frame as a PPM.
+//
+
+#define HEADLESS_WARMUP_FRAMES 10
+
+// Deterministic per-frame edits standing in for keyboard/mouse input
+void applyScriptedFrame(int frame)
 {
-	vector<string> objectFileNames;
-	ifstream fileStream(fileName);
-	string line;
-
-	fileStream.clear();
-	if (fileStream.is_open())
+	int objects = (int)modelViewMatrices.size();
+	for (int i = 0; i < objects; i++)
 	{
-		getline(fileStream, line);
-		Splitter split(line, " ");
-
-		// get names of object files
-		while (fileStream.good())
-		{
-			getline(fileStream, line);
-			split.reset(line, " ");
-			string tmpFileName = split[0];
-			if (tmpFileName.back() == '\r')
-			{
-				tmpFileName.pop_back();
-			}
-
-			objectFileNames.push_back(tmpFileName);
-		}
-	}
-	else
-	{
-		cout << "\nCouldn't read file\n";
-		exit(1);
+		modelViewMatrices[i].orientation = FromEuler(vec3(0.5f * frame, 2.0f * frame + 30.0f * i, 0.0f));
+		modelViewMatrices[i].translate.x = 0.2f * sin(0.05f * frame);
+		modelViewMatrices[i].scale = 1.0f + 0.1f * sin(0.02f * frame + i);
+		modelViewMatrices[i].eye.z = 3.0f + 0.5f * sin(0.01f * frame);
+		updateSceneBVH(i);
 	}
 
-	return objectFileNames;
+	// walk the selection so the wireframe and axis-gizmo path is covered too
+	objectSelected = (frame / 60) % (int)(modelViewMatrices.size() + 1) - 1;
+	selectedAxis = (Axis)((frame / 20) % 3);
 }
 
-void loadObjectFromFile(string objFileName)
+double percentile(const vector<double>& sorted, double p)
 {
-//	static int offset = 0;
-	static int index = 0;
+	if (sorted.empty())
+		return 0.0;
+	size_t index = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[min(index, sorted.size() - 1)];
+}
 
-	ifstream fileStream(objFileName);
-	string line;
+// One JSON line on stdout
+void printBenchmarkReport(const char* renderer, const char* version, const vector<double>& frameTimes, long triangles)
+{
+	double total = 0.0;
+	for (size_t i = 0; i < frameTimes.size(); i++)
+		total += frameTimes[i];
+	vector<double> sorted(frameTimes);
+	sort(sorted.begin(), sorted.end());
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	double peakMB = usage.ru_maxrss / (1024.0 * 1024.0);	// bytes
+#else
+	double peakMB = usage.ru_maxrss / 1024.0;				// kilobytes
+#endif
 
-	fileStream.clear();
-	if (fileStream.is_open())
-	{
-		getline(fileStream, line);
-		Splitter split(line, " ");
+	printf("{\"renderer\": \"%s\", \"gl_version\": \"%s\", \"width\": %d, \"height\": %d, "
+		   "\"objects\": %d, \"triangles_per_frame\": %ld, \"frames\": %d, "
+		   "\"fps\": %.2f, \"frame_ms\": {\"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, "
+		   "\"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}, \"peak_rss_mb\": %.1f}\n",
+		   renderer, version, WINDOW_SIZE, WINDOW_SIZE, (int)modelViewMatrices.size(), triangles,
+		   (int)frameTimes.size(), frameTimes.size() * 1000.0 / total, total / frameTimes.size(),
+		   sorted.front(), percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 95),
+		   percentile(sorted, 99), sorted.back(), peakMB);
+}
 
-		vec4 minValues;
-		vec4 maxValues;
+int runHeadlessBenchmark(int frameCount, const char* dumpPath)
+{
+	if (!headlessCreateContext())
+		return 1;
 
-		// ignore comment lines
-		while (split[0].c_str()[0] == '#')
-		{
-			if (split[0].compare("#\tRange") == 0)
-			{
-				string value = split[2];
-				value.pop_back();
-				value.erase(0, 1);
-				minValues.x = atof(value.c_str());
+#ifndef __APPLE__
+	// GLEW's GLX setup fails without an X display, but the GL entry points
+	// it needs are loaded before that, so the result is ignored
+    glewExperimental = GL_TRUE;
+    glewInit();
+#endif
+	if (!headlessCreateFramebuffer(WINDOW_SIZE, WINDOW_SIZE))
+		return 1;
 
-				value = split[3];
-				value.pop_back();
-				minValues.y = atof(value.c_str());
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	const char* version = (const char*)glGetString(GL_VERSION);
+	LOG_INFO("headless: %s, %s", renderer, version);
 
-				value = split[4];
-				value.pop_back();
-				minValues.z = atof(value.c_str());
+	init();
+	initScene();
 
-				value = split[6];
-				value.pop_back();
-				value.erase(0, 1);
-				maxValues.x = atof(value.c_str());
+	vector<double> frameTimes;
+	frameTimes.reserve(frameCount);
+	long triangles = 0;
 
-				value = split[7];
-				value.pop_back();
-				maxValues.y = atof(value.c_str());
+	for (int f = -HEADLESS_WARMUP_FRAMES; f < frameCount; f++)
+	{
+		applyScriptedFrame(f < 0 ? 0 : f);
 
-				value = split[8];
-				value.pop_back();
-				maxValues.z = atof(value.c_str());
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
 
-				minValues.w = maxValues.w = 1.0;
-			}
-			getline(fileStream, line);
-			split.reset(line, " ");
-		}
+		profiler.beginFrame();
+		profiler.beginPass("scene");
+		prepareFrame();
+		drawScene(drawList);
+		profiler.endPass();
 
-		while (fileStream.good())
+		// wait for the GPU so the time covers the whole frame, as a swap
+		// with vsync off would
+		glFinish();
+		profiler.endFrame();
+
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		if (f >= 0)
 		{
-			vertexStore.push_back(vector<point4>());
-			vertices.push_back(vector<point4>());
+			frameTimes.push_back(ms);
+			triangles = profiler.lastFrame()->triangles;
+		}
+	}
 
-			// get vertex info
-			while (split[0].compare("v") == 0)
-			{
-				point4 vertex = point4(atof(split[1].c_str()), atof(split[2].c_str()), atof(split[3].c_str()), 1.0);
-				normalizeVector(&vertex, minValues, maxValues);
+	if (dumpPath != NULL)
+	{
+		vector<unsigned char> pixels(WINDOW_SIZE * WINDOW_SIZE * 4);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, WINDOW_SIZE, WINDOW_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+		if (!writePPM(dumpPath, &pixels[0], WINDOW_SIZE, WINDOW_SIZE))
+			LOG_ERROR("could not write %s", dumpPath);
+	}
 
-//				vertex.x -= index;
-				vertexStore[index].push_back(vertex);
-				getline(fileStream, line);
-				split.reset(line, " ");
-			}
+	printBenchmarkReport(renderer, version, frameTimes, triangles);
 
-			normalStore.push_back(vector<vec4>());
-			normals.push_back(vector<vec4>());
-			// get normals
-			while (split[0].compare("vn") == 0)
-			{
-				point4 normal = vec4(atof(split[1].c_str()), atof(split[2].c_str()), atof(split[3].c_str()), 1.0);
-				normalizeVector(&normal, minValues, maxValues);
-//				normal.x -= index;
-				normalStore[index].push_back(normal);
-				getline(fileStream, line);
-				split.reset(line, " ");
-			}
+	headlessDestroyContext();
+	return 0;
+}
 
-			while (split[0].compare("f") == 0)
-			{
-				// extract index values for faces
-				point4 vertexIndices;
-				vec4 normalIndices;
+int runSoftwareBenchmark(int frameCount, const char* dumpPath)
+{
+	SoftwareRasterizer raster(WINDOW_SIZE, WINDOW_SIZE);
+	initScene();
 
-				Splitter slashSplitter(split[1], "//");
-				vertexIndices.x = atof(slashSplitter[0].c_str());
-				normalIndices.x = atof(slashSplitter[1].c_str());
+	char renderer[64];
+	snprintf(renderer, sizeof(renderer), "software, %d threads", jobs.threadCount());
+	LOG_INFO("headless: %s", renderer);
 
-				slashSplitter.reset(split[2], "//");
-				vertexIndices.y = atof(slashSplitter[0].c_str());
-				normalIndices.y = atof(slashSplitter[1].c_str());
+	vector<double> frameTimes;
+	frameTimes.reserve(frameCount);
+	long triangles = 0;
 
-				slashSplitter.reset(split[3], "//");
-				vertexIndices.z = atof(slashSplitter[0].c_str());
-				normalIndices.z = atof(slashSplitter[1].c_str());
+	for (int f = -HEADLESS_WARMUP_FRAMES; f < frameCount; f++)
+	{
+		applyScriptedFrame(f < 0 ? 0 : f);
 
-				addTri(vertexIndices.x, vertexIndices.y, vertexIndices.z, normalIndices.x, normalIndices.y, normalIndices.z, index);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
 
-				getline(fileStream, line);
-				split.reset(line, " ");
-			}
+		profiler.beginFrame();
+		profiler.beginPass("scene");
+		prepareFrame();
+		drawSceneSoftware(raster, drawList);
+		profiler.endPass();
+		profiler.endFrame();
+
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		if (f >= 0)
+		{
+			frameTimes.push_back(ms);
+			triangles = profiler.lastFrame()->triangles;
 		}
+	}
 
-		// add axis line end cap cubes
-		addCube( vec3(-1.0, 0.0, 0.0), .1);
-		addCube( vec3(1.0, 0.0, 0.0), .1);
-		addCube( vec3(0.0, -1.0, 0.0), .1);
-		addCube( vec3(0.0, 1.0, 0.0), .1);
-		addCube( vec3(0.0, 0.0, -1.0), .1);
-		addCube( vec3(0.0, 0.0, 1.0), .1);
+	if (dumpPath != NULL && !raster.writePPM(dumpPath))
+		LOG_ERROR("could not write %s", dumpPath);
 
+	printBenchmarkReport(renderer, "none", frameTimes, triangles);
+	return 0;
+}
+
+vector<string> readSceneFile(string fileName)
+{
+	vector<string> objectFileNames;
+	ifstream fileStream(fileName);
+	string line;
 
-		// add axis lines
-		addLine(vec4(-1.0, 0.0, 0.0, 1.0), vec4(1.0, 0.0, 0.0, 1.0));
-		addLine(vec4(0.0, -1.0, 0.0, 1.0), vec4(0.0, 1.0, 0.0, 1.0));
-		addLine(vec4(0.0, 0.0, -1.0, 1.0), vec4(0.0, 0.0, 1.0, 1.0));
+	fileStream.clear();
+	if (fileStream.is_open())
+	{
+		getline(fileStream, line);
+		Splitter split(line, " ");
 
-		index++;
+		// get names of object files
+		while (fileStream.good())
+		{
+			getline(fileStream, line);
+			split.reset(line, " ");
+			string tmpFileName = split[0];
+			if (!tmpFileName.empty() && tmpFileName.back() == '\r')
+			{
+				tmpFileName.pop_back();
+			}
 
+			// skip blank lines, including the one after the last name
+			if (!tmpFileName.empty())
+				objectFileNames.push_back(tmpFileName);
+		}
 	}
 	else
 	{
-		cout << "\nCouldn't read file " << objFileName << endl;
+		cout << "\nCouldn't read file\n";
 		exit(1);
 	}
 
+	return objectFileNames;
 }
 
-
-void normalizeVector(vec4 *vector, vec4 min, vec4 max)
+void loadObjectFromFile(string objFileName)
 {
-//	(*vector).x = ((*vector).x - min.x) / (max.x - min.x);
-//	(*vector).y = ((*vector).y - min.y) / (max.y - min.y);
-//	(*vector).z = ((*vector).z - min.z) / (max.z - min.z);
-}
+	PROFILE_SCOPE("loadObjectFromFile");
 
+	vertices.push_back(vector<point4>());
+	normals.push_back(vector<vec4>());
+	if (!loadObj(objFileName, vertices.back(), normals.back()))
+	{
+		cout << "\nCouldn't read file " << objFileName << endl;
+		exit(1);
+	}
+
+	// add the axis line end cap cubes and the axis lines; the lines'
+	// normals are the points themselves
+	vector<point4>& objectVertices = vertices.back();
+	objectVertices.insert(objectVertices.end(), axisGizmo.endCaps, axisGizmo.endCaps + endCapVerticesCount);
+	objectVertices.insert(objectVertices.end(), axisGizmo.lines, axisGizmo.lines + axisLineVerticesCount);
+	normals.back().insert(normals.back().end(), axisGizmo.lines, axisGizmo.lines + axisLineVerticesCount);
+}
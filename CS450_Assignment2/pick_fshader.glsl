@@ -0,0 +1,13 @@
+#version 150
+
+// IDs for the pick buffer; 0 is left for the background
+uniform uint objectID;
+
+out uint fObjectID;
+out uint fPrimitiveID;
+
+void main()
+{
+	fObjectID = objectID;
+	fPrimitiveID = uint(gl_PrimitiveID);
+}
@@ -6,6 +6,7 @@ out vec4 color;
 
 uniform vec4 AmbientProduct, DiffuseProduct, SpecularProduct;
 uniform mat4 ModelView;
+uniform mat3 NormalMatrix;
 uniform mat4 Projection;
 uniform vec4 LightPosition;
 uniform float Shininess;
@@ -19,11 +20,9 @@ void main()
     vec3 E = normalize( -pos );
     vec3 H = normalize( L + E );  //halfway vector
 
-    // Transform vertex normal into eye coordinates
-    vec3 N = normalize( ModelView*vNormal ).xyz;
-
-    //To correctly transform normals
-    // vec3      N = (normalize (transpose (inverse (ModelView))*vNormal).xyz
+    // Transform vertex normal into eye coordinates.  NormalMatrix is
+    // transpose(inverse(ModelView)), computed once per object on the CPU.
+    vec3 N = normalize( NormalMatrix * vNormal.xyz );
 
     // Compute terms in the illumination equation
     vec4 ambient = AmbientProduct;
@@ -40,6 +39,13 @@ void main()
 
     gl_Position = Projection * ModelView * vPosition;
 
+    // Lighting variants are selected with #defines by the ShaderManager
+#if defined(LIGHTING_AMBIENT)
+    color = ambient;
+#elif defined(LIGHTING_DIFFUSE)
+    color = ambient + diffuse;
+#else
     color = ambient + diffuse + specular;
+#endif
     color.a = 1.0;
 }